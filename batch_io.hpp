@@ -0,0 +1,546 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "thread_pool.hpp"
+#include "trace.hpp"
+
+#ifdef MYGIT_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#endif
+
+/**
+ * Batched file I/O for commands that touch many files: all lstat()s of a
+ * status, all reads of the files add hashes, all writes of new loose objects.
+ * One operation at a time pays the full latency of every file in turn (a
+ * network round trip, a cold disk seek); submitted together, they overlap.
+ *
+ * Backends ([core] ioengine):
+ *   sync     (default) one blocking syscall after the other, in the calling
+ *            thread. On a local disk with a warm cache nothing beats it:
+ *            every call is a few hundred nanoseconds and there is no latency
+ *            to hide.
+ *   uring    Linux io_uring, driven with the raw syscalls: operations go into
+ *            the submission ring, at most IO_QUEUE_DEPTH in flight, and the
+ *            kernel completes them in any order. Falls back to threads when
+ *            built without it or when the kernel refuses it (too old, or
+ *            blocked by a sandbox).
+ *   threads  the same operations as blocking syscalls on IO_THREADS threads.
+ *
+ * A batch runs in phases (open every file, then read every file, then close
+ * every file), so within each phase all operations are independent.
+ */
+
+const unsigned IO_QUEUE_DEPTH = 128;
+const unsigned IO_THREADS = 32;
+
+// --- One file operation; `result` is >= 0 on success, -errno on failure ---
+struct IoOp
+{
+    enum Kind
+    {
+        LSTAT,
+        OPEN,
+        READ,
+        WRITE,
+        CLOSE,
+        RENAME
+    };
+    Kind kind = LSTAT;
+    const char *path = nullptr;
+    const char *newPath = nullptr; // RENAME
+    int fd = -1;                   // READ, WRITE, CLOSE
+    int flags = 0;                 // OPEN
+    unsigned mode = 0;             // OPEN
+    char *buf = nullptr;           // READ, WRITE
+    size_t len = 0;
+    uint64_t offset = 0;
+    struct stat *st = nullptr; // LSTAT
+    int64_t result = 0;
+
+    // --- Run it as a blocking syscall ---
+    void execute()
+    {
+        long r = 0;
+        switch (kind)
+        {
+        case LSTAT:
+            r = ::lstat(path, st);
+            break;
+        case OPEN:
+            r = ::open(path, flags, mode);
+            break;
+        case READ:
+            r = ::pread(fd, buf, len, static_cast<off_t>(offset));
+            break;
+        case WRITE:
+            r = ::pwrite(fd, buf, len, static_cast<off_t>(offset));
+            break;
+        case CLOSE:
+            r = ::close(fd);
+            break;
+        case RENAME:
+            r = ::rename(path, newPath);
+            break;
+        }
+        result = r < 0 ? -errno : r;
+    }
+};
+
+#ifdef MYGIT_HAVE_IO_URING
+// ---------- io_uring ----------
+class IoUring
+{
+public:
+    IoUring() = default;
+    IoUring(const IoUring &) = delete;
+    IoUring &operator=(const IoUring &) = delete;
+
+    ~IoUring()
+    {
+        if (sqes)
+            ::munmap(sqes, sqesSize);
+        if (cqRing && cqRing != sqRing)
+            ::munmap(cqRing, cqSize);
+        if (sqRing)
+            ::munmap(sqRing, sqSize);
+        if (fd >= 0)
+            ::close(fd);
+    }
+
+    // --- Set up the rings; false if the kernel cannot run every operation we need ---
+    bool init(unsigned depth)
+    {
+        io_uring_params p;
+        std::memset(&p, 0, sizeof(p));
+        fd = static_cast<int>(::syscall(__NR_io_uring_setup, depth, &p));
+        if (fd < 0)
+            return false;
+
+        sqSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cqSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+        if (single)
+            sqSize = cqSize = std::max(sqSize, cqSize);
+        sqRing = map(sqSize, IORING_OFF_SQ_RING);
+        cqRing = single ? sqRing : map(cqSize, IORING_OFF_CQ_RING);
+        sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe *>(map(sqesSize, IORING_OFF_SQES));
+        if (!sqRing || !cqRing || !sqes)
+            return false;
+
+        char *sq = static_cast<char *>(sqRing), *cq = static_cast<char *>(cqRing);
+        sqTail = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+        cqHead = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+        cqTail = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe *>(cq + p.cq_off.cqes);
+        entries = p.sq_entries;
+
+        // statx, openat, read, write, close (5.6) and renameat (5.11)
+        std::vector<char> buf(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op), 0);
+        auto *probe = reinterpret_cast<io_uring_probe *>(buf.data());
+        if (::syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) < 0)
+            return false;
+        for (int op : {IORING_OP_STATX, IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_WRITE, IORING_OP_CLOSE,
+                       IORING_OP_RENAMEAT})
+            if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+                return false;
+        return true;
+    }
+
+    // --- Run every op, refilling the ring as completions come back ---
+    bool run(std::vector<IoOp> &ops)
+    {
+        std::vector<struct statx> statBufs(ops.size());
+        size_t next = 0, inFlight = 0;
+        unsigned unsubmitted = 0;
+        while (next < ops.size() || inFlight > 0)
+        {
+            unsigned tail = *sqTail;
+            while (next < ops.size() && inFlight < entries)
+            {
+                unsigned slot = tail & sqMask;
+                prepare(sqes[slot], ops[next], statBufs[next]);
+                sqes[slot].user_data = next;
+                sqArray[slot] = slot;
+                tail++, next++, inFlight++, unsubmitted++;
+            }
+            __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+
+            long r = ::syscall(__NR_io_uring_enter, fd, unsubmitted, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (r < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+                return false;
+            if (r > 0)
+                unsubmitted -= static_cast<unsigned>(r);
+
+            unsigned head = *cqHead;
+            for (; head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE); head++, inFlight--)
+            {
+                const io_uring_cqe &cqe = cqes[head & cqMask];
+                IoOp &op = ops[cqe.user_data];
+                op.result = cqe.res;
+                if (op.kind == IoOp::LSTAT && cqe.res == 0)
+                    fromStatx(statBufs[cqe.user_data], *op.st);
+            }
+            __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+        }
+        traceCount("io.uring.ops", ops.size());
+        return true;
+    }
+
+private:
+    int fd = -1;
+    void *sqRing = nullptr, *cqRing = nullptr;
+    io_uring_sqe *sqes = nullptr;
+    size_t sqSize = 0, cqSize = 0, sqesSize = 0;
+    unsigned *sqTail = nullptr, *sqArray = nullptr, *cqHead = nullptr, *cqTail = nullptr;
+    unsigned sqMask = 0, cqMask = 0, entries = 0;
+    io_uring_cqe *cqes = nullptr;
+
+    void *map(size_t size, off_t offset) const
+    {
+        void *p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+        return p == MAP_FAILED ? nullptr : p;
+    }
+
+    static void prepare(io_uring_sqe &sqe, const IoOp &op, struct statx &stx)
+    {
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.fd = AT_FDCWD;
+        switch (op.kind)
+        {
+        case IoOp::LSTAT:
+            sqe.opcode = IORING_OP_STATX;
+            sqe.addr = reinterpret_cast<uint64_t>(op.path);
+            sqe.len = STATX_BASIC_STATS;
+            sqe.off = reinterpret_cast<uint64_t>(&stx);
+            sqe.statx_flags = AT_SYMLINK_NOFOLLOW;
+            break;
+        case IoOp::OPEN:
+            sqe.opcode = IORING_OP_OPENAT;
+            sqe.addr = reinterpret_cast<uint64_t>(op.path);
+            sqe.len = op.mode;
+            sqe.open_flags = static_cast<__u32>(op.flags);
+            break;
+        case IoOp::READ:
+        case IoOp::WRITE:
+            sqe.opcode = op.kind == IoOp::READ ? IORING_OP_READ : IORING_OP_WRITE;
+            sqe.fd = op.fd;
+            sqe.addr = reinterpret_cast<uint64_t>(op.buf);
+            sqe.len = static_cast<__u32>(std::min<size_t>(op.len, 1u << 30));
+            sqe.off = op.offset;
+            break;
+        case IoOp::CLOSE:
+            sqe.opcode = IORING_OP_CLOSE;
+            sqe.fd = op.fd;
+            break;
+        case IoOp::RENAME:
+            sqe.opcode = IORING_OP_RENAMEAT;
+            sqe.addr = reinterpret_cast<uint64_t>(op.path);
+            sqe.len = static_cast<__u32>(AT_FDCWD);
+            sqe.off = reinterpret_cast<uint64_t>(op.newPath);
+            break;
+        }
+    }
+
+    // --- The fields of struct stat that the index and status look at ---
+    static void fromStatx(const struct statx &stx, struct stat &st)
+    {
+        std::memset(&st, 0, sizeof(st));
+        st.st_dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+        st.st_ino = stx.stx_ino;
+        st.st_mode = stx.stx_mode;
+        st.st_nlink = stx.stx_nlink;
+        st.st_uid = stx.stx_uid;
+        st.st_gid = stx.stx_gid;
+        st.st_size = static_cast<off_t>(stx.stx_size);
+        st.st_mtim.tv_sec = stx.stx_mtime.tv_sec;
+        st.st_mtim.tv_nsec = stx.stx_mtime.tv_nsec;
+        st.st_ctim.tv_sec = stx.stx_ctime.tv_sec;
+        st.st_ctim.tv_nsec = stx.stx_ctime.tv_nsec;
+        st.st_atim.tv_sec = stx.stx_atime.tv_sec;
+        st.st_atim.tv_nsec = stx.stx_atime.tv_nsec;
+    }
+};
+#endif
+
+// ---------- Batches ----------
+class BatchIo
+{
+public:
+    enum class Backend
+    {
+        Sync,
+        Uring,
+        Threads
+    };
+
+    // --- "sync", "uring" or "threads" (anything else is sync) ---
+    static Backend backendFromName(const std::string &name)
+    {
+        return name == "uring" ? Backend::Uring : name == "threads" ? Backend::Threads : Backend::Sync;
+    }
+
+    // --- io_uring is used only if it was built in and the kernel takes it, else threads ---
+    explicit BatchIo(Backend wanted = Backend::Sync) : chosen(wanted)
+    {
+        if (chosen != Backend::Uring)
+            return;
+        chosen = Backend::Threads;
+#ifdef MYGIT_HAVE_IO_URING
+        uring = std::make_unique<IoUring>();
+        if (uring->init(IO_QUEUE_DEPTH))
+            chosen = Backend::Uring;
+        else
+            uring.reset();
+#endif
+    }
+
+    Backend backend() const { return chosen; }
+
+    const char *backendName() const
+    {
+        return chosen == Backend::Uring ? "uring" : chosen == Backend::Threads ? "threads" : "sync";
+    }
+
+    // --- Run every op (results in op.result); safe to call from several threads ---
+    void run(std::vector<IoOp> &ops)
+    {
+        if (ops.empty())
+            return;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (chosen == Backend::Sync)
+        {
+            for (auto &op : ops)
+                op.execute();
+            return;
+        }
+#ifdef MYGIT_HAVE_IO_URING
+        if (uring)
+        {
+            if (uring->run(ops))
+                return;
+            // The ring broke mid-batch: leave it and finish on threads
+            std::cerr << "Warning: io_uring failed (" << std::strerror(errno) << "), using threads.\n";
+            uring.reset();
+            chosen = Backend::Threads;
+        }
+#endif
+        // A few ops per task: one task per op costs more than a cached lstat
+        if (!pool)
+            pool = std::make_unique<ThreadPool>(IO_THREADS);
+        size_t step = std::max<size_t>(1, ops.size() / (IO_THREADS * 4));
+        for (auto &op : ops)
+            op.result = -ECANCELED; // what an op that never ran reports
+        for (size_t begin = 0; begin < ops.size(); begin += step)
+            pool->submit([&ops, begin, step]
+                         {
+                for (size_t i = begin; i < std::min(ops.size(), begin + step); i++)
+                    ops[i].execute(); });
+        if (!pool->wait())
+            std::cerr << "Error: batched I/O task failed: " << pool->error() << "\n";
+        traceCount("io.thread.ops", ops.size());
+    }
+
+    // --- lstat() every path; errors[i] is 0 or the errno of paths[i] ---
+    void lstatAll(const std::vector<std::string> &paths, std::vector<struct stat> &stats, std::vector<int> &errors)
+    {
+        TraceSpan span("io.lstat");
+        stats.assign(paths.size(), {});
+        errors.assign(paths.size(), 0);
+        std::vector<IoOp> ops(paths.size());
+        for (size_t i = 0; i < paths.size(); i++)
+        {
+            ops[i].kind = IoOp::LSTAT;
+            ops[i].path = paths[i].c_str();
+            ops[i].st = &stats[i];
+        }
+        run(ops);
+        for (size_t i = 0; i < paths.size(); i++)
+            errors[i] = ops[i].result < 0 ? static_cast<int>(-ops[i].result) : 0;
+    }
+
+    // --- Read whole files that should be sizes[i] bytes long ---
+    // A file that is not exactly that size any more (changed since its lstat)
+    // fails with ESTALE, like any other error, in errors[i].
+    void readFiles(const std::vector<std::string> &paths, const std::vector<uint64_t> &sizes,
+                   std::vector<std::string> &contents, std::vector<int> &errors)
+    {
+        TraceSpan span("io.read");
+        size_t n = paths.size();
+        contents.assign(n, std::string());
+        errors.assign(n, 0);
+        std::vector<int> fds(n, -1);
+        openAll(paths, O_RDONLY | O_CLOEXEC, 0, fds, errors);
+
+        // One extra byte, so a file that grew shows up as too long
+        std::vector<uint64_t> done(n, 0);
+        for (size_t i = 0; i < n; i++)
+            if (fds[i] >= 0)
+                contents[i].resize(sizes[i] + 1);
+        transfer(IoOp::READ, fds, errors, done, [&](size_t i)
+                 { return std::make_pair(&contents[i][0], contents[i].size()); });
+        for (size_t i = 0; i < n; i++)
+        {
+            if (!errors[i] && done[i] != sizes[i])
+                errors[i] = ESTALE;
+            contents[i].resize(errors[i] ? 0 : sizes[i]);
+        }
+        closeAll(fds, errors);
+    }
+
+    struct FileWrite
+    {
+        std::string tmpPath; // created with O_EXCL, renamed to `path` when complete
+        std::string path;
+        std::string_view data;
+    };
+
+    // --- Create every file (with `mode`) through its temp file; ok[i] tells which made it ---
+    void writeFiles(const std::vector<FileWrite> &files, unsigned mode, std::vector<char> &ok)
+    {
+        TraceSpan span("io.write");
+        size_t n = files.size();
+        std::vector<int> fds(n, -1), errors(n, 0);
+        std::vector<std::string> tmps(n);
+        for (size_t i = 0; i < n; i++)
+            tmps[i] = files[i].tmpPath;
+        openAll(tmps, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, mode, fds, errors);
+
+        std::vector<uint64_t> done(n, 0);
+        transfer(IoOp::WRITE, fds, errors, done, [&](size_t i)
+                 { return std::make_pair(const_cast<char *>(files[i].data.data()), files[i].data.size()); });
+        closeAll(fds, errors);
+
+        std::vector<IoOp> ops;
+        std::vector<size_t> which;
+        for (size_t i = 0; i < n; i++)
+        {
+            if (errors[i])
+                continue;
+            IoOp op;
+            op.kind = IoOp::RENAME;
+            op.path = files[i].tmpPath.c_str();
+            op.newPath = files[i].path.c_str();
+            ops.push_back(op);
+            which.push_back(i);
+        }
+        run(ops);
+        for (size_t k = 0; k < ops.size(); k++)
+            if (ops[k].result < 0)
+                errors[which[k]] = static_cast<int>(-ops[k].result);
+
+        ok.assign(n, 0);
+        for (size_t i = 0; i < n; i++)
+        {
+            ok[i] = !errors[i];
+            if (errors[i] && fds[i] != -2) // -2: the temp file was never created
+                ::unlink(files[i].tmpPath.c_str());
+        }
+    }
+
+private:
+    Backend chosen;
+    std::mutex mutex;
+    std::unique_ptr<ThreadPool> pool;
+#ifdef MYGIT_HAVE_IO_URING
+    std::unique_ptr<IoUring> uring;
+#endif
+
+    void openAll(const std::vector<std::string> &paths, int flags, unsigned mode, std::vector<int> &fds,
+                 std::vector<int> &errors)
+    {
+        std::vector<IoOp> ops(paths.size());
+        for (size_t i = 0; i < paths.size(); i++)
+        {
+            ops[i].kind = IoOp::OPEN;
+            ops[i].path = paths[i].c_str();
+            ops[i].flags = flags;
+            ops[i].mode = mode;
+        }
+        run(ops);
+        for (size_t i = 0; i < paths.size(); i++)
+        {
+            fds[i] = ops[i].result < 0 ? -2 : static_cast<int>(ops[i].result);
+            if (ops[i].result < 0)
+                errors[i] = static_cast<int>(-ops[i].result);
+        }
+    }
+
+    // --- Read or write until every buffer is done (short transfers are resubmitted) ---
+    template <typename BufferOf>
+    void transfer(IoOp::Kind kind, const std::vector<int> &fds, std::vector<int> &errors,
+                  std::vector<uint64_t> &done, BufferOf bufferOf)
+    {
+        std::vector<size_t> active;
+        for (size_t i = 0; i < fds.size(); i++)
+            if (fds[i] >= 0 && bufferOf(i).second > 0)
+                active.push_back(i);
+        while (!active.empty())
+        {
+            std::vector<IoOp> ops(active.size());
+            for (size_t k = 0; k < active.size(); k++)
+            {
+                auto buffer = bufferOf(active[k]);
+                ops[k].kind = kind;
+                ops[k].fd = fds[active[k]];
+                ops[k].buf = buffer.first + done[active[k]];
+                ops[k].len = buffer.second - done[active[k]];
+                ops[k].offset = done[active[k]];
+            }
+            run(ops);
+            std::vector<size_t> again;
+            for (size_t k = 0; k < active.size(); k++)
+            {
+                size_t i = active[k];
+                if (ops[k].result < 0)
+                    errors[i] = static_cast<int>(-ops[k].result);
+                else if (ops[k].result == 0)
+                    errors[i] = kind == IoOp::WRITE ? EIO : 0; // end of file
+                else if ((done[i] += static_cast<uint64_t>(ops[k].result)) < bufferOf(i).second)
+                    again.push_back(i);
+            }
+            active.swap(again);
+        }
+    }
+
+    void closeAll(std::vector<int> &fds, std::vector<int> &errors)
+    {
+        std::vector<IoOp> ops;
+        std::vector<size_t> which;
+        for (size_t i = 0; i < fds.size(); i++)
+        {
+            if (fds[i] < 0)
+                continue;
+            IoOp op;
+            op.kind = IoOp::CLOSE;
+            op.fd = fds[i];
+            ops.push_back(op);
+            which.push_back(i);
+        }
+        run(ops);
+        for (size_t k = 0; k < ops.size(); k++)
+        {
+            if (ops[k].result < 0 && !errors[which[k]])
+                errors[which[k]] = static_cast<int>(-ops[k].result);
+            fds[which[k]] = -1;
+        }
+    }
+};
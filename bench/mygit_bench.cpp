@@ -0,0 +1,584 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "hash.hpp"
+#include "repository.hpp"
+
+/**
+ * mygit_bench: times the hot paths of Repository in-process on a synthetic
+ * repository and prints the results as JSON.
+ *
+ * The repository is generated from a seed: the same options always produce the
+ * same files, the same edits and the same file timestamps, so two runs (or two
+ * builds) measure exactly the same work. Each case has an untimed setup step
+ * and a timed step; every case is run `--iterations` times and reported as
+ * min / median / mean / max wall time.
+ *
+ *   mygit_bench [--files N] [--commits M] [--sizes small|mixed|large]
+ *               [--touch K] [--seed S] [--iterations I] [--filter TEXT]
+ *               [--ioengine sync|uring|threads] [--dir DIR] [--out FILE] [--keep] [--list]
+ */
+
+namespace fs = std::filesystem;
+
+// ---------- Options ----------
+struct BenchOptions
+{
+    size_t files = 2000;      // files in the generated tree
+    size_t commits = 50;      // commits of history below HEAD
+    std::string sizes = "mixed";
+    size_t touch = 0;         // files edited per commit / dirty status (0 = 1% of files)
+    uint64_t seed = 42;
+    size_t iterations = 5;
+    std::string filter;       // run only cases whose name contains this
+    std::string ioengine;     // [core] ioengine of the benchmarked repository ("" = default)
+    std::string dir;          // parent of the scratch directory (default: temp dir)
+    std::string out;          // JSON destination (default: stdout)
+    bool keep = false;        // leave the scratch repository behind
+    bool list = false;
+};
+
+// ---------- Deterministic generator ----------
+// splitmix64: fully specified, so output does not depend on the standard library
+struct Rng
+{
+    uint64_t state;
+
+    explicit Rng(uint64_t seed) : state(seed) {}
+
+    uint64_t next()
+    {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    // --- Uniform in [lo, hi] ---
+    uint64_t range(uint64_t lo, uint64_t hi)
+    {
+        return lo + next() % (hi - lo + 1);
+    }
+};
+
+// --- File size for the chosen distribution ---
+// "mixed" roughly follows a source tree: mostly small files, a few large ones.
+size_t pickSize(Rng &rng, const std::string &sizes)
+{
+    if (sizes == "small")
+        return rng.range(64, 1024);
+    if (sizes == "large")
+        return rng.range(64 * 1024, 512 * 1024);
+    uint64_t bucket = rng.range(0, 99);
+    if (bucket < 90)
+        return rng.range(100, 4 * 1024);
+    if (bucket < 99)
+        return rng.range(4 * 1024, 64 * 1024);
+    return rng.range(64 * 1024, 1024 * 1024);
+}
+
+// --- Text made of lines of words, so diffs and deltas behave like on source ---
+std::string randomLine(Rng &rng)
+{
+    static const char *const words[] = {
+        "int", "return", "if", "else", "for", "while", "std::string", "size_t", "const", "auto",
+        "index", "entry", "tree", "commit", "hash", "path", "object", "store", "(", ")",
+        "{", "}", ";", "=", "+", "->", "value", "count", "result", "data"};
+    std::string line(rng.range(0, 3) * 4, ' ');
+    size_t n = rng.range(1, 10);
+    for (size_t i = 0; i < n; i++)
+    {
+        if (i)
+            line += ' ';
+        line += words[rng.range(0, sizeof(words) / sizeof(words[0]) - 1)];
+    }
+    line += '\n';
+    return line;
+}
+
+std::string randomText(Rng &rng, size_t size)
+{
+    std::string text;
+    text.reserve(size + 64);
+    while (text.size() < size)
+        text += randomLine(rng);
+    return text;
+}
+
+// --- "dXX/dYY/fNNNNNN.txt": 16 x 16 directories ---
+std::string filePath(size_t i)
+{
+    char buf[64];
+    std::snprintf(buf, sizeof(buf), "d%02zu/d%02zu/f%06zu.txt", i % 16, (i / 16) % 16, i);
+    return buf;
+}
+
+// Every write gets the next timestamp from a fixed epoch: runs are identical,
+// and files never look "racy" next to an index written afterwards.
+struct FileWriter
+{
+    int64_t clock = 1600000000;
+
+    bool write(const std::string &file, const std::string &content)
+    {
+        std::ofstream out(file, std::ios::binary | std::ios::trunc);
+        if (!out)
+        {
+            std::error_code ec;
+            fs::create_directories(fs::path(file).parent_path(), ec);
+            out.open(file, std::ios::binary | std::ios::trunc);
+        }
+        out << content;
+        out.close();
+        if (!out)
+            return false;
+        struct timeval times[2];
+        times[0].tv_sec = times[1].tv_sec = clock++;
+        times[0].tv_usec = times[1].tv_usec = 0;
+        return ::utimes(file.c_str(), times) == 0;
+    }
+};
+
+// ---------- Synthetic repository ----------
+struct SyntheticRepo
+{
+    const BenchOptions &options;
+    Rng rng;
+    FileWriter writer;
+    uint64_t totalBytes = 0;
+
+    explicit SyntheticRepo(const BenchOptions &opts) : options(opts), rng(opts.seed) {}
+
+    bool generateFiles()
+    {
+        for (size_t i = 0; i < options.files; i++)
+        {
+            std::string text = randomText(rng, pickSize(rng, options.sizes));
+            totalBytes += text.size();
+            if (!writer.write(filePath(i), text))
+                return false;
+        }
+        return true;
+    }
+
+    // --- Edit `count` random files: replace one line and append another ---
+    std::vector<std::string> touchFiles(size_t count)
+    {
+        std::vector<std::string> touched;
+        for (size_t n = 0; n < count; n++)
+        {
+            std::string file = filePath(rng.range(0, options.files - 1));
+            std::ifstream in(file, std::ios::binary);
+            std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            size_t at = text.empty() ? 0 : rng.range(0, text.size() - 1);
+            size_t begin = at == 0 ? std::string::npos : text.rfind('\n', at - 1);
+            begin = begin == std::string::npos ? 0 : begin + 1;
+            size_t end = text.find('\n', at);
+            end = end == std::string::npos ? text.size() : end + 1;
+            text.replace(begin, end - begin, randomLine(rng));
+            text += randomLine(rng);
+            writer.write(file, text);
+            touched.push_back(file);
+        }
+        return touched;
+    }
+};
+
+// ---------- Harness ----------
+// Repository reports on std::cout; the timed code writes into this instead
+class NullBuffer : public std::streambuf
+{
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char *, std::streamsize n) override { return n; }
+};
+
+struct BenchResult
+{
+    std::string name;
+    std::vector<double> seconds;
+    uint64_t items = 0; // files / commits processed per iteration
+    uint64_t bytes = 0; // bytes processed per iteration (0 = not meaningful)
+};
+
+struct BenchCase
+{
+    std::string name;
+    std::function<void()> setup;   // untimed, before every iteration
+    std::function<void()> run;     // timed
+    std::function<uint64_t()> items;
+    std::function<uint64_t()> bytes;
+};
+
+double median(std::vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+    size_t mid = values.size() / 2;
+    return values.size() % 2 ? values[mid] : (values[mid - 1] + values[mid]) / 2;
+}
+
+std::string jsonString(const std::string &s)
+{
+    std::string out = "\"";
+    for (char c : s)
+    {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        out += c;
+    }
+    return out + "\"";
+}
+
+void writeJson(std::ostream &out, const BenchOptions &options, size_t touch, uint64_t totalBytes,
+               const std::vector<BenchResult> &results)
+{
+    char date[32];
+    std::time_t now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+    out << "{\n  \"context\": {\n"
+        << "    \"date\": " << jsonString(date) << ",\n"
+        << "    \"seed\": " << options.seed << ",\n"
+        << "    \"files\": " << options.files << ",\n"
+        << "    \"commits\": " << options.commits << ",\n"
+        << "    \"sizes\": " << jsonString(options.sizes) << ",\n"
+        << "    \"touch\": " << touch << ",\n"
+        << "    \"total_bytes\": " << totalBytes << ",\n"
+        << "    \"iterations\": " << options.iterations << ",\n"
+        << "    \"hardware_threads\": " << std::thread::hardware_concurrency() << "\n"
+        << "  },\n  \"benchmarks\": [";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const BenchResult &r = results[i];
+        double sum = 0;
+        for (double s : r.seconds)
+            sum += s;
+        double mean = sum / r.seconds.size();
+        double med = median(r.seconds);
+        out << (i ? ",\n" : "\n") << "    {\n"
+            << "      \"name\": " << jsonString(r.name) << ",\n"
+            << "      \"iterations\": " << r.seconds.size() << ",\n"
+            << "      \"min_ms\": " << *std::min_element(r.seconds.begin(), r.seconds.end()) * 1e3 << ",\n"
+            << "      \"median_ms\": " << med * 1e3 << ",\n"
+            << "      \"mean_ms\": " << mean * 1e3 << ",\n"
+            << "      \"max_ms\": " << *std::max_element(r.seconds.begin(), r.seconds.end()) * 1e3 << ",\n"
+            << "      \"items\": " << r.items;
+        if (r.bytes)
+            out << ",\n      \"bytes\": " << r.bytes << ",\n"
+                << "      \"bytes_per_second\": " << static_cast<uint64_t>(r.bytes / med);
+        out << "\n    }";
+    }
+    out << "\n  ]\n}\n";
+}
+
+bool parseOptions(int argc, char *argv[], BenchOptions &options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string
+        {
+            if (i + 1 >= argc)
+            {
+                std::cerr << "Error: " << arg << " needs a value\n";
+                std::exit(1);
+            }
+            return argv[++i];
+        };
+        if (arg == "--files")
+            options.files = std::strtoull(value().c_str(), nullptr, 10);
+        else if (arg == "--commits")
+            options.commits = std::strtoull(value().c_str(), nullptr, 10);
+        else if (arg == "--sizes")
+            options.sizes = value();
+        else if (arg == "--touch")
+            options.touch = std::strtoull(value().c_str(), nullptr, 10);
+        else if (arg == "--seed")
+            options.seed = std::strtoull(value().c_str(), nullptr, 10);
+        else if (arg == "--iterations")
+            options.iterations = std::strtoull(value().c_str(), nullptr, 10);
+        else if (arg == "--filter")
+            options.filter = value();
+        else if (arg == "--ioengine")
+            options.ioengine = value();
+        else if (arg == "--dir")
+            options.dir = value();
+        else if (arg == "--out")
+            options.out = value();
+        else if (arg == "--keep")
+            options.keep = true;
+        else if (arg == "--list")
+            options.list = true;
+        else
+        {
+            std::cerr << "Usage: mygit_bench [--files N] [--commits M] [--sizes small|mixed|large]\n"
+                      << "                   [--touch K] [--seed S] [--iterations I] [--filter TEXT]\n"
+                      << "                   [--ioengine sync|uring|threads] [--dir DIR] [--out FILE] [--keep] [--list]\n";
+            return false;
+        }
+    }
+    if (options.files == 0 || options.iterations == 0 ||
+        (options.sizes != "small" && options.sizes != "mixed" && options.sizes != "large"))
+    {
+        std::cerr << "Error: need --files > 0, --iterations > 0 and --sizes small|mixed|large\n";
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    BenchOptions options;
+    if (!parseOptions(argc, argv, options))
+        return 1;
+    const size_t touch = options.touch ? options.touch : std::max<size_t>(1, options.files / 100);
+
+    // --- Scratch directory; every case runs with it as the working directory ---
+    std::error_code ec;
+    fs::path parent = options.dir.empty() ? fs::temp_directory_path(ec) : fs::path(options.dir);
+    std::string scratch = (parent / "mygit_bench.XXXXXX").string();
+    if (!::mkdtemp(scratch.data()))
+    {
+        std::cerr << "Error: cannot create a directory in " << parent << ": " << std::strerror(errno) << "\n";
+        return 1;
+    }
+    const fs::path home = fs::current_path();
+    fs::current_path(scratch);
+
+    std::streambuf *stdoutBuf = std::cout.rdbuf();
+    NullBuffer nullBuf;
+    std::cout.rdbuf(&nullBuf);
+
+    SyntheticRepo synth(options);
+    std::vector<std::string> blobs; // hash input, capped at 64 MiB
+    uint64_t blobBytes = 0;
+
+    auto freshRepo = [&]()
+    {
+        fs::remove_all(".mygit");
+        Repository repo;
+        repo.init();
+        repo.setAuthorName("Bench");
+        repo.setAuthorEmail("bench@example.com");
+        if (!options.ioengine.empty())
+        {
+            auto cfg = repo.readConfig();
+            cfg["ioengine"] = options.ioengine;
+            repo.writeConfig(cfg);
+        }
+    };
+    size_t commitsMade = 0;
+    auto ensureHistory = [&]()
+    {
+        if (commitsMade > 0)
+            return;
+        Repository repo;
+        repo.add({"."});
+        repo.commit("initial");
+        for (commitsMade = 1; commitsMade < options.commits; commitsMade++)
+        {
+            synth.touchFiles(touch);
+            repo.add({"."});
+            repo.commit("commit " + std::to_string(commitsMade));
+        }
+    };
+
+    std::vector<BenchCase> cases = {
+        {"hash/blobs",
+         [&]()
+         {
+             if (!blobs.empty())
+                 return;
+             for (size_t i = 0; i < options.files && blobBytes < (64u << 20); i++)
+             {
+                 std::ifstream in(filePath(i), std::ios::binary);
+                 std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+                 blobBytes += content.size();
+                 blobs.push_back("blob " + std::to_string(content.size()) + '\0' + content);
+             }
+         },
+         [&]()
+         {
+             for (const auto &blob : blobs)
+                 hashBytes(blob);
+         },
+         [&]() { return static_cast<uint64_t>(blobs.size()); },
+         [&]() { return blobBytes; }},
+
+        {"add/initial",
+         [&]()
+         {
+             freshRepo();
+             commitsMade = 0;
+         },
+         [&]() { Repository().add({"."}); },
+         [&]() { return static_cast<uint64_t>(options.files); },
+         [&]() { return synth.totalBytes; }},
+
+        {"log/all",
+         [&]() { ensureHistory(); },
+         [&]() { Repository().logCommits(); },
+         [&]() { return static_cast<uint64_t>(commitsMade); },
+         nullptr},
+
+        {"diff/history",
+         [&]() { ensureHistory(); },
+         [&]()
+         {
+             // Every tree is both the new side of one diff and the old side of
+             // the next, so the second visit comes from the object cache
+             Repository repo;
+             const CommitGraph &graph = repo.commitGraph();
+             std::vector<Repository::FileChange> changes;
+             for (uint32_t pos = 0; pos < graph.size(); pos++)
+                 graph.forEachParent(pos, [&](uint32_t parent)
+                                     { repo.diffTrees(graph.treeAt(parent), graph.treeAt(pos), "", changes); });
+         },
+         [&]() { return static_cast<uint64_t>(commitsMade); },
+         nullptr},
+
+        {"add/unchanged",
+         [&]() { ensureHistory(); },
+         [&]() { Repository().add({"."}); },
+         [&]() { return static_cast<uint64_t>(options.files); },
+         nullptr},
+
+        {"status/clean",
+         [&]() { ensureHistory(); },
+         [&]() { Repository().status(); },
+         [&]() { return static_cast<uint64_t>(options.files); },
+         nullptr},
+
+        {"write_tree/full",
+         [&]() { ensureHistory(); },
+         [&]()
+         {
+             Repository repo;
+             Index index;
+             index.load(repo.path + "/index");
+             index.cacheTree.clear();
+             repo.writeTreeFromIndex(index);
+         },
+         [&]() { return static_cast<uint64_t>(options.files); },
+         nullptr},
+
+        {"write_tree/incremental",
+         [&]() { ensureHistory(); },
+         [&]()
+         {
+             // the cache tree is invalidated for `touch` paths, as add would do
+             Repository repo;
+             Index index;
+             index.load(repo.path + "/index");
+             Rng pick(options.seed);
+             for (size_t n = 0; n < touch; n++)
+                 index.invalidate(filePath(pick.range(0, options.files - 1)));
+             repo.writeTreeFromIndex(index);
+         },
+         [&]() { return static_cast<uint64_t>(touch); },
+         nullptr},
+
+        {"commit",
+         [&]()
+         {
+             ensureHistory();
+             synth.touchFiles(touch);
+             Repository().add({"."});
+         },
+         [&]()
+         {
+             Repository().commit("bench commit");
+             commitsMade++;
+         },
+         [&]() { return static_cast<uint64_t>(touch); },
+         nullptr},
+
+        {"status/dirty",
+         [&]()
+         {
+             ensureHistory();
+             synth.touchFiles(touch);
+         },
+         [&]() { Repository().status(); },
+         [&]() { return static_cast<uint64_t>(options.files); },
+         nullptr},
+
+        {"diff/worktree",
+         [&]() { ensureHistory(); },
+         [&]() { Repository().diff({}); },
+         [&]() { return static_cast<uint64_t>(touch); },
+         nullptr},
+    };
+
+    if (options.list)
+    {
+        std::ostream list(stdoutBuf);
+        for (const auto &c : cases)
+            list << c.name << "\n";
+    }
+    else
+    {
+        std::cerr << "Generating " << options.files << " files (" << options.sizes << ", seed " << options.seed
+                  << ") in " << scratch << "\n";
+        if (!synth.generateFiles())
+        {
+            std::cerr << "Error: cannot write the synthetic tree\n";
+            return 1;
+        }
+        freshRepo();
+
+        std::vector<BenchResult> results;
+        for (const auto &c : cases)
+        {
+            if (!options.filter.empty() && c.name.find(options.filter) == std::string::npos)
+                continue;
+            BenchResult result;
+            result.name = c.name;
+            for (size_t i = 0; i < options.iterations; i++)
+            {
+                c.setup();
+                auto start = std::chrono::steady_clock::now();
+                c.run();
+                auto stop = std::chrono::steady_clock::now();
+                result.seconds.push_back(std::chrono::duration<double>(stop - start).count());
+            }
+            result.items = c.items ? c.items() : 0;
+            result.bytes = c.bytes ? c.bytes() : 0;
+            std::cerr << "  " << c.name << ": " << median(result.seconds) * 1e3 << " ms\n";
+            results.push_back(result);
+        }
+
+        if (options.out.empty())
+        {
+            std::ostream json(stdoutBuf);
+            writeJson(json, options, touch, synth.totalBytes, results);
+        }
+        else
+        {
+            std::ofstream json(home / options.out);
+            writeJson(json, options, touch, synth.totalBytes, results);
+        }
+    }
+
+    std::cout.rdbuf(stdoutBuf);
+    fs::current_path(home);
+    if (!options.keep)
+        fs::remove_all(scratch, ec);
+    return 0;
+}
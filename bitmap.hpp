@@ -0,0 +1,299 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "hash.hpp"
+#include "lockfile.hpp"
+#include "mapped_file.hpp"
+#include "pack.hpp"
+
+/**
+ * Reachability bitmaps: for selected commits, every object reachable from
+ * them as one bit per object of a pack (bit i = the i-th id of its .idx).
+ * "Reachable from X but not Y" is then an OR of stored bitmaps plus a short
+ * walk from X and Y down to the nearest bitmapped commits, and an AND-NOT.
+ *
+ * Layout of "pack-<checksum>.bitmap", next to its pack (integers big-endian):
+ *   "MBMP" | u32 version (1) | u32 entry count | pack checksum
+ *   type bitmaps: commits | trees | blobs | others (tags, chunk lists)
+ *   per selected commit, sorted by id: raw commit id | bitmap
+ *   checksum of everything above
+ *
+ * Bitmaps are EWAH-compressed, in the same encoding git uses:
+ *   u32 bit count | u32 word count | u64 words | u32 index of the last marker
+ * The words are groups of one marker followed by literal words. A marker holds
+ * the running bit (bit 0), a count of all-0 or all-1 words (bits 1-32) and the
+ * number of literal words after it (bits 33-63), so long stretches of absent
+ * (or present) objects cost a single word.
+ */
+
+// ---------- Plain bitmap (what the set operations work on) ----------
+class Bitmap
+{
+public:
+    std::vector<uint64_t> words;
+
+    void set(size_t bit)
+    {
+        if (bit / 64 >= words.size())
+            words.resize(bit / 64 + 1);
+        words[bit / 64] |= 1ull << (bit % 64);
+    }
+
+    bool get(size_t bit) const
+    {
+        return bit / 64 < words.size() && ((words[bit / 64] >> (bit % 64)) & 1);
+    }
+
+    Bitmap &operator|=(const Bitmap &other)
+    {
+        if (other.words.size() > words.size())
+            words.resize(other.words.size());
+        for (size_t i = 0; i < other.words.size(); i++)
+            words[i] |= other.words[i];
+        return *this;
+    }
+
+    Bitmap &operator&=(const Bitmap &other)
+    {
+        if (words.size() > other.words.size())
+            words.resize(other.words.size());
+        for (size_t i = 0; i < words.size(); i++)
+            words[i] &= other.words[i];
+        return *this;
+    }
+
+    // --- Remove every bit that is set in `other` ---
+    Bitmap &andNot(const Bitmap &other)
+    {
+        for (size_t i = 0; i < words.size() && i < other.words.size(); i++)
+            words[i] &= ~other.words[i];
+        return *this;
+    }
+
+    size_t count() const
+    {
+        size_t n = 0;
+        for (uint64_t w : words)
+            n += static_cast<size_t>(__builtin_popcountll(w));
+        return n;
+    }
+
+    // --- fn(bit) for every set bit, in ascending order ---
+    template <typename Fn>
+    void forEach(Fn fn) const
+    {
+        for (size_t i = 0; i < words.size(); i++)
+            for (uint64_t w = words[i]; w; w &= w - 1)
+                fn(i * 64 + static_cast<size_t>(__builtin_ctzll(w)));
+    }
+};
+
+inline void putBE64(std::string &buf, uint64_t v)
+{
+    putBE32(buf, static_cast<uint32_t>(v >> 32));
+    putBE32(buf, static_cast<uint32_t>(v));
+}
+
+inline uint64_t getBE64(const unsigned char *p)
+{
+    return (uint64_t(getBE32(p)) << 32) | getBE32(p + 4);
+}
+
+// ---------- EWAH encoding ----------
+inline void ewahWrite(const Bitmap &bitmap, std::string &out)
+{
+    const std::vector<uint64_t> &w = bitmap.words;
+    const uint64_t MAX_RUN = 0xffffffffull, MAX_LITERALS = 0x7fffffffull;
+    std::vector<uint64_t> buf;
+    size_t marker = 0;
+    size_t i = 0;
+    do
+    {
+        marker = buf.size();
+        buf.push_back(0);
+        uint64_t run = 0, literals = 0;
+        bool bit = i < w.size() && w[i] == ~0ull;
+        while (i < w.size() && w[i] == (bit ? ~0ull : 0) && run < MAX_RUN)
+            run++, i++;
+        while (i < w.size() && w[i] != 0 && w[i] != ~0ull && literals < MAX_LITERALS)
+        {
+            buf.push_back(w[i++]);
+            literals++;
+        }
+        buf[marker] = uint64_t(bit) | (run << 1) | (literals << 33);
+    } while (i < w.size());
+
+    putBE32(out, static_cast<uint32_t>(w.size() * 64));
+    putBE32(out, static_cast<uint32_t>(buf.size()));
+    for (uint64_t word : buf)
+        putBE64(out, word);
+    putBE32(out, static_cast<uint32_t>(marker));
+}
+
+// --- Decode the bitmap at `pos` (advanced past it) ---
+inline bool ewahRead(const unsigned char *p, size_t size, size_t &pos, Bitmap &out)
+{
+    if (pos + 8 > size)
+        return false;
+    uint32_t bits = getBE32(p + pos);
+    uint32_t count = getBE32(p + pos + 4);
+    if (pos + 8 + count * 8ull + 4 > size)
+        return false;
+    const unsigned char *w = p + pos + 8;
+    pos += 8 + count * 8ull + 4;
+
+    size_t wordCount = (bits + 63ull) / 64;
+    out.words.clear();
+    out.words.reserve(wordCount);
+    for (uint32_t i = 0; i < count;)
+    {
+        uint64_t marker = getBE64(w + i++ * 8ull);
+        uint64_t run = (marker >> 1) & 0xffffffffull;
+        uint64_t literals = marker >> 33;
+        if (i + literals > count || out.words.size() + run + literals > wordCount)
+            return false;
+        out.words.insert(out.words.end(), run, (marker & 1) ? ~0ull : 0);
+        for (uint64_t k = 0; k < literals; k++)
+            out.words.push_back(getBE64(w + i++ * 8ull));
+    }
+    out.words.resize(wordCount);
+    return true;
+}
+
+// ---------- The .bitmap file of one pack ----------
+class PackBitmaps
+{
+public:
+    enum ObjectKind
+    {
+        COMMITS,
+        TREES,
+        BLOBS,
+        OTHERS
+    };
+
+    static std::string pathFor(const std::string &packPath)
+    {
+        return packPath.substr(0, packPath.size() - 5) + ".bitmap";
+    }
+
+    // --- Map the bitmap file of `pack`; fails if there is none or it belongs to another pack ---
+    bool load(const Pack &pack)
+    {
+        ids.clear();
+        offsets.clear();
+        size_t idSize = hashAlgo().rawSize;
+        if (!map.open(pathFor(pack.packPath)))
+            return false;
+        const unsigned char *p = map.data();
+        size_t n = map.size();
+        if (n < 12 + 2 * idSize || std::memcmp(p, "MBMP", 4) != 0 || getBE32(p + 4) != 1 ||
+            ObjectId::fromRaw(p + 12, idSize) != pack.checksum())
+            return false;
+        uint32_t count = getBE32(p + 8);
+
+        size_t pos = 12 + idSize;
+        for (auto &type : types)
+            if (!ewahRead(p, n - idSize, pos, type))
+                return false;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            if (pos + idSize + 8 > n - idSize)
+                return false;
+            ids.push_back(ObjectId::fromRaw(p + pos, idSize));
+            pos += idSize;
+            offsets.push_back(pos);
+            pos += 8 + getBE32(p + pos + 4) * 8ull + 4; // skip the bitmap
+        }
+        return pos + idSize == n;
+    }
+
+    size_t size() const { return ids.size(); }
+
+    // --- Objects of one kind (a bit per pack object, like the commit bitmaps) ---
+    const Bitmap &ofKind(ObjectKind kind) const { return types[kind]; }
+
+    // --- Everything reachable from `commit`, if it is one of the selected commits ---
+    bool find(const ObjectId &commit, Bitmap &out) const
+    {
+        auto it = std::lower_bound(ids.begin(), ids.end(), commit);
+        if (it == ids.end() || *it != commit)
+            return false;
+        size_t pos = offsets[it - ids.begin()];
+        return ewahRead(map.data(), map.size(), pos, out);
+    }
+
+private:
+    MappedFile map;
+    Bitmap types[4];
+    std::vector<ObjectId> ids; // sorted
+    std::vector<size_t> offsets;
+};
+
+// --- Write the .bitmap file of `pack`; `commits` may be in any order ---
+inline bool writePackBitmaps(const Pack &pack, const Bitmap (&types)[4],
+                             std::vector<std::pair<ObjectId, Bitmap>> commits)
+{
+    std::sort(commits.begin(), commits.end(), [](const auto &a, const auto &b)
+              { return a.first < b.first; });
+    std::string buf = "MBMP";
+    putBE32(buf, 1);
+    putBE32(buf, static_cast<uint32_t>(commits.size()));
+    buf += pack.checksum().raw();
+    for (const auto &type : types)
+        ewahWrite(type, buf);
+    for (const auto &commit : commits)
+    {
+        buf += commit.first.raw();
+        ewahWrite(commit.second, buf);
+    }
+    buf += hashBytes(buf).raw();
+
+    // Under "<bitmap>.lock", like every rewritten file: concurrent gc runs cannot
+    // interleave, and a short write or crash never leaves a torn bitmap in place
+    LockFile lock;
+    return lock.acquire(PackBitmaps::pathFor(pack.packPath)) && lock.write(buf) && lock.sync() && lock.commit();
+}
+
+// ---------- Bit positions during a walk ----------
+// Objects of the bitmapped pack keep their pack position; any other object
+// (loose, or in a pack without bitmaps) is numbered after them as it is found.
+class ObjectPositions
+{
+public:
+    explicit ObjectPositions(const Pack *pack = nullptr) : pack(pack) {}
+
+    uint32_t packedCount() const { return pack ? pack->size() : 0; }
+
+    uint32_t position(const ObjectId &id)
+    {
+        uint32_t pos;
+        if (pack && pack->findPosition(id, pos))
+            return pos;
+        auto it = extra.find(id);
+        if (it != extra.end())
+            return it->second;
+        pos = packedCount() + static_cast<uint32_t>(extraIds.size());
+        extra.emplace(id, pos);
+        extraIds.push_back(id);
+        return pos;
+    }
+
+    bool hasExtra() const { return !extraIds.empty(); }
+
+    ObjectId idAt(uint32_t pos) const
+    {
+        return pos < packedCount() ? pack->hashAt(pos) : extraIds[pos - packedCount()];
+    }
+
+private:
+    const Pack *pack;
+    std::unordered_map<ObjectId, uint32_t> extra;
+    std::vector<ObjectId> extraIds;
+};
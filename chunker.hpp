@@ -0,0 +1,88 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Content-defined chunking (FastCDC) for large files.
+ *
+ * Cut points are chosen by the content itself: a gear hash rolls over the
+ * bytes and a chunk ends where its top bits are all zero. An edit only moves
+ * the cut points next to it, so after a change in the middle of a big file
+ * every other chunk is byte-identical to before and is already stored.
+ *
+ *   gear hash   fp = (fp << 1) + GEAR[byte]   (the last 64 bytes decide fp)
+ *   skipping    the first CDC_MIN_SIZE bytes of a chunk are never hashed
+ *   normalized  a stricter mask (more bits) before CDC_AVG_SIZE, a looser
+ *               one after, so chunk sizes cluster around the average
+ *
+ * The gear table is derived from a fixed seed: the same file always splits
+ * the same way, which is what makes its chunk list id stable.
+ */
+
+const size_t CDC_MIN_SIZE = 64 * 1024;
+const size_t CDC_AVG_SIZE = 256 * 1024; // 2^18
+const size_t CDC_MAX_SIZE = 1024 * 1024;
+
+// 18 +/- 2 one-bits at the top of the fingerprint
+const uint64_t CDC_MASK_STRICT = ~0ull << (64 - 20);
+const uint64_t CDC_MASK_LOOSE = ~0ull << (64 - 16);
+
+// --- 256 random 64-bit values (splitmix64 from a fixed seed) ---
+inline const std::array<uint64_t, 256> &cdcGearTable()
+{
+    static const std::array<uint64_t, 256> table = []
+    {
+        std::array<uint64_t, 256> t{};
+        uint64_t state = 0x6d79676974636463ull; // "mygitcdc"
+        for (auto &v : t)
+        {
+            uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            v = z ^ (z >> 31);
+        }
+        return t;
+    }();
+    return table;
+}
+
+// --- Length of the chunk that starts at `data` (`size` bytes are left) ---
+inline size_t cdcNextCut(const unsigned char *data, size_t size)
+{
+    if (size <= CDC_MIN_SIZE)
+        return size;
+    const uint64_t *gear = cdcGearTable().data();
+    size_t normal = size < CDC_AVG_SIZE ? size : CDC_AVG_SIZE;
+    size_t end = size < CDC_MAX_SIZE ? size : CDC_MAX_SIZE;
+    uint64_t fp = 0;
+    size_t i = CDC_MIN_SIZE;
+    for (; i < normal; i++)
+    {
+        fp = (fp << 1) + gear[data[i]];
+        if (!(fp & CDC_MASK_STRICT))
+            return i + 1;
+    }
+    for (; i < end; i++)
+    {
+        fp = (fp << 1) + gear[data[i]];
+        if (!(fp & CDC_MASK_LOOSE))
+            return i + 1;
+    }
+    return end;
+}
+
+// --- Call fn(offset, length) for every chunk of `data`, in order ---
+template <typename Fn>
+bool forEachCdcChunk(const unsigned char *data, size_t size, Fn fn)
+{
+    for (size_t offset = 0; offset < size;)
+    {
+        size_t length = cdcNextCut(data + offset, size - offset);
+        if (!fn(offset, length))
+            return false;
+        offset += length;
+    }
+    return true;
+}
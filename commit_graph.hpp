@@ -0,0 +1,456 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "hash.hpp"
+#include "lockfile.hpp"
+#include "mapped_file.hpp"
+#include "pack.hpp"
+
+/**
+ * Commit-graph: every known commit's parents, root tree, generation number and
+ * timestamp in one sorted, memory-mapped file, so history walks and ancestry
+ * queries never have to open or parse commit objects.
+ *
+ * Layout of ".mygit/objects/info/commit-graph" (integers big-endian):
+ *   "MCGR" | u32 version (1) | u32 commit count | u32 extra edge count
+ *   u32 fanout[256]
+ *   sorted raw commit ids
+ *   per commit: raw tree id | u32 parent1 | u32 parent2 | u32 generation | u64 time
+ *   u32 extra edges
+ *   checksum of everything above
+ *
+ * Ids and the checksum are hashAlgo().rawSize bytes (20 for SHA-1).
+ *
+ * Parents are positions in the sorted id table. NO_PARENT marks a missing
+ * parent. If parent2 has the high bit set, the commit has more than two parents
+ * and the low bits index the extra edge list, which continues until an entry
+ * with the high bit set (the same trick git uses for octopus merges).
+ *
+ * The generation number is 1 for a root commit and 1 + the highest parent
+ * generation otherwise, so a commit can never be an ancestor of a commit with a
+ * lower or equal generation; walks use it to stop early.
+ *
+ * The file is rewritten under "commit-graph.lock" (lockfile.hpp). load() checks
+ * the trailing checksum and that every parent position is inside the graph; a
+ * file that fails either is ignored, and callers fall back to the objects.
+ */
+
+struct CommitGraphEntry
+{
+    ObjectId hash;
+    ObjectId tree;
+    std::vector<ObjectId> parents;
+    uint64_t time = 0;
+    uint32_t generation = 0;
+};
+
+class CommitGraph
+{
+public:
+    static const uint32_t NO_PARENT = 0x70000000u;
+    static const uint32_t EXTRA_EDGES = 0x80000000u;
+
+    bool load(const std::string &file)
+    {
+        count = 0;
+        idSize = hashAlgo().rawSize;
+        recordSize = idSize + 4 + 4 + 4 + 8;
+        if (!map.open(file))
+            return false;
+        const unsigned char *p = map.data();
+        if (map.size() < 16 + 256 * 4 + idSize || std::memcmp(p, "MCGR", 4) != 0 || getBE32(p + 4) != 1)
+        {
+            map.close();
+            return false;
+        }
+        count = getBE32(p + 8);
+        extraCount = getBE32(p + 12);
+        if (map.size() != recordStart() + count * recordSize + extraCount * 4ull + idSize ||
+            hashBytes(p, map.size() - idSize) != ObjectId::fromRaw(p + map.size() - idSize, idSize) ||
+            !parentsInRange())
+        {
+            map.close();
+            count = 0;
+            return false;
+        }
+        return true;
+    }
+
+    bool isLoaded() const { return map.isOpen() && count > 0; }
+    uint32_t size() const { return count; }
+
+    // --- Fan-out + binary search lookup ---
+    bool find(const ObjectId &id, uint32_t &pos) const
+    {
+        if (!isLoaded() || id.size() != idSize)
+            return false;
+        const unsigned char *p = map.data();
+        unsigned char first = id.data()[0];
+        uint32_t lo = first == 0 ? 0 : getBE32(p + 16 + (first - 1) * 4);
+        uint32_t hi = getBE32(p + 16 + first * 4);
+        while (lo < hi)
+        {
+            uint32_t mid = lo + (hi - lo) / 2;
+            int cmp = std::memcmp(p + idStart() + mid * idSize, id.data(), idSize);
+            if (cmp == 0)
+            {
+                pos = mid;
+                return true;
+            }
+            if (cmp < 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return false;
+    }
+
+    // Every commit whose hex id starts with `prefix`
+    std::vector<uint32_t> findPrefix(const std::string &prefix) const
+    {
+        std::vector<uint32_t> found;
+        for (uint32_t i = 0; i < count; i++)
+            if (hashAt(i).hex().compare(0, prefix.size(), prefix) == 0)
+                found.push_back(i);
+        return found;
+    }
+
+    ObjectId hashAt(uint32_t pos) const
+    {
+        return ObjectId::fromRaw(map.data() + idStart() + pos * idSize, idSize);
+    }
+
+    ObjectId treeAt(uint32_t pos) const
+    {
+        return ObjectId::fromRaw(record(pos), idSize);
+    }
+
+    uint32_t generationAt(uint32_t pos) const
+    {
+        return getBE32(record(pos) + idSize + 8);
+    }
+
+    uint64_t timeAt(uint32_t pos) const
+    {
+        const unsigned char *r = record(pos) + idSize + 12;
+        return (uint64_t(getBE32(r)) << 32) | getBE32(r + 4);
+    }
+
+    template <typename Fn>
+    void forEachParent(uint32_t pos, Fn fn) const
+    {
+        const unsigned char *r = record(pos);
+        uint32_t p1 = getBE32(r + idSize);
+        uint32_t p2 = getBE32(r + idSize + 4);
+        if (p1 == NO_PARENT)
+            return;
+        fn(p1);
+        if (p2 == NO_PARENT)
+            return;
+        if (!(p2 & EXTRA_EDGES))
+        {
+            fn(p2);
+            return;
+        }
+        const unsigned char *edges = map.data() + recordStart() + count * recordSize;
+        for (uint32_t i = p2 & ~EXTRA_EDGES; i < extraCount; i++)
+        {
+            uint32_t edge = getBE32(edges + i * 4ull);
+            if ((edge & ~EXTRA_EDGES) != NO_PARENT)
+                fn(edge & ~EXTRA_EDGES);
+            if (edge & EXTRA_EDGES)
+                break;
+        }
+    }
+
+    // --- Is `ancestor` reachable from `descendant`? ---
+    // Only commits with a generation above the ancestor's can lead to it.
+    bool isAncestor(uint32_t ancestor, uint32_t descendant) const
+    {
+        if (ancestor == descendant)
+            return true;
+        uint32_t minGeneration = generationAt(ancestor);
+        std::vector<char> seen(count, 0);
+        std::vector<uint32_t> stack{descendant};
+        seen[descendant] = 1;
+        while (!stack.empty())
+        {
+            uint32_t pos = stack.back();
+            stack.pop_back();
+            bool found = false;
+            forEachParent(pos, [&](uint32_t parent)
+                          {
+                if (parent == ancestor)
+                    found = true;
+                if (!seen[parent] && generationAt(parent) > minGeneration)
+                {
+                    seen[parent] = 1;
+                    stack.push_back(parent);
+                } });
+            if (found)
+                return true;
+        }
+        return false;
+    }
+
+    // --- Best common ancestors of a and b ---
+    // Paints both sides down a generation-ordered priority queue. A commit reached
+    // from both sides is a candidate; everything below a candidate is marked stale.
+    // The walk ends as soon as only stale commits remain, so it is bounded by the
+    // divergence of the two lines, not by the length of history.
+    std::vector<uint32_t> mergeBases(uint32_t a, uint32_t b) const
+    {
+        if (a == b)
+            return {a};
+
+        const uint8_t SIDE_A = 1, SIDE_B = 2, STALE = 4, RESULT = 8;
+        std::unordered_map<uint32_t, uint8_t> flags;
+        auto cmp = [this](uint32_t x, uint32_t y)
+        {
+            uint32_t gx = generationAt(x), gy = generationAt(y);
+            return gx != gy ? gx < gy : timeAt(x) < timeAt(y);
+        };
+        std::priority_queue<uint32_t, std::vector<uint32_t>, decltype(cmp)> queue(cmp);
+
+        flags[a] = SIDE_A;
+        flags[b] = SIDE_B;
+        queue.push(a);
+        queue.push(b);
+        size_t nonStale = 2;
+
+        std::vector<uint32_t> results;
+        while (!queue.empty() && nonStale > 0)
+        {
+            uint32_t pos = queue.top();
+            queue.pop();
+            uint8_t f = flags[pos];
+            if (!(f & STALE))
+                nonStale--;
+
+            uint8_t sides = f & (SIDE_A | SIDE_B);
+            if (sides == (SIDE_A | SIDE_B) && !(f & (STALE | RESULT)))
+            {
+                flags[pos] |= RESULT;
+                results.push_back(pos);
+                sides |= STALE;
+            }
+            else if (f & STALE)
+                sides |= STALE;
+
+            forEachParent(pos, [&](uint32_t parent)
+                          {
+                uint8_t &pf = flags[parent];
+                if ((pf & sides) == sides)
+                    return;
+                bool wasQueued = pf != 0;
+                bool wasStale = (pf & STALE) != 0;
+                pf |= sides;
+                if (!wasQueued)
+                {
+                    queue.push(parent);
+                    if (!(pf & STALE))
+                        nonStale++;
+                }
+                else if (!wasStale && (pf & STALE))
+                    nonStale--; });
+        }
+
+        // Drop candidates that are ancestors of other candidates
+        std::vector<uint32_t> best;
+        for (uint32_t r : results)
+        {
+            bool redundant = false;
+            for (uint32_t other : results)
+                if (other != r && isAncestor(r, other))
+                    redundant = true;
+            if (!redundant)
+                best.push_back(r);
+        }
+        return best;
+    }
+
+    // --- Newest-first walk over everything reachable from `start` ---
+    // Ordered by commit time (generation breaks ties), so merged lines interleave
+    // the way git log shows them; fn returns false to stop.
+    template <typename Fn>
+    void walk(uint32_t start, Fn fn) const
+    {
+        auto cmp = [this](uint32_t x, uint32_t y)
+        {
+            uint64_t tx = timeAt(x), ty = timeAt(y);
+            return tx != ty ? tx < ty : generationAt(x) < generationAt(y);
+        };
+        std::priority_queue<uint32_t, std::vector<uint32_t>, decltype(cmp)> queue(cmp);
+        std::vector<char> seen(count, 0);
+        queue.push(start);
+        seen[start] = 1;
+        while (!queue.empty())
+        {
+            uint32_t pos = queue.top();
+            queue.pop();
+            if (!fn(pos))
+                return;
+            forEachParent(pos, [&](uint32_t parent)
+                          {
+                if (!seen[parent])
+                {
+                    seen[parent] = 1;
+                    queue.push(parent);
+                } });
+        }
+    }
+
+    // Copy every commit back out (used when the file is rewritten with new commits)
+    void entries(std::vector<CommitGraphEntry> &out) const
+    {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            CommitGraphEntry e;
+            e.hash = hashAt(i);
+            e.tree = treeAt(i);
+            e.time = timeAt(i);
+            forEachParent(i, [&](uint32_t parent)
+                          { e.parents.push_back(hashAt(parent)); });
+            out.push_back(std::move(e));
+        }
+    }
+
+private:
+    MappedFile map;
+    uint32_t count = 0;
+    uint32_t extraCount = 0;
+    size_t idSize = 20;     // raw id length
+    size_t recordSize = 40; // tree id + parents + generation + time
+
+    size_t idStart() const { return 16 + 256 * 4; }
+    size_t recordStart() const { return idStart() + count * idSize; }
+    const unsigned char *record(uint32_t pos) const { return map.data() + recordStart() + pos * recordSize; }
+
+    // --- Does every parent (and extra edge) name a commit of this graph, or NO_PARENT? ---
+    bool parentsInRange() const
+    {
+        auto valid = [&](uint32_t parent)
+        { return parent == NO_PARENT || parent < count; };
+        for (uint32_t pos = 0; pos < count; pos++)
+        {
+            uint32_t p2 = getBE32(record(pos) + idSize + 4);
+            if (!valid(getBE32(record(pos) + idSize)) ||
+                (p2 & EXTRA_EDGES ? (p2 & ~EXTRA_EDGES) >= extraCount : !valid(p2)))
+                return false;
+        }
+        const unsigned char *edges = map.data() + recordStart() + count * recordSize;
+        for (uint32_t i = 0; i < extraCount; i++)
+            if (!valid(getBE32(edges + i * 4ull) & ~EXTRA_EDGES))
+                return false;
+        return true;
+    }
+};
+
+// --- Fill in generation numbers (iteratively: histories can be very deep) ---
+inline void computeGenerations(std::vector<CommitGraphEntry> &entries)
+{
+    std::unordered_map<ObjectId, size_t> byHash;
+    for (size_t i = 0; i < entries.size(); i++)
+        byHash[entries[i].hash] = i;
+
+    for (size_t start = 0; start < entries.size(); start++)
+    {
+        if (entries[start].generation)
+            continue;
+        std::vector<size_t> stack{start};
+        while (!stack.empty())
+        {
+            CommitGraphEntry &e = entries[stack.back()];
+            uint32_t gen = 1;
+            bool ready = true;
+            for (const auto &parent : e.parents)
+            {
+                auto it = byHash.find(parent);
+                if (it == byHash.end())
+                    continue; // parent not in the graph: treated as a root
+                if (!entries[it->second].generation)
+                {
+                    stack.push_back(it->second);
+                    ready = false;
+                }
+                else
+                    gen = std::max(gen, entries[it->second].generation + 1);
+            }
+            if (ready)
+            {
+                e.generation = gen;
+                stack.pop_back();
+            }
+        }
+    }
+}
+
+// --- Write a commit-graph file for `entries` (any order) through `lock`, held on it ---
+inline bool writeCommitGraph(LockFile &lock, std::vector<CommitGraphEntry> entries)
+{
+    computeGenerations(entries);
+    std::sort(entries.begin(), entries.end(), [](const CommitGraphEntry &a, const CommitGraphEntry &b)
+              { return a.hash < b.hash; });
+    std::unordered_map<ObjectId, uint32_t> position;
+    for (size_t i = 0; i < entries.size(); i++)
+        position[entries[i].hash] = static_cast<uint32_t>(i);
+
+    std::string records, extra;
+    uint32_t extraCount = 0;
+    auto parentPos = [&](const ObjectId &hash)
+    {
+        auto it = position.find(hash);
+        return it == position.end() ? CommitGraph::NO_PARENT : it->second;
+    };
+
+    for (const auto &e : entries)
+    {
+        records += e.tree.raw();
+        uint32_t p1 = e.parents.empty() ? CommitGraph::NO_PARENT : parentPos(e.parents[0]);
+        uint32_t p2 = e.parents.size() < 2 ? CommitGraph::NO_PARENT : parentPos(e.parents[1]);
+        if (e.parents.size() > 2)
+        {
+            p2 = CommitGraph::EXTRA_EDGES | extraCount;
+            for (size_t i = 1; i < e.parents.size(); i++)
+            {
+                uint32_t edge = parentPos(e.parents[i]);
+                if (i + 1 == e.parents.size())
+                    edge |= CommitGraph::EXTRA_EDGES;
+                putBE32(extra, edge);
+                extraCount++;
+            }
+        }
+        putBE32(records, p1);
+        putBE32(records, p2);
+        putBE32(records, e.generation);
+        putBE32(records, static_cast<uint32_t>(e.time >> 32));
+        putBE32(records, static_cast<uint32_t>(e.time));
+    }
+
+    std::string buf = "MCGR";
+    putBE32(buf, 1);
+    putBE32(buf, static_cast<uint32_t>(entries.size()));
+    putBE32(buf, extraCount);
+    uint32_t fanout[256] = {0};
+    for (const auto &e : entries)
+        fanout[e.hash.data()[0]]++;
+    for (int i = 1; i < 256; i++)
+        fanout[i] += fanout[i - 1];
+    for (int i = 0; i < 256; i++)
+        putBE32(buf, fanout[i]);
+    for (const auto &e : entries)
+        buf += e.hash.raw();
+    buf += records;
+    buf += extra;
+    buf += hashBytes(buf).raw();
+
+    // Checked after the data is on disk, so a short write never replaces a good graph
+    return lock.write(buf) && lock.sync() && lock.commit();
+}
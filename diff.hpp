@@ -0,0 +1,466 @@
+#pragma once
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Line diff engine behind `mygit diff`.
+ *
+ *  1. Every line is interned once into an integer id, so the algorithm below
+ *     compares ints, never strings.
+ *  2. Lines that do not occur at all on the other side are changed by
+ *     definition and are dropped before the search (for generated files this
+ *     usually removes most of the input).
+ *  3. The rest goes through Myers' O(ND) algorithm in its linear-space
+ *     divide-and-conquer form ("middle snake"), trimming the common prefix and
+ *     suffix of every sub-problem. When the edit distance of a sub-problem gets
+ *     large the search stops early and splits at the furthest-reaching point,
+ *     the same cost cap git's xdiff uses, so worst cases stay near-linear
+ *     (the diff is then still correct, just not always minimal).
+ *
+ * The result is a per-line "changed" flag for both sides, which
+ * writeUnifiedDiff() turns into unified-diff hunks and mergeLines() into a
+ * three-way merge.
+ */
+
+// --- Lines including their '\n' (the last line may lack one) ---
+inline void splitLines(std::string_view text, std::vector<std::string_view> &lines)
+{
+    lines.clear();
+    size_t pos = 0;
+    while (pos < text.size())
+    {
+        size_t eol = text.find('\n', pos);
+        size_t end = eol == std::string_view::npos ? text.size() : eol + 1;
+        lines.push_back(text.substr(pos, end - pos));
+        pos = end;
+    }
+}
+
+// --- Git's heuristic: a NUL byte in the first 8000 bytes means binary ---
+inline bool isBinaryContent(std::string_view text)
+{
+    return text.substr(0, 8000).find('\0') != std::string_view::npos;
+}
+
+class LineDiff
+{
+public:
+    std::vector<std::string_view> linesA, linesB;
+    std::vector<char> changedA, changedB; // one flag per line
+
+    void run(std::string_view a, std::string_view b)
+    {
+        splitLines(a, linesA);
+        splitLines(b, linesB);
+        changedA.assign(linesA.size(), 0);
+        changedB.assign(linesB.size(), 0);
+
+        // --- Intern lines into ids ---
+        std::unordered_map<std::string_view, uint32_t> ids;
+        ids.reserve(linesA.size() + linesB.size());
+        std::vector<uint32_t> idA(linesA.size()), idB(linesB.size());
+        std::vector<uint32_t> countA, countB;
+        auto intern = [&](std::string_view line)
+        {
+            auto [it, inserted] = ids.emplace(line, static_cast<uint32_t>(ids.size()));
+            if (inserted)
+            {
+                countA.push_back(0);
+                countB.push_back(0);
+            }
+            return it->second;
+        };
+        for (size_t i = 0; i < linesA.size(); i++)
+            countA[idA[i] = intern(linesA[i])]++;
+        for (size_t i = 0; i < linesB.size(); i++)
+            countB[idB[i] = intern(linesB[i])]++;
+
+        // --- Drop lines without a partner on the other side ---
+        ha.clear();
+        hb.clear();
+        mapA.clear();
+        mapB.clear();
+        for (size_t i = 0; i < idA.size(); i++)
+        {
+            if (countB[idA[i]] == 0)
+                changedA[i] = 1;
+            else
+            {
+                ha.push_back(idA[i]);
+                mapA.push_back(i);
+            }
+        }
+        for (size_t i = 0; i < idB.size(); i++)
+        {
+            if (countA[idB[i]] == 0)
+                changedB[i] = 1;
+            else
+            {
+                hb.push_back(idB[i]);
+                mapB.push_back(i);
+            }
+        }
+
+        // --- Myers on what is left ---
+        long n = static_cast<long>(ha.size()), m = static_cast<long>(hb.size());
+        kvdf.assign(n + m + 3, 0);
+        kvdb.assign(n + m + 3, 0);
+        diagOffset = m + 1;
+        maxCost = 1;
+        for (long total = n + m; total > 1; total >>= 2)
+            maxCost <<= 1; // ~sqrt(n + m)
+        maxCost = std::max(maxCost, 256L);
+
+        compare(0, n, 0, m);
+    }
+
+private:
+    std::vector<uint32_t> ha, hb;   // ids of the lines that take part in the search
+    std::vector<size_t> mapA, mapB; // search position -> original line number
+    std::vector<long> kvdf, kvdb;   // furthest x per diagonal, forward / backward
+    long diagOffset = 0;
+    long maxCost = 256;
+
+    long &fwd(long d) { return kvdf[d + diagOffset]; }
+    long &bwd(long d) { return kvdb[d + diagOffset]; }
+
+    void markA(long from, long to)
+    {
+        for (long i = from; i < to; i++)
+            changedA[mapA[i]] = 1;
+    }
+
+    void markB(long from, long to)
+    {
+        for (long i = from; i < to; i++)
+            changedB[mapB[i]] = 1;
+    }
+
+    // --- Divide and conquer over ha[a0, a1) vs hb[b0, b1) ---
+    void compare(long a0, long a1, long b0, long b1)
+    {
+        // the second half is handled by the loop, only the first half recurses
+        while (true)
+        {
+            while (a0 < a1 && b0 < b1 && ha[a0] == hb[b0])
+                a0++, b0++;
+            while (a0 < a1 && b0 < b1 && ha[a1 - 1] == hb[b1 - 1])
+                a1--, b1--;
+
+            if (a0 == a1)
+            {
+                markB(b0, b1);
+                return;
+            }
+            if (b0 == b1)
+            {
+                markA(a0, a1);
+                return;
+            }
+
+            long splitA, splitB;
+            split(a0, a1, b0, b1, splitA, splitB);
+            compare(a0, splitA, b0, splitB);
+            a0 = splitA;
+            b0 = splitB;
+        }
+    }
+
+    // --- Find a point on an optimal (or, past maxCost, a good) edit path ---
+    // Diagonal d = x - y. Forward paths start at (a0, b0), backward at (a1, b1);
+    // the first diagonal where they overlap is the middle snake.
+    void split(long a0, long a1, long b0, long b1, long &splitA, long &splitB)
+    {
+        const long dmin = a0 - b1, dmax = a1 - b0;
+        const long fmid = a0 - b0, bmid = a1 - b1;
+        const bool odd = ((fmid - bmid) & 1) != 0;
+        long fmin = fmid, fmax = fmid, bmin = bmid, bmax = bmid;
+
+        fwd(fmid) = a0;
+        bwd(bmid) = a1;
+
+        for (long cost = 1;; cost++)
+        {
+            // --- Forward step ---
+            if (fmin > dmin)
+                fwd(--fmin - 1) = -1;
+            else
+                ++fmin;
+            if (fmax < dmax)
+                fwd(++fmax + 1) = -1;
+            else
+                --fmax;
+            for (long d = fmax; d >= fmin; d -= 2)
+            {
+                long x = fwd(d - 1) >= fwd(d + 1) ? fwd(d - 1) + 1 : fwd(d + 1);
+                long y = x - d;
+                while (x < a1 && y < b1 && ha[x] == hb[y])
+                    x++, y++;
+                fwd(d) = x;
+                if (odd && bmin <= d && d <= bmax && bwd(d) <= x)
+                {
+                    splitA = x;
+                    splitB = y;
+                    return;
+                }
+            }
+
+            // --- Backward step ---
+            if (bmin > dmin)
+                bwd(--bmin - 1) = LONG_MAX;
+            else
+                ++bmin;
+            if (bmax < dmax)
+                bwd(++bmax + 1) = LONG_MAX;
+            else
+                --bmax;
+            for (long d = bmax; d >= bmin; d -= 2)
+            {
+                long x = bwd(d - 1) < bwd(d + 1) ? bwd(d - 1) : bwd(d + 1) - 1;
+                long y = x - d;
+                while (x > a0 && y > b0 && ha[x - 1] == hb[y - 1])
+                    x--, y--;
+                bwd(d) = x;
+                if (!odd && fmin <= d && d <= fmax && x <= fwd(d))
+                {
+                    splitA = x;
+                    splitB = y;
+                    return;
+                }
+            }
+
+            if (cost < maxCost)
+                continue;
+
+            // --- Too expensive: split where one side got furthest ---
+            long fbest = -1, fbestA = 0;
+            for (long d = fmax; d >= fmin; d -= 2)
+            {
+                long x = std::min(fwd(d), a1);
+                long y = x - d;
+                if (b1 < y)
+                    x = b1 + d, y = b1;
+                if (fbest < x + y)
+                {
+                    fbest = x + y;
+                    fbestA = x;
+                }
+            }
+            long bbest = LONG_MAX, bbestA = 0;
+            for (long d = bmax; d >= bmin; d -= 2)
+            {
+                long x = std::max(a0, bwd(d));
+                long y = x - d;
+                if (y < b0)
+                    x = b0 + d, y = b0;
+                if (x + y < bbest)
+                {
+                    bbest = x + y;
+                    bbestA = x;
+                }
+            }
+            if ((a1 + b1) - bbest < fbest - (a0 + b0))
+            {
+                splitA = fbestA;
+                splitB = fbest - fbestA;
+            }
+            else
+            {
+                splitA = bbestA;
+                splitB = bbest - bbestA;
+            }
+            return;
+        }
+    }
+};
+
+// --- A run of changed lines: a[a, a + aLen) was replaced by b[b, b + bLen) ---
+struct DiffChange
+{
+    size_t a, aLen, b, bLen;
+};
+
+// --- Walk both sides in step; a change is a run of changed lines on either side ---
+inline std::vector<DiffChange> collectChanges(const LineDiff &diff)
+{
+    const auto &la = diff.linesA, &lb = diff.linesB;
+    const auto &ca = diff.changedA, &cb = diff.changedB;
+    std::vector<DiffChange> changes;
+    size_t i = 0, j = 0;
+    while (i < la.size() || j < lb.size())
+    {
+        if (i < la.size() && j < lb.size() && !ca[i] && !cb[j])
+        {
+            i++, j++;
+            continue;
+        }
+        DiffChange c{i, 0, j, 0};
+        while (i < la.size() && ca[i])
+            i++, c.aLen++;
+        while (j < lb.size() && cb[j])
+            j++, c.bLen++;
+        changes.push_back(c);
+    }
+    return changes;
+}
+
+// --- Print one line of a hunk, flagging a missing final newline like git ---
+inline void writeDiffLine(std::ostream &out, char marker, std::string_view line)
+{
+    out << marker << line;
+    if (line.empty() || line.back() != '\n')
+        out << "\n\\ No newline at end of file\n";
+}
+
+// --- Unified diff hunks ("@@ -a,b +c,d @@") for two texts ---
+inline void writeUnifiedDiff(std::ostream &out, std::string_view a, std::string_view b, size_t context = 3)
+{
+    LineDiff diff;
+    diff.run(a, b);
+    const auto &la = diff.linesA, &lb = diff.linesB;
+    std::vector<DiffChange> changes = collectChanges(diff);
+
+    auto range = [](size_t start, size_t len)
+    {
+        // git prints the line before an empty range, and omits a length of 1
+        std::string s = std::to_string(len == 0 ? start : start + 1);
+        if (len != 1)
+            s += "," + std::to_string(len);
+        return s;
+    };
+
+    // Hunk headers name the nearest preceding line that starts with a letter, '_'
+    // or '$' (git's default "function" heuristic); hunks only move forward, so the
+    // scan for it is linear overall.
+    size_t scanned = 0;
+    std::string_view function;
+
+    for (size_t first = 0; first < changes.size();)
+    {
+        // Merge changes whose context would touch or overlap
+        size_t last = first;
+        while (last + 1 < changes.size() &&
+               changes[last + 1].a - (changes[last].a + changes[last].aLen) <= 2 * context)
+            last++;
+
+        size_t lead = std::min(context, changes[first].a);
+        size_t aStart = changes[first].a - lead, bStart = changes[first].b - lead;
+        size_t aEnd = std::min(la.size(), changes[last].a + changes[last].aLen + context);
+        size_t trail = aEnd - (changes[last].a + changes[last].aLen); // unchanged on both sides
+        size_t bEnd = changes[last].b + changes[last].bLen + trail;
+
+        for (; scanned < aStart; scanned++)
+        {
+            char c = la[scanned].empty() ? '\0' : la[scanned][0];
+            if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == '$')
+                function = la[scanned];
+        }
+        std::string_view label = function.substr(0, std::min<size_t>(function.find_last_not_of("\r\n \t") + 1, 80));
+
+        out << "@@ -" << range(aStart, aEnd - aStart) << " +" << range(bStart, bEnd - bStart) << " @@";
+        if (!label.empty())
+            out << " " << label;
+        out << "\n";
+        size_t x = aStart, y = bStart;
+        for (size_t k = first; k <= last; k++)
+        {
+            const DiffChange &c = changes[k];
+            for (; x < c.a; x++, y++)
+                writeDiffLine(out, ' ', la[x]);
+            for (size_t n = 0; n < c.aLen; n++)
+                writeDiffLine(out, '-', la[x++]);
+            for (size_t n = 0; n < c.bLen; n++)
+                writeDiffLine(out, '+', lb[y++]);
+        }
+        for (; x < aEnd; x++)
+            writeDiffLine(out, ' ', la[x]);
+        first = last + 1;
+    }
+}
+
+// --- Three-way line merge of ours and theirs against their common base ---
+// Each side's changes against the base are lined up; changes from the two sides
+// that overlap or touch form one region. A region changed on one side only, or
+// changed identically on both, merges cleanly; anything else is written as a
+// conflict block with git's markers. Returns false if there was a conflict.
+inline bool mergeLines(std::string_view base, std::string_view ours, std::string_view theirs,
+                       const std::string &oursLabel, const std::string &theirsLabel, std::string &out)
+{
+    LineDiff diffOurs, diffTheirs;
+    diffOurs.run(base, ours);
+    diffTheirs.run(base, theirs);
+    std::vector<DiffChange> co = collectChanges(diffOurs), ct = collectChanges(diffTheirs);
+    const auto &lb = diffOurs.linesA, &lo = diffOurs.linesB, &lt = diffTheirs.linesB;
+
+    auto append = [&](const std::vector<std::string_view> &lines, size_t from, size_t to)
+    {
+        for (size_t i = from; i < to; i++)
+            out += lines[i];
+    };
+    // A conflict block must start on a fresh line even if a side lacks its final newline
+    auto appendBlock = [&](const std::vector<std::string_view> &lines, size_t from, size_t to)
+    {
+        append(lines, from, to);
+        if (from < to && lines[to - 1].back() != '\n')
+            out += '\n';
+    };
+
+    out.clear();
+    bool clean = true;
+    size_t io = 0, it = 0, pos = 0; // next change on each side, first base line not yet written
+    long deltaO = 0, deltaT = 0;    // side line number minus base line number, before the region
+    while (io < co.size() || it < ct.size())
+    {
+        size_t start = it == ct.size() || (io < co.size() && co[io].a <= ct[it].a) ? co[io].a : ct[it].a;
+        size_t end = start;
+        size_t o0 = io, t0 = it;
+        long endO = deltaO, endT = deltaT;
+        while (true)
+        {
+            if (io < co.size() && co[io].a <= end)
+            {
+                end = std::max(end, co[io].a + co[io].aLen);
+                endO += static_cast<long>(co[io].bLen) - static_cast<long>(co[io].aLen);
+                io++;
+            }
+            else if (it < ct.size() && ct[it].a <= end)
+            {
+                end = std::max(end, ct[it].a + ct[it].aLen);
+                endT += static_cast<long>(ct[it].bLen) - static_cast<long>(ct[it].aLen);
+                it++;
+            }
+            else
+                break;
+        }
+
+        append(lb, pos, start);
+        size_t oFrom = start + deltaO, oTo = end + endO;
+        size_t tFrom = start + deltaT, tTo = end + endT;
+        if (it == t0)
+            append(lo, oFrom, oTo);
+        else if (io == o0 ||
+                 std::equal(lo.begin() + oFrom, lo.begin() + oTo, lt.begin() + tFrom, lt.begin() + tTo))
+            append(lt, tFrom, tTo);
+        else
+        {
+            clean = false;
+            out += "<<<<<<< " + oursLabel + "\n";
+            appendBlock(lo, oFrom, oTo);
+            out += "=======\n";
+            appendBlock(lt, tFrom, tTo);
+            out += ">>>>>>> " + theirsLabel + "\n";
+        }
+        pos = end;
+        deltaO = endO;
+        deltaT = endT;
+    }
+    append(lb, pos, lb.size());
+    return clean;
+}
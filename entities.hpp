@@ -1,11 +1,13 @@
 #pragma once
 
+#include <algorithm>
 #include <string>
 #include <vector>
+#include "hash.hpp"
 
-// Blob is the raw file data, prefixed with a small header, then hashed
+// Blob is the raw file data, prefixed with a small "blob <size>\0" header, then hashed
 struct Blob{
-    std::string hash; // SHA-1 hashed
+    ObjectId hash;
     std::string content;
 };
 
@@ -13,44 +15,45 @@ struct Blob{
 struct TreeEntry {
     std::string mode; // file permissions
     std::string name; 
-    std::string hash; // hash of the object (blob or tree)
+    ObjectId hash; // id of the object (blob or tree)
 };
 
 struct Tree{
     std::vector<TreeEntry> entries;
 };
 
+// git orders entries by name, comparing a directory as if it ended in '/'
+inline void sortTreeEntries(Tree &tree)
+{
+    std::sort(tree.entries.begin(), tree.entries.end(), [](const TreeEntry &a, const TreeEntry &b)
+              { return (a.mode == "40000" ? a.name + "/" : a.name) < (b.mode == "40000" ? b.name + "/" : b.name); });
+}
+
 /**
  * Commits are project snapshots with history
  * 
  * A commit ties everything together:
  * - Points to a tree (the state of the project)
- * - Optionally to one or more parent commits
+ * - Optionally to one or more parent commits (a merge has two or more)
  * - includes metadata 
  *      - author
  *      - commit message
  */
 struct Commit{
-    std::string treeHash;
-    std::string parentHash;
+    ObjectId treeHash;
+    std::vector<ObjectId> parentHashes; // first parent first
     std::string author;
     std::string message;
-    std::string hash;
+    ObjectId hash;
 };
 
 // Movable pointer to a commit
 struct Branch{
     std::string name;
-    std::string commitHash;
+    ObjectId commitHash;
 };
 
 struct HEAD{
     bool isDetached;
     std::string refName; // branch name OR commit hash
 };
-
-struct Repository{
-    std::string path = ".mygit";
-    std::vector<Commit> commits;
-    std::vector<Branch> branches;
-};
@@ -0,0 +1,453 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "trace.hpp"
+
+/**
+ * Filesystem monitor: a per-repository daemon that watches the working tree
+ * with inotify and answers "what changed since <token>?" over a Unix socket at
+ * ".mygit/fsmonitor.sock", so status and add only look at changed paths.
+ *
+ * Protocol (one request per connection, fields NUL-terminated):
+ *   client: "query <token>\n"    server: "<new token>\0" then either "*\0"
+ *                                 (cannot answer: scan everything) or one
+ *                                 "<path>\0" per changed path
+ *   client: "ping\n"             server: "ok\0"
+ *   client: "stop\n"             server: "ok\0", then the daemon exits
+ *
+ * A token is "<daemon instance>:<event sequence>". Tokens from another daemon
+ * instance, or from before an inotify queue overflow, get the "*" answer.
+ * Paths are relative to the repository root; a directory path means anything
+ * below it may have changed as well.
+ *
+ * Before answering, the daemon creates a cookie file in .mygit and waits for
+ * its own event: inotify delivers events in order, so every change made before
+ * the query is then known (the same trick git's fsmonitor uses). If the cookie
+ * cannot be created or its event does not arrive in time, the answer is "*".
+ */
+
+struct FsMonitorAnswer
+{
+    std::string token;
+    bool full = true; // true: the daemon cannot say, scan everything
+    std::vector<std::string> paths;
+};
+
+// --- One request/response round trip; false if no daemon is listening ---
+inline bool fsmonitorRequest(const std::string &socketPath, const std::string &request, std::string &response)
+{
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return false;
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(addr.sun_path))
+    {
+        ::close(fd);
+        return false;
+    }
+    std::strcpy(addr.sun_path, socketPath.c_str());
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    timeval timeout{10, 0};
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    bool ok = ::send(fd, request.data(), request.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(request.size());
+    ::shutdown(fd, SHUT_WR);
+
+    response.clear();
+    char buf[64 * 1024];
+    ssize_t n;
+    while (ok && (n = ::read(fd, buf, sizeof(buf))) != 0)
+    {
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            ok = false;
+            break;
+        }
+        response.append(buf, static_cast<size_t>(n));
+    }
+    ::close(fd);
+    return ok;
+}
+
+inline bool fsmonitorQuery(const std::string &socketPath, const std::string &token, FsMonitorAnswer &answer)
+{
+    TraceSpan span("fsmonitor.query");
+    answer = FsMonitorAnswer();
+    std::string response;
+    if (!fsmonitorRequest(socketPath, "query " + token + "\n", response))
+        return false;
+
+    size_t pos = response.find('\0');
+    if (pos == std::string::npos)
+        return false;
+    answer.token = response.substr(0, pos);
+    answer.full = false;
+    for (size_t start = pos + 1; start < response.size(); start = pos + 1)
+    {
+        pos = response.find('\0', start);
+        if (pos == std::string::npos)
+            return false;
+        std::string path = response.substr(start, pos - start);
+        if (path == "*")
+            answer.full = true;
+        else
+            answer.paths.push_back(std::move(path));
+    }
+    return !answer.token.empty();
+}
+
+class FsMonitorDaemon
+{
+public:
+    // `gitDir` is the repository directory name inside the working tree root (".mygit")
+    explicit FsMonitorDaemon(std::string gitDir = ".mygit")
+        : gitDir(std::move(gitDir)), socketPath(this->gitDir + "/fsmonitor.sock") {}
+
+    ~FsMonitorDaemon()
+    {
+        if (listenFd >= 0)
+        {
+            ::close(listenFd);
+            ::unlink(socketPath.c_str());
+        }
+        if (inotifyFd >= 0)
+            ::close(inotifyFd);
+    }
+
+    FsMonitorDaemon(const FsMonitorDaemon &) = delete;
+    FsMonitorDaemon &operator=(const FsMonitorDaemon &) = delete;
+
+    // --- Set up watches and the socket (call before daemonizing to report errors) ---
+    bool start()
+    {
+        instance = std::to_string(::getpid()) + "-" + std::to_string(std::time(nullptr));
+
+        inotifyFd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotifyFd < 0)
+        {
+            std::cerr << "Error: inotify_init1: " << std::strerror(errno) << "\n";
+            return false;
+        }
+        if (!watchTree(""))
+            return false;
+        gitDirWatch = ::inotify_add_watch(inotifyFd, gitDir.c_str(), IN_CREATE | IN_ONLYDIR);
+
+        listenFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        std::strcpy(addr.sun_path, socketPath.c_str());
+        ::unlink(socketPath.c_str()); // stale socket of a daemon that died
+        if (listenFd < 0 || ::bind(listenFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+            ::listen(listenFd, 16) != 0)
+        {
+            std::cerr << "Error: cannot listen on " << socketPath << ": " << std::strerror(errno) << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    size_t watchCount() const { return watchByPath.size(); }
+
+    // Forget the descriptors without closing the socket down (the forking parent
+    // calls this so that only the child keeps serving)
+    void detach()
+    {
+        if (listenFd >= 0)
+            ::close(listenFd);
+        if (inotifyFd >= 0)
+            ::close(inotifyFd);
+        listenFd = inotifyFd = -1;
+    }
+
+    // --- Event loop; returns when a "stop" request arrives ---
+    void run()
+    {
+        while (!stopping)
+        {
+            pollfd fds[2] = {{inotifyFd, POLLIN, 0}, {listenFd, POLLIN, 0}};
+            if (::poll(fds, 2, -1) < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return;
+            }
+            if (fds[0].revents & POLLIN)
+                readEvents();
+            if (fds[1].revents & POLLIN)
+                serveClient();
+        }
+    }
+
+private:
+    std::string gitDir;
+    std::string socketPath;
+    std::string instance;
+    int inotifyFd = -1;
+    int listenFd = -1;
+    int gitDirWatch = -1;
+    bool stopping = false;
+
+    // Every change gets the next sequence number; a path is kept only with its latest one
+    uint64_t sequence = 0;
+    uint64_t resetAt = 0; // tokens older than this cannot be answered (overflow)
+    std::map<uint64_t, std::string> changeLog;
+    std::unordered_map<std::string, uint64_t> lastChange;
+
+    std::unordered_map<int, std::string> watchPath; // watch descriptor -> directory ("" = root)
+    std::map<std::string, int> watchByPath;
+
+    uint64_t cookieCounter = 0;
+    std::set<std::string> cookiesSeen;
+
+    static constexpr uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | IN_MOVED_FROM |
+                                           IN_MOVED_TO | IN_DONT_FOLLOW | IN_ONLYDIR | IN_EXCL_UNLINK;
+
+    static std::string join(const std::string &dir, const std::string &name)
+    {
+        return dir.empty() ? name : dir + "/" + name;
+    }
+
+    void markChanged(const std::string &path)
+    {
+        auto it = lastChange.find(path);
+        if (it != lastChange.end())
+            changeLog.erase(it->second);
+        lastChange[path] = ++sequence;
+        changeLog[sequence] = path;
+    }
+
+    // --- Watch `dir` and every directory below it (except .mygit) ---
+    bool watchTree(const std::string &dir)
+    {
+        std::vector<std::string> pending{dir};
+        while (!pending.empty())
+        {
+            std::string current = pending.back();
+            pending.pop_back();
+            int wd = ::inotify_add_watch(inotifyFd, current.empty() ? "." : current.c_str(), WATCH_MASK);
+            if (wd < 0)
+            {
+                if (errno == ENOSPC)
+                {
+                    std::cerr << "Error: out of inotify watches (see /proc/sys/fs/inotify/max_user_watches)\n";
+                    return false;
+                }
+                continue; // vanished or not a directory any more
+            }
+            watchPath[wd] = current;
+            watchByPath[current] = wd;
+
+            DIR *d = ::opendir(current.empty() ? "." : current.c_str());
+            if (!d)
+                continue;
+            while (dirent *e = ::readdir(d))
+            {
+                std::string name = e->d_name;
+                if (name == "." || name == ".." || (current.empty() && name == gitDir))
+                    continue;
+                std::string child = join(current, name);
+                bool isDir = e->d_type == DT_DIR;
+                if (e->d_type == DT_UNKNOWN)
+                {
+                    struct stat st;
+                    isDir = ::lstat(child.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+                }
+                if (isDir)
+                    pending.push_back(child);
+            }
+            ::closedir(d);
+        }
+        return true;
+    }
+
+    void unwatchTree(const std::string &dir)
+    {
+        auto unwatch = [&](std::map<std::string, int>::iterator it)
+        {
+            ::inotify_rm_watch(inotifyFd, it->second);
+            watchPath.erase(it->second);
+            return watchByPath.erase(it);
+        };
+        auto self = watchByPath.find(dir);
+        if (self != watchByPath.end())
+            unwatch(self);
+        std::string prefix = dir + "/";
+        for (auto it = watchByPath.lower_bound(prefix);
+             it != watchByPath.end() && it->first.compare(0, prefix.size(), prefix) == 0;)
+            it = unwatch(it);
+    }
+
+    // --- Drain the inotify queue ---
+    void readEvents()
+    {
+        alignas(inotify_event) char buf[64 * 1024];
+        while (true)
+        {
+            ssize_t len = ::read(inotifyFd, buf, sizeof(buf));
+            if (len <= 0)
+                return; // EAGAIN: queue empty
+
+            for (char *p = buf; p < buf + len;)
+            {
+                const inotify_event *event = reinterpret_cast<const inotify_event *>(p);
+                p += sizeof(inotify_event) + event->len;
+
+                if (event->mask & IN_Q_OVERFLOW)
+                {
+                    resetAt = ++sequence; // events were lost: everyone has to rescan
+                    changeLog.clear();
+                    lastChange.clear();
+                    continue;
+                }
+                std::string name = event->len ? std::string(event->name) : "";
+                if (event->wd == gitDirWatch)
+                {
+                    if (name.compare(0, 17, "fsmonitor-cookie-") == 0)
+                        cookiesSeen.insert(name);
+                    continue;
+                }
+
+                auto it = watchPath.find(event->wd);
+                if (it == watchPath.end())
+                    continue;
+                if (event->mask & IN_IGNORED)
+                {
+                    watchByPath.erase(it->second);
+                    watchPath.erase(it);
+                    continue;
+                }
+                if (name.empty())
+                    continue; // event on the watched directory itself; its parent reports it
+
+                std::string path = join(it->second, name);
+                if (path == gitDir)
+                    continue;
+                if (event->mask & IN_ISDIR)
+                {
+                    if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+                        unwatchTree(path);
+                    if (event->mask & (IN_CREATE | IN_MOVED_TO))
+                        watchTree(path); // contents created before the watch are covered by the dir path
+                }
+                markChanged(path);
+            }
+        }
+    }
+
+    // --- Make sure every change made before now has been read ---
+    // False if that cannot be confirmed (no cookie file, or its event never
+    // came): the change log may then be missing something.
+    bool syncWithCookie()
+    {
+        std::string name = "fsmonitor-cookie-" + std::to_string(::getpid()) + "-" + std::to_string(++cookieCounter);
+        std::string file = gitDir + "/" + name;
+        int fd = ::open(file.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        if (fd < 0)
+        {
+            readEvents();
+            return false;
+        }
+        ::close(fd);
+        for (int waited = 0; !cookiesSeen.count(name) && waited < 50; waited++)
+        {
+            pollfd pfd{inotifyFd, POLLIN, 0};
+            if (::poll(&pfd, 1, 20) > 0)
+                readEvents();
+        }
+        bool seen = cookiesSeen.erase(name) > 0;
+        ::unlink(file.c_str());
+        return seen;
+    }
+
+    void serveClient()
+    {
+        int fd = ::accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0)
+            return;
+        timeval timeout{2, 0};
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        std::string request;
+        char buf[512];
+        ssize_t n;
+        while (request.find('\n') == std::string::npos && (n = ::read(fd, buf, sizeof(buf))) > 0)
+            request.append(buf, static_cast<size_t>(n));
+        request = request.substr(0, request.find('\n'));
+
+        std::string response;
+        if (request == "ping")
+            response = std::string("ok") + '\0';
+        else if (request == "stop")
+        {
+            response = std::string("ok") + '\0';
+            stopping = true;
+        }
+        else if (request.compare(0, 6, "query ") == 0)
+            response = answerQuery(request.substr(6));
+
+        const char *p = response.data();
+        size_t left = response.size();
+        while (left > 0)
+        {
+            ssize_t sent = ::send(fd, p, left, MSG_NOSIGNAL);
+            if (sent <= 0)
+                break;
+            p += sent;
+            left -= static_cast<size_t>(sent);
+        }
+        ::close(fd);
+    }
+
+    std::string answerQuery(const std::string &token)
+    {
+        bool synced = syncWithCookie();
+        std::string response = instance + ":" + std::to_string(sequence);
+        response.push_back('\0');
+
+        // Not synced: the log may be incomplete, so the client must rescan everything
+        size_t colon = token.rfind(':');
+        uint64_t since = 0;
+        bool known = synced && colon != std::string::npos && token.substr(0, colon) == instance;
+        if (known)
+        {
+            since = std::strtoull(token.c_str() + colon + 1, nullptr, 10);
+            known = since >= resetAt && since <= sequence;
+        }
+        if (!known)
+        {
+            response += "*";
+            response.push_back('\0');
+            return response;
+        }
+        for (auto it = changeLog.upper_bound(since); it != changeLog.end(); ++it)
+        {
+            response += it->second;
+            response.push_back('\0');
+        }
+        return response;
+    }
+};
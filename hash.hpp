@@ -0,0 +1,283 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <openssl/evp.h>
+#include <openssl/opensslv.h>
+#include "trace.hpp"
+
+/**
+ * Object ids and the hash function behind them.
+ *
+ * A repository uses one object format for every id: SHA-1 (the default, the
+ * same ids git computes) or SHA-256 ("mygit init --object-format=sha256",
+ * recorded in the config). The format is process-wide and set when the
+ * repository is opened, like git's the_hash_algo; the checksums of the index,
+ * packs and commit-graph use it as well.
+ *
+ * Digests go through OpenSSL's EVP interface, which picks the fastest code for
+ * the CPU at run time (SHA-NI on x86-64, the crypto extensions on ARMv8). The
+ * digest is fetched once and one-shot hashing reuses a per-thread context, so
+ * hashing a small tree or commit allocates nothing.
+ */
+
+// ---------- Hash algorithms ----------
+struct HashAlgo
+{
+    const char *name;        // as written in the config
+    const char *opensslName; // EVP digest name
+    size_t rawSize;
+    size_t hexSize;
+};
+
+inline const HashAlgo SHA1_ALGO{"sha1", "SHA1", 20, 40};
+inline const HashAlgo SHA256_ALGO{"sha256", "SHA256", 32, 64};
+
+inline const HashAlgo *&currentHashAlgo()
+{
+    static const HashAlgo *algo = &SHA1_ALGO;
+    return algo;
+}
+
+// --- Object format of the repository in use ---
+inline const HashAlgo &hashAlgo()
+{
+    return *currentHashAlgo();
+}
+
+inline void setHashAlgo(const HashAlgo &algo)
+{
+    currentHashAlgo() = &algo;
+}
+
+inline const HashAlgo *hashAlgoByName(std::string_view name)
+{
+    if (name == SHA1_ALGO.name)
+        return &SHA1_ALGO;
+    if (name == SHA256_ALGO.name)
+        return &SHA256_ALGO;
+    return nullptr;
+}
+
+inline const EVP_MD *evpDigest(const HashAlgo &algo)
+{
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    // Explicit fetch: the implicit one behind EVP_sha1() repeats the provider lookup on every init
+    static EVP_MD *sha1 = EVP_MD_fetch(nullptr, SHA1_ALGO.opensslName, nullptr);
+    static EVP_MD *sha256 = EVP_MD_fetch(nullptr, SHA256_ALGO.opensslName, nullptr);
+    return &algo == &SHA256_ALGO ? sha256 : sha1;
+#else
+    return &algo == &SHA256_ALGO ? EVP_sha256() : EVP_sha1();
+#endif
+}
+
+// ---------- Hex ----------
+inline const char HEX_DIGITS[] = "0123456789abcdef";
+
+// Value of a hex digit, -1 for anything else
+inline int hexValue(char c)
+{
+    static const struct Table
+    {
+        signed char value[256];
+        Table()
+        {
+            std::memset(value, -1, sizeof(value));
+            for (int i = 0; i < 10; i++)
+                value['0' + i] = static_cast<signed char>(i);
+            for (int i = 0; i < 6; i++)
+                value['a' + i] = value['A' + i] = static_cast<signed char>(10 + i);
+        }
+    } table;
+    return table.value[static_cast<unsigned char>(c)];
+}
+
+inline bool isHexString(std::string_view text)
+{
+    for (char c : text)
+        if (hexValue(c) < 0)
+            return false;
+    return true;
+}
+
+// --- Helpers: hex <-> raw bytes ---
+inline std::string hexToRaw(std::string_view hex)
+{
+    std::string raw(hex.size() / 2, '\0');
+    for (size_t i = 0; i < raw.size(); i++)
+        raw[i] = static_cast<char>((hexValue(hex[i * 2]) << 4) | hexValue(hex[i * 2 + 1]));
+    return raw;
+}
+
+inline std::string rawToHex(std::string_view raw)
+{
+    std::string hex(raw.size() * 2, '0');
+    for (size_t i = 0; i < raw.size(); i++)
+    {
+        unsigned char c = static_cast<unsigned char>(raw[i]);
+        hex[i * 2] = HEX_DIGITS[c >> 4];
+        hex[i * 2 + 1] = HEX_DIGITS[c & 0xf];
+    }
+    return hex;
+}
+
+// ---------- Object id ----------
+// Raw digest bytes held by value: no allocation, compared with memcmp. An empty
+// id (size 0) stands for "no object".
+struct ObjectId
+{
+    static const size_t MAX_RAW_SIZE = 32;
+
+    unsigned char bytes[MAX_RAW_SIZE] = {};
+    uint8_t length = 0;
+
+    static ObjectId fromRaw(const void *raw, size_t size)
+    {
+        ObjectId id;
+        if (size <= MAX_RAW_SIZE)
+        {
+            std::memcpy(id.bytes, raw, size);
+            id.length = static_cast<uint8_t>(size);
+        }
+        return id;
+    }
+
+    static ObjectId fromRaw(std::string_view raw)
+    {
+        return fromRaw(raw.data(), raw.size());
+    }
+
+    // --- Parse a full-length hex id of the current object format (empty id if invalid) ---
+    static ObjectId fromHex(std::string_view hex)
+    {
+        ObjectId id;
+        if (hex.size() != hashAlgo().hexSize)
+            return id;
+        for (size_t i = 0; i < hex.size() / 2; i++)
+        {
+            int hi = hexValue(hex[i * 2]), lo = hexValue(hex[i * 2 + 1]);
+            if (hi < 0 || lo < 0)
+                return ObjectId();
+            id.bytes[i] = static_cast<unsigned char>((hi << 4) | lo);
+        }
+        id.length = static_cast<uint8_t>(hex.size() / 2);
+        return id;
+    }
+
+    bool empty() const { return length == 0; }
+    size_t size() const { return length; }
+    const unsigned char *data() const { return bytes; }
+    std::string_view raw() const { return std::string_view(reinterpret_cast<const char *>(bytes), length); }
+
+    std::string hex() const
+    {
+        std::string out(length * 2, '0');
+        for (size_t i = 0; i < length; i++)
+        {
+            out[i * 2] = HEX_DIGITS[bytes[i] >> 4];
+            out[i * 2 + 1] = HEX_DIGITS[bytes[i] & 0xf];
+        }
+        return out;
+    }
+
+    bool operator==(const ObjectId &other) const
+    {
+        return length == other.length && std::memcmp(bytes, other.bytes, length) == 0;
+    }
+    bool operator!=(const ObjectId &other) const { return !(*this == other); }
+
+    // Same order as the hex strings (ids of one format all have the same length)
+    bool operator<(const ObjectId &other) const
+    {
+        int cmp = std::memcmp(bytes, other.bytes, length < other.length ? length : other.length);
+        return cmp != 0 ? cmp < 0 : length < other.length;
+    }
+};
+
+inline std::ostream &operator<<(std::ostream &out, const ObjectId &id)
+{
+    return out << id.hex();
+}
+
+// Digests are uniformly distributed: the first bytes are a good hash already
+namespace std
+{
+    template <>
+    struct hash<ObjectId>
+    {
+        size_t operator()(const ObjectId &id) const
+        {
+            size_t h;
+            std::memcpy(&h, id.bytes, sizeof(h));
+            return h;
+        }
+    };
+}
+
+// ---------- Hashing ----------
+// --- Digest of one buffer with the repository's hash ---
+inline ObjectId hashBytes(const void *data, size_t size)
+{
+    traceCount("hash.bytes", size);
+    thread_local struct Context
+    {
+        EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+        ~Context() { EVP_MD_CTX_free(ctx); }
+    } local;
+
+    unsigned char md[EVP_MAX_MD_SIZE];
+    unsigned int len = 0;
+    EVP_DigestInit_ex(local.ctx, evpDigest(hashAlgo()), nullptr);
+    EVP_DigestUpdate(local.ctx, data, size);
+    EVP_DigestFinal_ex(local.ctx, md, &len);
+    return ObjectId::fromRaw(md, len);
+}
+
+inline ObjectId hashBytes(std::string_view data)
+{
+    return hashBytes(data.data(), data.size());
+}
+
+// --- Incremental hashing: feed data in pieces, memory use stays constant ---
+class HashStream
+{
+public:
+    HashStream() : ctx(EVP_MD_CTX_new())
+    {
+        EVP_DigestInit_ex(ctx, evpDigest(hashAlgo()), nullptr);
+    }
+
+    ~HashStream()
+    {
+        EVP_MD_CTX_free(ctx);
+    }
+
+    HashStream(const HashStream &) = delete;
+    HashStream &operator=(const HashStream &) = delete;
+
+    void update(const void *data, size_t size)
+    {
+        traceCount("hash.bytes", size);
+        EVP_DigestUpdate(ctx, data, size);
+    }
+
+    void update(std::string_view data)
+    {
+        update(data.data(), data.size());
+    }
+
+    ObjectId finish()
+    {
+        unsigned char md[EVP_MAX_MD_SIZE];
+        unsigned int len = 0;
+        EVP_DigestFinal_ex(ctx, md, &len);
+        return ObjectId::fromRaw(md, len);
+    }
+
+private:
+    EVP_MD_CTX *ctx;
+};
@@ -0,0 +1,289 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * .mygitignore support, with git's pattern rules: one pattern per line, '#'
+ * starts a comment, '!' re-includes, a trailing '/' matches directories only,
+ * a '/' anywhere else anchors the pattern to the directory of the file, and
+ * '*', '?', '[...]' and '**' are wildcards. A .mygitignore applies to its own
+ * directory and everything below it; deeper files take precedence, and within
+ * a file the last matching pattern wins.
+ *
+ * Each file is compiled once into buckets, so most paths are decided without
+ * running the glob matcher at all:
+ *   literal   "build", "/Makefile.in"   hash lookup on the name (or the path)
+ *   suffix    "*.o", "*~"               compare the end of the name
+ *   prefix    "tmp*"                    compare the start of the name
+ *   glob      everything else           wildMatch()
+ */
+
+// --- Glob match: '*' and '?' stop at '/', "**" crosses directories ---
+inline bool wildMatch(std::string_view pattern, std::string_view text)
+{
+    size_t pi = 0, ti = 0;
+    while (pi < pattern.size())
+    {
+        char c = pattern[pi];
+        if (c == '*')
+        {
+            if (pi + 1 < pattern.size() && pattern[pi + 1] == '*')
+            {
+                pi += 2;
+                // "**/" also matches no directory at all
+                if (pi < pattern.size() && pattern[pi] == '/' && wildMatch(pattern.substr(pi + 1), text.substr(ti)))
+                    return true;
+                for (size_t k = ti; k <= text.size(); k++)
+                    if (wildMatch(pattern.substr(pi), text.substr(k)))
+                        return true;
+                return false;
+            }
+            pi++;
+            for (size_t k = ti; k <= text.size(); k++)
+            {
+                if (wildMatch(pattern.substr(pi), text.substr(k)))
+                    return true;
+                if (k < text.size() && text[k] == '/')
+                    break;
+            }
+            return false;
+        }
+        if (ti >= text.size())
+            return false;
+        if (c == '?')
+        {
+            if (text[ti] == '/')
+                return false;
+            pi++, ti++;
+            continue;
+        }
+        if (c == '[')
+        {
+            size_t close = pattern.find(']', pi + 2);
+            if (close != std::string_view::npos)
+            {
+                std::string_view set = pattern.substr(pi + 1, close - pi - 1);
+                bool negate = set[0] == '!' || set[0] == '^';
+                if (negate)
+                    set.remove_prefix(1);
+                bool found = false;
+                for (size_t k = 0; k < set.size(); k++)
+                {
+                    if (k + 2 < set.size() && set[k + 1] == '-')
+                    {
+                        found = found || (text[ti] >= set[k] && text[ti] <= set[k + 2]);
+                        k += 2;
+                    }
+                    else
+                        found = found || text[ti] == set[k];
+                }
+                if (found == negate || text[ti] == '/')
+                    return false;
+                pi = close + 1;
+                ti++;
+                continue;
+            }
+            // no closing ']': a literal '['
+        }
+        if (c == '\\' && pi + 1 < pattern.size())
+            c = pattern[++pi];
+        if (c != text[ti])
+            return false;
+        pi++, ti++;
+    }
+    return ti == text.size();
+}
+
+// ---------- One .mygitignore ----------
+class IgnoreList
+{
+public:
+    // --- Compile the patterns of one file ---
+    void parse(std::string_view content)
+    {
+        size_t pos = 0;
+        while (pos < content.size())
+        {
+            size_t eol = content.find('\n', pos);
+            if (eol == std::string_view::npos)
+                eol = content.size();
+            add(content.substr(pos, eol - pos));
+            pos = eol + 1;
+        }
+    }
+
+    bool empty() const { return patterns.empty(); }
+
+    // --- 1: ignored, 0: re-included by a '!' pattern, -1: no pattern matches ---
+    // `path` is relative to the directory of this file.
+    int match(std::string_view path, bool isDir) const
+    {
+        size_t slash = path.rfind('/');
+        std::string_view name = slash == std::string_view::npos ? path : path.substr(slash + 1);
+        long best = -1;
+        auto consider = [&](const std::vector<uint32_t> *ids)
+        {
+            if (!ids)
+                return;
+            for (uint32_t id : *ids) // ascending: the last applicable one wins
+                if (isDir || !patterns[id].dirOnly)
+                    best = std::max(best, static_cast<long>(id));
+        };
+        auto find = [](const std::unordered_map<std::string, std::vector<uint32_t>> &map, std::string_view key)
+        {
+            auto it = map.find(std::string(key));
+            return it == map.end() ? nullptr : &it->second;
+        };
+
+        consider(find(names, name));
+        consider(find(paths, path));
+        // The other buckets are scanned newest first and stop at the first match
+        for (auto it = suffixes.rbegin(); it != suffixes.rend() && *it > best; ++it)
+        {
+            const Pattern &p = patterns[*it];
+            if ((isDir || !p.dirOnly) && name.size() >= p.text.size() &&
+                name.compare(name.size() - p.text.size(), p.text.size(), p.text) == 0)
+                best = *it;
+        }
+        for (auto it = prefixes.rbegin(); it != prefixes.rend() && *it > best; ++it)
+        {
+            const Pattern &p = patterns[*it];
+            if ((isDir || !p.dirOnly) && name.compare(0, p.text.size(), p.text) == 0)
+                best = *it;
+        }
+        for (auto it = globs.rbegin(); it != globs.rend() && *it > best; ++it)
+        {
+            const Pattern &p = patterns[*it];
+            if ((isDir || !p.dirOnly) && wildMatch(p.text, p.anchored ? path : name))
+            {
+                best = *it;
+                break;
+            }
+        }
+        return best < 0 ? -1 : (patterns[best].negated ? 0 : 1);
+    }
+
+private:
+    struct Pattern
+    {
+        std::string text; // without '!', the anchoring '/' and the trailing '/'
+        bool negated = false;
+        bool dirOnly = false;
+        bool anchored = false; // matched against the whole path, not just the name
+    };
+
+    std::vector<Pattern> patterns;
+    std::unordered_map<std::string, std::vector<uint32_t>> names; // unanchored literals
+    std::unordered_map<std::string, std::vector<uint32_t>> paths; // anchored literals
+    std::vector<uint32_t> suffixes, prefixes, globs;              // ascending pattern ids
+
+    void add(std::string_view line)
+    {
+        while (!line.empty() && (line.back() == '\r' || (line.back() == ' ' && (line.size() < 2 || line[line.size() - 2] != '\\'))))
+            line.remove_suffix(1);
+        if (line.empty() || line[0] == '#')
+            return;
+
+        Pattern p;
+        if (line[0] == '!')
+        {
+            p.negated = true;
+            line.remove_prefix(1);
+        }
+        else if (line[0] == '\\' && line.size() > 1 && (line[1] == '#' || line[1] == '!'))
+            line.remove_prefix(1);
+        if (!line.empty() && line.back() == '/')
+        {
+            p.dirOnly = true;
+            line.remove_suffix(1);
+        }
+        p.anchored = line.find('/') != std::string_view::npos;
+        if (!line.empty() && line[0] == '/')
+            line.remove_prefix(1);
+        if (line.empty())
+            return;
+        p.text.assign(line);
+
+        uint32_t id = static_cast<uint32_t>(patterns.size());
+        auto isWild = [](std::string_view s)
+        { return s.find_first_of("*?[\\") != std::string_view::npos; };
+        std::string_view rest = std::string_view(p.text).substr(1);
+        std::string_view head = std::string_view(p.text).substr(0, p.text.size() - 1);
+        if (!isWild(p.text))
+            (p.anchored ? paths : names)[p.text].push_back(id);
+        else if (!p.anchored && p.text[0] == '*' && !isWild(rest))
+        {
+            p.text.erase(0, 1);
+            suffixes.push_back(id);
+        }
+        else if (!p.anchored && p.text.back() == '*' && !isWild(head))
+        {
+            p.text.pop_back();
+            prefixes.push_back(id);
+        }
+        else
+            globs.push_back(id);
+        patterns.push_back(std::move(p));
+    }
+};
+
+// ---------- All .mygitignore files of a working tree ----------
+// Files are read lazily, the first time a path below their directory is
+// checked, and kept for the lifetime of the object.
+class IgnoreRules
+{
+public:
+    // --- Is `path` (relative to the top of the working tree) ignored? ---
+    // Only the path itself is matched: callers that walk the tree never descend
+    // into an ignored directory, so they need not check the parents again.
+    bool isIgnored(std::string_view path, bool isDir)
+    {
+        // deepest .mygitignore first
+        for (size_t end = path.rfind('/');; end = end == 0 ? std::string_view::npos : path.rfind('/', end - 1))
+        {
+            std::string_view dir = end == std::string_view::npos ? std::string_view() : path.substr(0, end);
+            const IgnoreList &list = listFor(dir);
+            if (!list.empty())
+            {
+                int result = list.match(dir.empty() ? path : path.substr(dir.size() + 1), isDir);
+                if (result >= 0)
+                    return result == 1;
+            }
+            if (end == std::string_view::npos)
+                return false;
+        }
+    }
+
+    // --- Like isIgnored(), but a path inside an ignored directory is ignored too ---
+    bool isExcluded(std::string_view path, bool isDir)
+    {
+        for (size_t slash = path.find('/'); slash != std::string_view::npos; slash = path.find('/', slash + 1))
+            if (isIgnored(path.substr(0, slash), true))
+                return true;
+        return isIgnored(path, isDir);
+    }
+
+private:
+    std::unordered_map<std::string, std::unique_ptr<IgnoreList>> lists; // directory ("" = top) -> its rules
+
+    const IgnoreList &listFor(std::string_view dir)
+    {
+        auto &list = lists[std::string(dir)];
+        if (!list)
+        {
+            list = std::make_unique<IgnoreList>();
+            std::ifstream in(dir.empty() ? std::string(".mygitignore") : std::string(dir) + "/.mygitignore", std::ios::binary);
+            if (in)
+                list->parse(std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()));
+        }
+        return *list;
+    }
+};
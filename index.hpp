@@ -0,0 +1,593 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include "hash.hpp"
+#include "lockfile.hpp"
+#include "mapped_file.hpp"
+#include "trace.hpp"
+
+/**
+ * The index (staging area) records, for every tracked path, the blob hash that
+ * will go into the next commit together with the stat data the file had when it
+ * was hashed. If a later lstat() returns the same stat data the file is assumed
+ * unchanged and never has to be read again, just like git's index.
+ *
+ * On-disk format (all integers big-endian), entries sorted by path:
+ *   "MIDX" | u32 version (2) | u32 entry count
+ *   per entry:
+ *     u32 ctime sec | u32 ctime nsec | u32 mtime sec | u32 mtime nsec
+ *     u64 dev | u64 ino | u32 mode | u64 size
+ *     raw object id (20 bytes for SHA-1, 32 for SHA-256)
+ *     varint N | NUL-terminated suffix: the path is the previous entry's path
+ *     with N bytes cut from its end, plus the suffix
+ *   optional extensions: 4-byte signature | u32 size | data
+ *     "TREE": cached tree ids, repeated "<dir path>\0<raw id>"
+ *     "FSMN": fsmonitor token "\0", then two lists (not-clean tracked paths,
+ *             untracked paths), each a u32 count of NUL-terminated paths
+ *     "UNTR": untracked cache, per directory "<dir path>\0" | u32 mtime sec |
+ *             u32 mtime nsec | u64 ino | u32 .mygitignore mtime sec | u32 nsec |
+ *             u64 .mygitignore size, then two lists (untracked files,
+ *             subdirectories), each a u32 count of NUL-terminated names
+ *   checksum of everything above (the repository's hash)
+ *
+ * Version 1 (u16 path length + full path, no checksum) is still read.
+ * The file is only ever replaced through "index.lock" (see lockfile.hpp).
+ */
+struct IndexEntry
+{
+    std::string path; // repository-relative, '/' separated
+    ObjectId hash; // blob id
+    uint32_t ctimeSec = 0;
+    uint32_t ctimeNsec = 0;
+    uint32_t mtimeSec = 0;
+    uint32_t mtimeNsec = 0;
+    uint64_t dev = 0;
+    uint64_t ino = 0;
+    uint32_t mode = 0;
+    uint64_t size = 0;
+};
+
+// --- Git tree mode for a file's st_mode: symlink, executable or regular file ---
+inline std::string gitMode(uint32_t mode)
+{
+    if (S_ISLNK(mode))
+        return "120000";
+    if (mode & S_IXUSR)
+        return "100755";
+    return "100644";
+}
+
+// --- Copy the stat fields the index cares about ---
+inline void fillStatData(IndexEntry &entry, const struct stat &st)
+{
+    entry.ctimeSec = static_cast<uint32_t>(st.st_ctim.tv_sec);
+    entry.ctimeNsec = static_cast<uint32_t>(st.st_ctim.tv_nsec);
+    entry.mtimeSec = static_cast<uint32_t>(st.st_mtim.tv_sec);
+    entry.mtimeNsec = static_cast<uint32_t>(st.st_mtim.tv_nsec);
+    entry.dev = static_cast<uint64_t>(st.st_dev);
+    entry.ino = static_cast<uint64_t>(st.st_ino);
+    entry.mode = static_cast<uint32_t>(st.st_mode);
+    entry.size = static_cast<uint64_t>(st.st_size);
+}
+
+// --- True if the file still looks exactly like it did when it was hashed ---
+inline bool statMatches(const IndexEntry &entry, const struct stat &st)
+{
+    return entry.mtimeSec == static_cast<uint32_t>(st.st_mtim.tv_sec) &&
+           entry.mtimeNsec == static_cast<uint32_t>(st.st_mtim.tv_nsec) &&
+           entry.ctimeSec == static_cast<uint32_t>(st.st_ctim.tv_sec) &&
+           entry.ctimeNsec == static_cast<uint32_t>(st.st_ctim.tv_nsec) &&
+           entry.ino == static_cast<uint64_t>(st.st_ino) &&
+           entry.dev == static_cast<uint64_t>(st.st_dev) &&
+           entry.mode == static_cast<uint32_t>(st.st_mode) &&
+           entry.size == static_cast<uint64_t>(st.st_size);
+}
+
+// --- Untracked cache: what status found in one directory ---
+// Valid while the directory's own stat data is unchanged (an entry was added,
+// removed or renamed otherwise) and its .mygitignore is the same file. Staging
+// or removing a path in the directory invalidates it as well.
+struct UntrackedDir
+{
+    uint32_t mtimeSec = 0;
+    uint32_t mtimeNsec = 0;
+    uint64_t ino = 0;
+    uint32_t ignoreMtimeSec = 0; // the directory's .mygitignore (all 0: none)
+    uint32_t ignoreMtimeNsec = 0;
+    uint64_t ignoreSize = 0;
+    std::vector<std::string> files; // untracked, not ignored
+    std::vector<std::string> dirs;  // subdirectories, not ignored
+
+    void setStat(const struct stat &st)
+    {
+        mtimeSec = static_cast<uint32_t>(st.st_mtim.tv_sec);
+        mtimeNsec = static_cast<uint32_t>(st.st_mtim.tv_nsec);
+        ino = static_cast<uint64_t>(st.st_ino);
+    }
+
+    void setIgnoreStat(const struct stat &st)
+    {
+        ignoreMtimeSec = static_cast<uint32_t>(st.st_mtim.tv_sec);
+        ignoreMtimeNsec = static_cast<uint32_t>(st.st_mtim.tv_nsec);
+        ignoreSize = static_cast<uint64_t>(st.st_size);
+    }
+
+    bool sameIgnore(const UntrackedDir &other) const
+    {
+        return ignoreMtimeSec == other.ignoreMtimeSec && ignoreMtimeNsec == other.ignoreMtimeNsec &&
+               ignoreSize == other.ignoreSize;
+    }
+
+    bool sameStat(const UntrackedDir &other) const
+    {
+        return mtimeSec == other.mtimeSec && mtimeNsec == other.mtimeNsec && ino == other.ino && sameIgnore(other);
+    }
+};
+
+struct Index
+{
+    std::map<std::string, IndexEntry> entries; // sorted by path
+
+    // Cache tree: directory path ("" = root) -> tree id written for it last time.
+    // A directory is dropped from the cache as soon as anything below it changes,
+    // so the ids that remain can be reused without re-reading their entries.
+    std::map<std::string, ObjectId> cacheTree;
+
+    // fsmonitor state: the daemon token of the last status, plus what that status
+    // found not clean. Those paths are re-checked every time even if the daemon
+    // reports no new change for them.
+    std::string fsmonitorToken;
+    std::vector<std::string> fsmonitorDirty;     // modified or deleted tracked files
+    std::vector<std::string> fsmonitorUntracked; // as status printed them ("dir/" for dirs)
+
+    // Untracked cache: directory path ("" = root) -> what status found in it
+    std::map<std::string, UntrackedDir> untrackedCache;
+
+    // --- Stage an entry, invalidating cached trees only if content or mode changed ---
+    void stage(const IndexEntry &entry)
+    {
+        auto it = entries.find(entry.path);
+        if (it == entries.end())
+        {
+            removeConflicts(entry.path);
+            invalidateUntracked(entry.path);
+        }
+        if (it == entries.end() || it->second.hash != entry.hash || gitMode(it->second.mode) != gitMode(entry.mode))
+            invalidate(entry.path);
+        entries[entry.path] = entry;
+    }
+
+    // A path cannot be both a file and a directory: staging "a/b" drops a file "a",
+    // staging a file "a" drops everything under "a/"
+    void removeConflicts(const std::string &filePath)
+    {
+        for (size_t slash = filePath.find('/'); slash != std::string::npos; slash = filePath.find('/', slash + 1))
+            remove(filePath.substr(0, slash));
+        std::string prefix = filePath + "/";
+        auto it = entries.lower_bound(prefix);
+        while (it != entries.end() && it->first.compare(0, prefix.size(), prefix) == 0)
+        {
+            invalidateUntracked(it->first);
+            it = entries.erase(it);
+        }
+        cacheTree.erase(filePath);
+        for (auto dir = cacheTree.lower_bound(prefix); dir != cacheTree.end() && dir->first.compare(0, prefix.size(), prefix) == 0;)
+            dir = cacheTree.erase(dir);
+    }
+
+    void remove(const std::string &filePath)
+    {
+        if (entries.erase(filePath))
+        {
+            invalidate(filePath);
+            invalidateUntracked(filePath);
+        }
+    }
+
+    // --- True if some tracked path lies below directory `dir` ---
+    bool hasEntriesUnder(const std::string &dir) const
+    {
+        std::string prefix = dir + "/";
+        auto it = entries.lower_bound(prefix);
+        return it != entries.end() && it->first.compare(0, prefix.size(), prefix) == 0;
+    }
+
+    // Drop the cached tree of every directory containing `filePath`
+    void invalidate(const std::string &filePath)
+    {
+        cacheTree.erase("");
+        for (size_t slash = filePath.find('/'); slash != std::string::npos; slash = filePath.find('/', slash + 1))
+            cacheTree.erase(filePath.substr(0, slash));
+    }
+
+    // Force a re-read of the directory holding `filePath`: whether the file is
+    // untracked changed. The .mygitignore stat is kept for comparison.
+    void invalidateUntracked(const std::string &filePath)
+    {
+        size_t slash = filePath.rfind('/');
+        auto it = untrackedCache.find(slash == std::string::npos ? std::string() : filePath.substr(0, slash));
+        if (it != untrackedCache.end())
+            it->second.mtimeSec = it->second.mtimeNsec = 0;
+    }
+
+    // mtime of the index file when it was loaded. An entry modified at or after
+    // this moment is "racy": it may have changed again within the same timestamp
+    // granularity, so its stat data cannot be trusted and it must be re-hashed.
+    uint32_t fileMtimeSec = 0;
+    uint32_t fileMtimeNsec = 0;
+
+    bool isRacy(uint32_t mtimeSec, uint32_t mtimeNsec) const
+    {
+        if (fileMtimeSec == 0)
+            return true;
+        if (mtimeSec != fileMtimeSec)
+            return mtimeSec > fileMtimeSec;
+        return mtimeNsec >= fileMtimeNsec;
+    }
+
+    bool isRacy(const IndexEntry &entry) const
+    {
+        return isRacy(entry.mtimeSec, entry.mtimeNsec);
+    }
+
+    // An entry can be trusted without reading the file if its stat data is unchanged
+    bool isUpToDate(const IndexEntry &entry, const struct stat &st) const
+    {
+        return statMatches(entry, st) && !isRacy(entry);
+    }
+
+    // --- Load index from disk (missing file = empty index) ---
+    // The file is mapped and parsed in place; entries are stored sorted, so each
+    // one is appended to the map in constant time.
+    bool load(const std::string &file)
+    {
+        TraceSpan span("index.load");
+        entries.clear();
+        cacheTree.clear();
+        fsmonitorToken.clear();
+        fsmonitorDirty.clear();
+        fsmonitorUntracked.clear();
+        untrackedCache.clear();
+
+        struct stat st;
+        if (::stat(file.c_str(), &st) != 0)
+            return true;
+        fileMtimeSec = static_cast<uint32_t>(st.st_mtim.tv_sec);
+        fileMtimeNsec = static_cast<uint32_t>(st.st_mtim.tv_nsec);
+
+        MappedFile map;
+        if (!map.open(file))
+            return false;
+        if (map.size() == 0)
+            return true; // empty file: nothing staged yet
+
+        const unsigned char *p = map.data();
+        const unsigned char *end = p + map.size();
+        if (map.size() < 12 || std::memcmp(p, "MIDX", 4) != 0)
+            return false;
+        uint32_t version = getU32(p + 4);
+        uint32_t count = getU32(p + 8);
+        if (version != 1 && version != 2)
+            return false;
+
+        if (version >= 2)
+        {
+            // trailing checksum over everything before it
+            if (map.size() < 12 + hashAlgo().rawSize)
+                return false;
+            end -= hashAlgo().rawSize;
+            if (hashBytes(p, end - p).raw() != std::string_view(reinterpret_cast<const char *>(end), hashAlgo().rawSize))
+                return false;
+        }
+
+        p += 12;
+        std::string path;
+        const ptrdiff_t fixedSize = entryFixedSize();
+        for (uint32_t i = 0; i < count; i++)
+        {
+            if (end - p < fixedSize)
+                return false;
+            IndexEntry entry;
+            entry.ctimeSec = getU32(p);
+            entry.ctimeNsec = getU32(p + 4);
+            entry.mtimeSec = getU32(p + 8);
+            entry.mtimeNsec = getU32(p + 12);
+            entry.dev = getU64(p + 16);
+            entry.ino = getU64(p + 24);
+            entry.mode = getU32(p + 32);
+            entry.size = getU64(p + 36);
+            entry.hash = ObjectId::fromRaw(p + STAT_SIZE, hashAlgo().rawSize);
+            p += fixedSize;
+
+            if (version == 1)
+            {
+                if (end - p < 2)
+                    return false;
+                size_t len = (size_t(p[0]) << 8) | p[1];
+                p += 2;
+                if (size_t(end - p) < len)
+                    return false;
+                path.assign(reinterpret_cast<const char *>(p), len);
+                p += len;
+            }
+            else
+            {
+                // v2: drop N bytes from the end of the previous path, append the suffix
+                uint64_t strip;
+                if (!getVarint(p, end, strip) || strip > path.size())
+                    return false;
+                const unsigned char *nul = static_cast<const unsigned char *>(std::memchr(p, '\0', end - p));
+                if (!nul)
+                    return false;
+                path.resize(path.size() - strip);
+                path.append(reinterpret_cast<const char *>(p), nul - p);
+                p = nul + 1;
+            }
+
+            entry.path = path;
+            entries.emplace_hint(entries.end(), path, std::move(entry));
+        }
+
+        // --- Extensions ---
+        while (end - p >= 8)
+        {
+            const unsigned char *sig = p;
+            uint32_t size = getU32(p + 4);
+            p += 8;
+            if (size_t(end - p) < size)
+                return false;
+            if (std::memcmp(sig, "TREE", 4) == 0)
+                loadCacheTree(std::string(reinterpret_cast<const char *>(p), size));
+            else if (std::memcmp(sig, "FSMN", 4) == 0)
+                loadFsmonitor(std::string(reinterpret_cast<const char *>(p), size));
+            else if (std::memcmp(sig, "UNTR", 4) == 0)
+                loadUntracked(std::string(reinterpret_cast<const char *>(p), size));
+            // unknown extensions are skipped
+            p += size;
+        }
+        return p == end;
+    }
+
+    // --- Write the whole index through "<file>.lock" ---
+    bool save(const std::string &file) const
+    {
+        LockFile lock;
+        return lock.acquire(file) && save(lock);
+    }
+
+    // Write into a lock the caller already holds (taken before load() so that
+    // nobody can change the index between reading and rewriting it)
+    bool save(LockFile &lock) const
+    {
+        TraceSpan span("index.save");
+        std::string buf = "MIDX";
+        putU32(buf, 2);
+        putU32(buf, static_cast<uint32_t>(entries.size()));
+        buf.reserve(entries.size() * (entryFixedSize() + 16));
+        const std::string *previous = nullptr;
+        for (const auto &[path, entry] : entries)
+        {
+            putU32(buf, entry.ctimeSec);
+            putU32(buf, entry.ctimeNsec);
+            putU32(buf, entry.mtimeSec);
+            putU32(buf, entry.mtimeNsec);
+            putU64(buf, entry.dev);
+            putU64(buf, entry.ino);
+            putU32(buf, entry.mode);
+            putU64(buf, entry.size);
+            buf += entry.hash.raw();
+
+            size_t common = 0;
+            if (previous)
+                while (common < previous->size() && common < path.size() && (*previous)[common] == path[common])
+                    common++;
+            putVarint(buf, previous ? previous->size() - common : 0);
+            buf.append(path, common, std::string::npos);
+            buf.push_back('\0');
+            previous = &path;
+        }
+
+        if (!cacheTree.empty())
+        {
+            std::string tree;
+            for (const auto &[dir, hash] : cacheTree)
+            {
+                tree += dir;
+                tree.push_back('\0');
+                tree += hash.raw();
+            }
+            buf += "TREE";
+            putU32(buf, static_cast<uint32_t>(tree.size()));
+            buf += tree;
+        }
+
+        if (!fsmonitorToken.empty())
+        {
+            std::string data = fsmonitorToken;
+            data.push_back('\0');
+            for (const auto *list : {&fsmonitorDirty, &fsmonitorUntracked})
+            {
+                putU32(data, static_cast<uint32_t>(list->size()));
+                for (const auto &file : *list)
+                {
+                    data += file;
+                    data.push_back('\0');
+                }
+            }
+            buf += "FSMN";
+            putU32(buf, static_cast<uint32_t>(data.size()));
+            buf += data;
+        }
+
+        if (!untrackedCache.empty())
+        {
+            std::string data;
+            for (const auto &[dir, cached] : untrackedCache)
+            {
+                data += dir;
+                data.push_back('\0');
+                putU32(data, cached.mtimeSec);
+                putU32(data, cached.mtimeNsec);
+                putU64(data, cached.ino);
+                putU32(data, cached.ignoreMtimeSec);
+                putU32(data, cached.ignoreMtimeNsec);
+                putU64(data, cached.ignoreSize);
+                for (const auto *list : {&cached.files, &cached.dirs})
+                {
+                    putU32(data, static_cast<uint32_t>(list->size()));
+                    for (const auto &name : *list)
+                    {
+                        data += name;
+                        data.push_back('\0');
+                    }
+                }
+            }
+            buf += "UNTR";
+            putU32(buf, static_cast<uint32_t>(data.size()));
+            buf += data;
+        }
+
+        buf += hashBytes(buf).raw();
+
+        return lock.write(buf) && lock.commit();
+    }
+
+private:
+    void loadFsmonitor(const std::string &data)
+    {
+        size_t pos = data.find('\0');
+        if (pos == std::string::npos)
+            return;
+        std::string token = data.substr(0, pos++);
+        std::vector<std::string> lists[2];
+        for (auto &list : lists)
+        {
+            if (pos + 4 > data.size())
+                return;
+            uint32_t count = getU32(reinterpret_cast<const unsigned char *>(data.data()) + pos);
+            pos += 4;
+            for (uint32_t i = 0; i < count; i++)
+            {
+                size_t nul = data.find('\0', pos);
+                if (nul == std::string::npos)
+                    return;
+                list.push_back(data.substr(pos, nul - pos));
+                pos = nul + 1;
+            }
+        }
+        fsmonitorToken = token;
+        fsmonitorDirty = std::move(lists[0]);
+        fsmonitorUntracked = std::move(lists[1]);
+    }
+
+    void loadUntracked(const std::string &data)
+    {
+        const unsigned char *base = reinterpret_cast<const unsigned char *>(data.data());
+        size_t pos = 0;
+        while (pos < data.size())
+        {
+            size_t nul = data.find('\0', pos);
+            if (nul == std::string::npos || nul + 1 + 32 > data.size())
+                return;
+            std::string dir = data.substr(pos, nul - pos);
+            const unsigned char *p = base + nul + 1;
+            UntrackedDir cached;
+            cached.mtimeSec = getU32(p);
+            cached.mtimeNsec = getU32(p + 4);
+            cached.ino = getU64(p + 8);
+            cached.ignoreMtimeSec = getU32(p + 16);
+            cached.ignoreMtimeNsec = getU32(p + 20);
+            cached.ignoreSize = getU64(p + 24);
+            pos = nul + 1 + 32;
+            for (auto *list : {&cached.files, &cached.dirs})
+            {
+                if (pos + 4 > data.size())
+                    return;
+                uint32_t count = getU32(base + pos);
+                pos += 4;
+                for (uint32_t i = 0; i < count; i++)
+                {
+                    size_t end = data.find('\0', pos);
+                    if (end == std::string::npos)
+                        return;
+                    list->push_back(data.substr(pos, end - pos));
+                    pos = end + 1;
+                }
+            }
+            untrackedCache.emplace_hint(untrackedCache.end(), std::move(dir), std::move(cached));
+        }
+    }
+
+    void loadCacheTree(const std::string &data)
+    {
+        size_t pos = 0;
+        while (pos < data.size())
+        {
+            size_t nul = data.find('\0', pos);
+            if (nul == std::string::npos || nul + 1 + hashAlgo().rawSize > data.size())
+                break;
+            cacheTree[data.substr(pos, nul - pos)] = ObjectId::fromRaw(data.data() + nul + 1, hashAlgo().rawSize);
+            pos = nul + 1 + hashAlgo().rawSize;
+        }
+    }
+
+    // Fixed-width part of an entry: stat data + raw id
+    static const ptrdiff_t STAT_SIZE = 4 * 4 + 8 + 8 + 4 + 8;
+
+    static ptrdiff_t entryFixedSize()
+    {
+        return STAT_SIZE + static_cast<ptrdiff_t>(hashAlgo().rawSize);
+    }
+
+    static uint32_t getU32(const unsigned char *b)
+    {
+        return (uint32_t(b[0]) << 24) | (uint32_t(b[1]) << 16) | (uint32_t(b[2]) << 8) | uint32_t(b[3]);
+    }
+
+    static uint64_t getU64(const unsigned char *b)
+    {
+        return (uint64_t(getU32(b)) << 32) | getU32(b + 4);
+    }
+
+    // 7 bits per byte, low bits first; the high bit marks a continuation
+    static bool getVarint(const unsigned char *&p, const unsigned char *end, uint64_t &value)
+    {
+        value = 0;
+        for (int shift = 0; p < end && shift < 64; shift += 7)
+        {
+            unsigned char byte = *p++;
+            value |= uint64_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return true;
+        }
+        return false;
+    }
+
+    static void putVarint(std::string &buf, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            buf.push_back(static_cast<char>((value & 0x7f) | 0x80));
+            value >>= 7;
+        }
+        buf.push_back(static_cast<char>(value));
+    }
+
+    static void putU32(std::string &buf, uint32_t v)
+    {
+        for (int shift = 24; shift >= 0; shift -= 8)
+            buf.push_back(static_cast<char>((v >> shift) & 0xff));
+    }
+
+    static void putU64(std::string &buf, uint64_t v)
+    {
+        putU32(buf, static_cast<uint32_t>(v >> 32));
+        putU32(buf, static_cast<uint32_t>(v));
+    }
+};
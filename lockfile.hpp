@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * "<file>.lock" protocol used for every file that is rewritten in place
+ * (index, refs): the lock is created with O_EXCL, so only one process can hold
+ * it; the new content is written into the lock file and renamed over the
+ * target on commit(), so readers see either the old or the new file, never a
+ * partial one. A lock that is neither committed nor rolled back is removed by
+ * the destructor.
+ */
+class LockFile
+{
+public:
+    LockFile() = default;
+    LockFile(const LockFile &) = delete;
+    LockFile &operator=(const LockFile &) = delete;
+
+    ~LockFile()
+    {
+        rollback();
+    }
+
+    // `quiet` suppresses the error message for callers that can do without the lock.
+    // A lock held by another process is retried for up to `timeoutMs` (refs are
+    // held only for a moment, so concurrent writers wait instead of failing).
+    bool acquire(const std::string &file, bool quiet = false, int timeoutMs = 0)
+    {
+        rollback();
+        target = file;
+        lockPath = file + ".lock";
+        for (int waited = 0, backoff = 1;; waited += backoff, backoff = backoff < 32 ? backoff * 2 : backoff)
+        {
+            fd = ::open(lockPath.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+            if (fd >= 0 || errno != EEXIST || waited >= timeoutMs)
+                break;
+            ::usleep(static_cast<useconds_t>(backoff) * 1000);
+        }
+        if (fd < 0)
+        {
+            if (!quiet)
+            {
+                std::cerr << "Error: unable to create '" << lockPath << "': " << std::strerror(errno) << "\n";
+                if (errno == EEXIST)
+                    std::cerr << "Another mygit process seems to be running in this repository.\n";
+            }
+            return false;
+        }
+        return true;
+    }
+
+    bool isLocked() const { return fd >= 0; }
+    const std::string &path() const { return lockPath; }
+
+    bool write(const void *data, size_t size)
+    {
+        const char *p = static_cast<const char *>(data);
+        while (size > 0)
+        {
+            ssize_t n = ::write(fd, p, size);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            p += n;
+            size -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    bool write(const std::string &data) { return write(data.data(), data.size()); }
+
+    // --- Flush what was written to disk (before commit(), for files worth the cost) ---
+    bool sync() { return fd >= 0 && ::fsync(fd) == 0; }
+
+    // --- Replace the target with what was written ---
+    bool commit()
+    {
+        if (fd < 0)
+            return false;
+        bool ok = ::close(fd) == 0;
+        fd = -1;
+        if (ok && std::rename(lockPath.c_str(), target.c_str()) == 0)
+            return true;
+        ::unlink(lockPath.c_str());
+        return false;
+    }
+
+    // --- Drop the lock and leave the target untouched ---
+    void rollback()
+    {
+        if (fd < 0)
+            return;
+        ::close(fd);
+        fd = -1;
+        ::unlink(lockPath.c_str());
+    }
+
+private:
+    int fd = -1;
+    std::string target;
+    std::string lockPath;
+};
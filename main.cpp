@@ -1,557 +1,209 @@
 #include <iostream>
-#include <filesystem>
-#include <fstream>
-#include <sstream>
-#include <iomanip>
+#include <string>
 #include <vector>
-#include <ctime>
-#include <unordered_map>
-#include <openssl/sha.h> // For SHA1 hash
-#include <map>
+#include <cstdint>
+#include <cstdlib>
+#include "repository.hpp"
 
-namespace fs = std::filesystem;
-
-// --- Helper: compute SHA-1 hash ---
-std::string sha1(const std::string &data)
-{
-    unsigned char hash[SHA_DIGEST_LENGTH];
-    SHA1(reinterpret_cast<const unsigned char *>(data.c_str()), data.size(), hash);
-    std::ostringstream os;
-    for (int i = 0; i < SHA_DIGEST_LENGTH; i++)
-        os << std::hex << std::setw(2) << std::setfill('0') << (int)hash[i];
-    return os.str();
-}
-
-// ---------- Blob structure ----------
-struct Blob
-{
-    std::string hash;
-    std::string content;
-};
-
-// ---------- Commit structure ----------
-struct Commit
-{
-    std::string treeHash;
-    std::string parentHash;
-    std::string author;
-    std::string message;
-    std::string hash;
-};
-
-// ---------- Tree structure ----------
-struct TreeEntry
-{
-    std::string mode; // e.g. "100644"
-    std::string name; // "file.cpp"
-    std::string hash; // blob or subtree hash
-};
-
-struct Tree
-{
-    std::vector<TreeEntry> entries;
-};
-
-// ---------- Repository ----------
-struct Repository
+// --- Main Command Parser (CLI entry point) ---
+int main(int argc, char *argv[])
 {
-    std::string path = ".mygit"; // local repo folder
-
-    bool isInitialized() const
+    if (argc < 2)
     {
-        return fs::exists(path) && fs::exists(path + "/objects");
+        std::cerr << "Usage: mygit <command> [args]\n";
+        return 1;
     }
-    // --- Initialize a new repository ---
-    bool init()
-    {
-        if (isInitialized())
-        {
-            std::cout << "Reinitialized MyGit in " << fs::absolute(path) << "\n";
-            return false;
-        }
 
-        // create directory structure
-        fs::create_directories(path + "/objects");
-        fs::create_directories(path + "/refs/heads");
-        fs::create_directories(path + "/refs/tags");
-
-        std::ofstream(path + "/HEAD") << "ref: refs/heads/main\n";
-
-        // create basic config file
-        std::ofstream cfg(path + "/config");
-        cfg << "[core]\n    repositoryformatversion = 0\n    filemode = true\n    bare = false\n"
-            << "[user]\n    name = Unknown\n    email = unknown@example.com\n";
-        cfg.close();
-
-        std::cout << "Initialized MyGit repository in " << fs::absolute(path) << "\n";
-        return true;
-    }
+    Repository repo;
+    std::string cmd = argv[1];
 
-    // ----- CONFIG MANAGEMENT -----
-    std::map<std::string, std::string> readConfig()
+    if (cmd == "init")
     {
-        // Create a map to store key-value pairs (like "name" -> "Alice", "email" -> "alice@example.com")
-        std::map<std::string, std::string> cfg;
-
-        // Open the config file from the .mygit directory
-        std::ifstream f(path + "/config");
-        if (!f.is_open())
-            return cfg;
-
-        std::string line;
-        // Read the config file line by line
-        while (std::getline(f, line))
-        {
-            // If the line contains "name", extract the substring after '=' and store it as the author name
-            if (line.find("name") != std::string::npos)
-                cfg["name"] = line.substr(line.find("=") + 1);
-
-            // If the line contains "email", extract the substring after '=' and store it as the author email
-            else if (line.find("email") != std::string::npos)
-                cfg["email"] = line.substr(line.find("=") + 1);
-        }
-
-        // --- Trim leading whitespace from each value (e.g., " Alice" → "Alice") ---
-        for (auto &p : cfg)
+        // [--object-format=sha1|sha256]
+        std::string objectFormat = "sha1";
+        const std::string option = "--object-format=";
+        for (int i = 2; i < argc; i++)
         {
-            if (!p.second.empty() && p.second.front() == ' ')
-                p.second.erase(0, p.second.find_first_not_of(' '));
+            std::string arg = argv[i];
+            if (arg.compare(0, option.size(), option) != 0)
+            {
+                std::cerr << "Usage: mygit init [--object-format=sha1|sha256]\n";
+                return 1;
+            }
+            objectFormat = arg.substr(option.size());
         }
-        return cfg;
-    }
-
-    void writeConfig(const std::string &name, const std::string &email)
-    {
-        std::ofstream cfg(path + "/config", std::ios::trunc);
-        cfg << "[core]\n"
-            << "    repositoryformatversion = 0\n"
-            << "    filemode = true\n"
-            << "    bare = false\n"
-            << "[user]\n"
-            << "    name = " << name << "\n"
-            << "    email = " << email << "\n";
+        repo.init(objectFormat);
     }
-
-    // --- Add setter commands ---
-    void setAuthorName(const std::string &name)
+    else if (cmd == "add")
     {
-        if (!isInitialized())
+        if (argc < 3)
         {
-            std::cerr << "Not a MyGit repository.\n";
-            return;
+            std::cerr << "Usage: mygit add <path>...\n";
+            return 1;
         }
-
-        auto cfgmap = readConfig();
-        cfgmap["name"] = name;
-        writeConfig(cfgmap["name"], cfgmap["email"]);
-        std::cout << "Author name set to: " << name << "\n";
+        repo.add(std::vector<std::string>(argv + 2, argv + argc));
     }
-
-    void setAuthorEmail(const std::string &email)
+    else if (cmd == "commit")
     {
-        if (!isInitialized())
+        if (argc < 3)
         {
-            std::cerr << "Not a MyGit repository.\n";
-            return;
+            std::cerr << "Usage: mygit commit <msg>\n";
+            return 1;
         }
-
-        auto cfgmap = readConfig();
-        cfgmap["email"] = email;
-        writeConfig(cfgmap["name"], cfgmap["email"]);
-        std::cout << "Author email set to: " << email << "\n";
+        repo.commit(argv[2]);
     }
-
-    // --- Add operation ---
-    std::string add(const std::string &filePath)
+    else if (cmd == "log" || cmd == "rev-list")
     {
-        if (!isInitialized())
+        // [-n <count>] [--count] [<rev>]
+        // rev-list --objects [--count] [--all] <rev>... [^<rev>...]
+        size_t maxCount = SIZE_MAX;
+        bool countOnly = false, objects = false;
+        std::string rev = "HEAD";
+        std::vector<std::string> include, exclude;
+        for (int i = 2; i < argc; i++)
         {
-            std::cerr << "Error: not a MyGit repository. \n";
-            return "";
+            std::string arg = argv[i];
+            if (arg == "-n" && i + 1 < argc)
+                maxCount = std::strtoull(argv[++i], nullptr, 10);
+            else if (arg.size() > 2 && arg.compare(0, 2, "-n") == 0)
+                maxCount = std::strtoull(arg.c_str() + 2, nullptr, 10);
+            else if (arg == "--count" && cmd == "rev-list")
+                countOnly = true;
+            else if (arg == "--objects" && cmd == "rev-list")
+                objects = true;
+            else if (arg.size() > 1 && arg[0] == '^')
+                exclude.push_back(arg.substr(1));
+            else
+            {
+                rev = arg;
+                include.push_back(arg);
+            }
         }
-
-        if (!fs::exists(filePath))
+        if (objects)
         {
-            std::cerr << "Error: file not found: " << filePath << "\n";
-            return "";
+            if (include.empty())
+                include.push_back("HEAD");
+            if (!repo.revListObjects(include, exclude, countOnly))
+                return 1;
         }
-
-        // Read file content
-        std::ifstream file(filePath, std::ios::binary); // Open the file in binary mode
-        std::ostringstream buffer;
-        buffer << file.rdbuf(); // Stream file contents into an in-memory buffer
-        file.close();
-        std::string content = buffer.str();
-
-        // Compute hash
-        // The hash uniquely identifies a file by its content.
-        std::string hash = sha1(content);
-
-        // Use the first two characters of the hash as a subdirectory
-        // (to distribute objects into multiple folders — just like Git does).
-        std::string dir = path + "/objects/" + hash.substr(0, 2);
-        std::string fileName = hash.substr(2);
-
-        // store the blob object
-        fs::create_directories(dir);
-
-        // Save the raw file content into the object store under ".mygit/objects/"
-        std::ofstream blobFile(dir + "/" + fileName, std::ios::binary);
-        blobFile << content;
-        blobFile.close();
-
-        // Record the blob in the index
-        // Append a new entry to ".mygit/index" that maps the filename to its content hash.
-        std::ofstream indexFile(path + "/index", std::ios::app);
-        indexFile << filePath << " " << hash << "\n";
-        indexFile.close();
-
-        std::cout << "Added file " << filePath << " as blob " << hash << "\n";
-        return hash;
+        else if (cmd == "log")
+            repo.logCommits(maxCount, rev);
+        else if (!repo.revList(rev, maxCount, countOnly))
+            return 1;
     }
-
-    // ---------- BUILD TREE FROM INDEX ----------
-    Tree buildTree()
+    else if (cmd == "diff")
     {
-        Tree tree;
-        std::ifstream index(path + "/index");
-        if (!index.is_open())
-            return tree;
-
-        std::string filename, blobHash;
-        while (index >> filename >> blobHash)
-        {
-            TreeEntry entry;
-            entry.mode = "100644"; // Normal file permission
-            entry.name = filename;
-            entry.hash = blobHash;
-            tree.entries.push_back(entry);
-        }
-        return tree;
+        if (!repo.diff(std::vector<std::string>(argv + 2, argv + argc)))
+            return 1;
     }
-
-    // ---------- Write Tree Object ----------
-    std::string writeTree(const Tree &tree)
+    else if (cmd == "branch")
     {
-        std::ostringstream treeContent;
-        for (const auto &entry : tree.entries)
-        {
-            treeContent << entry.mode << " " << entry.name << "\0" << entry.hash << "\n";
-        }
-        std::string content = treeContent.str();
-        std::string hash = sha1(content);
-
-        std::string dir = path + "/objects/" + hash.substr(0, 2);
-        std::string file = hash.substr(2);
-        fs::create_directories(dir);
-        std::ofstream(dir + "/" + file, std::ios::binary) << content;
-
-        return hash;
+        if (!repo.branch(std::vector<std::string>(argv + 2, argv + argc)))
+            return 1;
     }
-
-    // --- Commit operation ---
-    std::string commit(const std::string &message)
+    else if (cmd == "update-ref")
     {
-        if (!isInitialized())
-        {
-            std::cerr << "Error: not a MyGit repository.\n";
-            return "";
-        }
-
-        // Ensure there is an index
-        Tree tree = buildTree();
-        if (tree.entries.empty())
-        {
-            std::cerr << "Nothing to commit.\n";
-            return "";
-        }
-
-        // build a simple tree object
-        std::string treeHash = writeTree(tree);
-
-        // Find parent commit
-        std::string parentHash;
-        std::string refPath = path + "/refs/heads/main";
-        if (fs::exists(refPath))
-        {
-            std::ifstream ref(refPath);
-            ref >> parentHash;
-        }
-
-        // Create commit object
-        std::ostringstream commitBuf;
-        commitBuf << "tree " << treeHash << "\n";
-        if (!parentHash.empty())
-            commitBuf << "parent " << parentHash << "\n";
-
-        // read name/email from config
-        auto cfg = readConfig();
-        std::string authorName = cfg.count("name") ? cfg["name"] : "Unknown";
-        std::string authorEmail = cfg.count("email") ? cfg["email"] : "unknown@example.com";
-
-        commitBuf << "author " << authorName << " <" << authorEmail << "> "
-                  << std::time(nullptr) << "\n\n";
-
-        commitBuf << message << "\n";
-
-        std::string commitContent = commitBuf.str();
-        std::string commitHash = sha1(commitContent);
-
-        std::string dir = path + "/objects/" + commitHash.substr(0, 2);
-        std::string file = commitHash.substr(2);
-        fs::create_directories(dir);
-        std::ofstream(dir + "/" + file, std::ios::binary) << commitContent;
-
-        std::ofstream(refPath) << commitHash;
-
-        // clear index (as Git does)
-        std::ofstream(path + "/index", std::ios::trunc);
-
-        std::cout << "[main " << commitHash.substr(0, 7) << "] " << message << "\n";
-        return commitHash;
+        if (!repo.updateRefs(std::vector<std::string>(argv + 2, argv + argc)))
+            return 1;
     }
-
-    // --- log operation ---
-    void logCommits() const
+    else if (cmd == "pack-refs")
     {
-        if (!isInitialized())
-        {
-            std::cerr << "Not a MyGit repository.\n";
-            return;
-        }
-
-        std::string branchRef = path + "/refs/heads/main";
-        if (!fs::exists(branchRef))
-        {
-            std::cerr << "No commits yet.\n";
-            return;
-        }
-
-        // Read the latest commit hash
-        std::string commitHash;
-        std::ifstream(branchRef) >> commitHash;
-
-        while (!commitHash.empty())
-        {
-            std::string dir = path + "/objects/" + commitHash.substr(0, 2);
-            std::string file = commitHash.substr(2);
-            std::ifstream commitFile(dir + "/" + file, std::ios::binary);
-
-            if (!commitFile.is_open())
-            {
-                std::cerr << "Error: cannot open commit " << commitHash << "\n";
-                return;
-            }
-
-            std::string line;
-            std::string treeHash, parentHash, author, message;
-            bool msgStarted = false;
-            while (std::getline(commitFile, line))
-            {
-                if (line.rfind("tree ", 0) == 0)
-                    treeHash = line.substr(5);
-                else if (line.rfind("parent ", 0) == 0)
-                    parentHash = line.substr(7);
-                else if (line.rfind("author ", 0) == 0)
-                    author = line.substr(7);
-                else if (line.empty())
-                    msgStarted = true;
-                else if (msgStarted)
-                    message += line + "\n";
-            }
-            commitFile.close();
-
-            std::cout << "commit " << commitHash << "\n";
-            if (!author.empty())
-                std::cout << "Author: " << author << "\n";
-            std::cout << "\n    " << message << "\n";
-
-            if (parentHash.empty())
-                break;
-            commitHash = parentHash;
-        }
+        if (!repo.packAllRefs())
+            return 1;
     }
-
-    void status()
+    else if (cmd == "checkout")
     {
-        if (!isInitialized())
-        {
-            std::cerr << "Error: not a MyGit repository.\n";
-            return;
-        }
-
-        // --- Read current branch name from HEAD ---
-        std::ifstream headFile(path + "/HEAD");
-        std::string headRef;
-        std::getline(headFile, headRef);
-        headFile.close();
-
-        std::string branch = "main";
-        if (headRef.find("ref:") != std::string::npos)
-            branch = headRef.substr(headRef.find_last_of('/') + 1);
-
-        std::cout << "On branch " << branch << "\n\n";
-
-        // --- Read index (staging area) ---
-        std::map<std::string, std::string> indexEntries;
-        std::ifstream indexFile(path + "/index");
-        if (indexFile.is_open())
+        bool create = argc == 4 && std::string(argv[2]) == "-b";
+        if (argc != 3 && !create)
         {
-            std::string filePath, fileHash;
-            while (indexFile >> filePath >> fileHash)
-                indexEntries[filePath] = fileHash;
-            indexFile.close();
-        }
-
-        // --- Read last commit’s tracked files (if any) ---
-        std::map<std::string, std::string> committedFiles;
-        std::string branchRef = path + "/refs/heads/" + branch;
-        if (fs::exists(branchRef))
-        {
-            std::ifstream refFile(branchRef);
-            std::string commitHash;
-            refFile >> commitHash;
-            refFile.close();
-
-            // Load commit from objects
-            std::string commitDir = path + "/objects/" + commitHash.substr(0, 2);
-            std::string commitFile = commitHash.substr(2);
-            std::ifstream commitObj(commitDir + "/" + commitFile, std::ios::binary);
-            if (commitObj.is_open())
-            {
-                std::string line, treeHash;
-                while (std::getline(commitObj, line))
-                {
-                    if (line.rfind("tree ", 0) == 0)
-                    {
-                        treeHash = line.substr(5);
-                        break;
-                    }
-                }
-                commitObj.close();
-
-                // Read tree object to get committed files
-                if (!treeHash.empty())
-                {
-                    std::string treeDir = path + "/objects/" + treeHash.substr(0, 2);
-                    std::string treeName = treeHash.substr(2);
-                    std::ifstream treeObj(treeDir + "/" + treeName, std::ios::binary);
-                    std::string entry;
-                    while (std::getline(treeObj, entry))
-                    {
-                        std::istringstream iss(entry);
-                        std::string mode, name, hash;
-                        iss >> mode >> name >> hash;
-                        if (!name.empty() && !hash.empty())
-                            committedFiles[name] = hash;
-                    }
-                    treeObj.close();
-                }
-            }
-        }
-
-        // --- Collect file states ---
-        std::vector<std::string> staged;
-        std::vector<std::string> modified;
-        std::vector<std::string> untracked;
-
-        // Check staged files
-        for (auto &[filename, hash] : indexEntries)
-            staged.push_back(filename);
-
-        // Walk working directory (skip .mygit)
-        for (auto &entry : fs::directory_iterator(fs::current_path()))
-        {
-            if (entry.path().filename() == ".mygit")
-                continue;
-            if (entry.is_directory())
-                continue;
-
-            std::string fname = entry.path().filename();
-            std::ifstream f(fname, std::ios::binary);
-            std::ostringstream buf;
-            buf << f.rdbuf();
-            std::string content = buf.str();
-            f.close();
-
-            std::string h = sha1(content);
-
-            bool inIndex = indexEntries.count(fname);
-            bool inCommit = committedFiles.count(fname);
-
-            if (inCommit && h != committedFiles[fname])
-                modified.push_back(fname);
-            else if (!inIndex && !inCommit)
-                untracked.push_back(fname);
-        }
-
-        // --- Print results ---
-        if (!staged.empty())
-        {
-            std::cout << "Staged files:\n";
-            for (auto &f : staged)
-                std::cout << "    " << f << "\n";
-            std::cout << "\n";
-        }
-
-        if (!modified.empty())
-        {
-            std::cout << "Modified (not staged):\n";
-            for (auto &f : modified)
-                std::cout << "    " << f << "\n";
-            std::cout << "\n";
-        }
-
-        if (!untracked.empty())
-        {
-            std::cout << "Untracked files:\n";
-            for (auto &f : untracked)
-                std::cout << "    " << f << "\n";
-            std::cout << "\n";
+            std::cerr << "Usage: mygit checkout [-b] <branch|commit>\n";
+            return 1;
         }
-
-        if (staged.empty() && modified.empty() && untracked.empty())
-            std::cout << "Nothing to commit, working tree clean\n";
+        if (!repo.checkout(argv[create ? 3 : 2], create))
+            return 1;
     }
-};
-
-// --- Main Command Parser (CLI entry point) ---
-int main(int argc, char *argv[])
-{
-    if (argc < 2)
+    else if (cmd == "fsmonitor")
     {
-        std::cerr << "Usage: mygit <command> [args]\n";
-        return 1;
+        if (!repo.fsmonitorCommand(argc > 2 ? argv[2] : ""))
+            return 1;
     }
-
-    Repository repo;
-    std::string cmd = argv[1];
-
-    if (cmd == "init")
+    else if (cmd == "merge")
     {
-        repo.init();
+        if (argc != 3)
+        {
+            std::cerr << "Usage: mygit merge <branch|commit>\n";
+            return 1;
+        }
+        if (!repo.merge(argv[2]))
+            return 1;
     }
-    else if (cmd == "add")
+    else if (cmd == "merge-base")
     {
-        if (argc < 3)
+        bool ancestorCheck = argc == 5 && std::string(argv[2]) == "--is-ancestor";
+        if (argc != 4 && !ancestorCheck)
         {
-            std::cerr << "Usage: mygit add <file>\n";
+            std::cerr << "Usage: mygit merge-base [--is-ancestor] <commit> <commit>\n";
             return 1;
         }
-        repo.add(argv[2]);
+        if (ancestorCheck)
+            return repo.isAncestor(argv[3], argv[4]) ? 0 : 1;
+        if (!repo.mergeBase(argv[2], argv[3]))
+            return 1;
     }
-    else if (cmd == "commit")
+    else if (cmd == "commit-graph")
     {
-        if (argc < 3)
+        if (argc < 3 || std::string(argv[2]) != "write")
         {
-            std::cerr << "Usage: mygit commit <msg>\n";
+            std::cerr << "Usage: mygit commit-graph write\n";
             return 1;
         }
-        repo.commit(argv[2]);
+        ObjectId head = repo.readHeadCommit();
+        if (!head.empty() && repo.updateCommitGraph({head}))
+            std::cout << "Commit-graph has " << repo.commitGraph().size() << " commit(s).\n";
     }
-    else if (cmd == "log")
+    else if (cmd == "cat-file")
     {
-        repo.logCommits();
+        // (-t | -s | -e | -p) <object> | --batch | --batch-check [--buffer]
+        std::string option = argc > 2 ? argv[2] : "";
+        bool batch = option == "--batch" || option == "--batch-check";
+        bool buffered = argc == 4 && std::string(argv[3]) == "--buffer";
+        bool single = argc == 4 && (option == "-t" || option == "-s" || option == "-e" || option == "-p");
+        if (batch ? argc > 3 && !buffered : !single)
+        {
+            std::cerr << "Usage: mygit cat-file (-t | -s | -e | -p) <object>\n"
+                         "       mygit cat-file (--batch | --batch-check) [--buffer]\n";
+            return 1;
+        }
+        if (!(batch ? repo.catFileBatch(option == "--batch", buffered) : repo.catFile(option, argv[3])))
+            return 1;
+    }
+    else if (cmd == "hash-object")
+    {
+        // [-w] [-t <type>] [--stdin | --stdin-paths] [<file>...]
+        std::string type = "blob";
+        bool write = false, stdinPaths = false, fromStdin = false;
+        std::vector<std::string> files;
+        for (int i = 2; i < argc; i++)
+        {
+            std::string arg = argv[i];
+            if (arg == "-w")
+                write = true;
+            else if (arg == "-t" && i + 1 < argc)
+                type = argv[++i];
+            else if (arg == "--stdin-paths")
+                stdinPaths = true;
+            else if (arg == "--stdin")
+                fromStdin = true;
+            else
+                files.push_back(arg);
+        }
+        if ((files.empty() && !stdinPaths && !fromStdin) || (stdinPaths && (fromStdin || !files.empty())))
+        {
+            std::cerr << "Usage: mygit hash-object [-w] [-t <type>] [--stdin | --stdin-paths] [<file>...]\n";
+            return 1;
+        }
+        if (!repo.hashObjects(files, type, write, stdinPaths, fromStdin))
+            return 1;
     }
     else if (cmd == "set_author")
     {
@@ -575,25 +227,114 @@ int main(int argc, char *argv[])
     {
         repo.status();
     }
+    else if (cmd == "gc" || cmd == "repack")
+    {
+        repo.gc();
+    }
+    else if (cmd == "count-objects")
+    {
+        bool verbose = argc == 3 && std::string(argv[2]) == "-v";
+        if (argc > 3 || (argc == 3 && !verbose))
+        {
+            std::cerr << "Usage: mygit count-objects [-v]\n";
+            return 1;
+        }
+        if (!repo.countObjects(verbose))
+            return 1;
+    }
+    else if (cmd == "prune")
+    {
+        bool dryRun = false, ok = true;
+        std::string expire = Repository::PRUNE_EXPIRE;
+        for (int i = 2; i < argc && ok; i++)
+        {
+            std::string arg = argv[i];
+            if (arg == "-n" || arg == "--dry-run")
+                dryRun = true;
+            else if (arg.compare(0, 9, "--expire=") == 0)
+                expire = arg.substr(9);
+            else if (arg == "--expire" && i + 1 < argc)
+                expire = argv[++i];
+            else
+                ok = false;
+        }
+        time_t cutoff;
+        if (!ok || !Repository::parseExpiry(expire, std::time(nullptr), cutoff))
+        {
+            std::cerr << "Usage: mygit prune [-n | --dry-run] [--expire <time>]\n"
+                         "  <time>: now, never or <n>.<seconds|minutes|hours|days|weeks>.ago (default "
+                      << Repository::PRUNE_EXPIRE << ")\n";
+            return 1;
+        }
+        if (!repo.prune(dryRun, cutoff))
+            return 1;
+    }
+    else if (cmd == "fsck")
+    {
+        bool noDangling = argc == 3 && std::string(argv[2]) == "--no-dangling";
+        if (argc > 3 || (argc == 3 && !noDangling))
+        {
+            std::cerr << "Usage: mygit fsck [--no-dangling]\n";
+            return 1;
+        }
+        if (!repo.fsck(!noDangling))
+            return 1;
+    }
     else if (cmd == "help")
     {
         std::cout << "MyGit - a minimal Git-like version control system\n\n"
                  "Usage:\n"
                  "  mygit <command> [arguments]\n\n"
                  "Commands:\n"
-                 "  init                    Initialize a new repository (.mygit directory)\n"
-                 "  add <file>              Add file contents to the staging area\n"
+                 "  init [--object-format=sha1|sha256]\n"
+                 "                          Initialize a new repository (.mygit directory)\n"
+                 "  add <path>...           Add file contents to the staging area (directories recursively)\n"
                  "  commit <message>        Record staged changes as a new commit\n"
-                 "  log                     Display commit history\n"
+                 "  diff [--cached | <commit> <commit>]\n"
+                 "                          Show changes: worktree vs index, index vs HEAD, or two commits\n"
+                 "  log [-n <count>] [<rev>]\n"
+                 "                          Display commit history\n"
+                 "  rev-list [-n <count>] [--count] <rev>\n"
+                 "                          List commit ids reachable from a revision\n"
+                 "  rev-list --objects [--count] [--all] <rev>... [^<rev>...]\n"
+                 "                          List every object reachable from the revs but not the ^revs\n"
+                 "  branch [-d] [<name> [<start>]]\n"
+                 "                          List, create or delete branches\n"
+                 "  update-ref [--no-deref] [-d] <ref> [<new>] [<old>]\n"
+                 "                          Set or delete a ref, only if it is still <old> when given;\n"
+                 "                          HEAD stands for its branch unless --no-deref\n"
+                 "  update-ref --stdin      Apply update/create/delete/verify lines as one transaction\n"
+                 "  pack-refs               Move loose refs into the packed-refs file\n"
+                 "  checkout [-b] <branch|commit>\n"
+                 "                          Switch branches (or detach HEAD at a commit)\n"
+                 "  merge <branch|commit>   Join another line of history into the current branch\n"
+                 "  merge-base [--is-ancestor] <a> <b>\n"
+                 "                          Find the common ancestor of two commits\n"
+                 "  commit-graph write      Add any missing commits to the commit-graph file\n"
+                 "  cat-file (-t | -s | -e | -p) <object>\n"
+                 "                          Show an object's type, size or content (<rev> or <rev>:<path>)\n"
+                 "  cat-file (--batch | --batch-check) [--buffer]\n"
+                 "                          Answer object names read from stdin, one per line\n"
+                 "  hash-object [-w] [-t <type>] [--stdin | --stdin-paths] [<file>...]\n"
+                 "                          Compute object ids (and store the objects with -w)\n"
                  "  set_author <name>       Set the author's name\n"
                  "  set_email <email>       Set the author's email address\n"
                  "  status                  Show the working tree status\n"
+                 "  gc, repack              Pack all objects into a delta-compressed packfile\n"
+                 "  count-objects [-v]      Count loose objects (and packs and reachable objects with -v)\n"
+                 "  prune [-n | --dry-run] [--expire <time>]\n"
+                 "                          Delete loose objects that nothing references, older than\n"
+                 "                          <time> (default 2.weeks.ago)\n"
+                 "  fsck [--no-dangling]    Re-hash every object in parallel and check links between them\n"
+                 "  fsmonitor start|run|stop|status\n"
+                 "                          Watch the working tree so status only checks changed paths\n"
                  "  help                    Show this help message\n\n"
                  "Examples:\n"
                  "  ./mygit init\n"
                  "  ./mygit set_author \"John Doe\"\n"
                  "  ./mygit set_email john@example.com\n"
                  "  ./mygit add main.cpp\n"
+                 "  ./mygit add .\n"
                  "  ./mygit commit \"Initial commit\"\n"
                  "  ./mygit log\n";
     }
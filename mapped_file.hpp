@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Read-only memory mapping of a whole file. The kernel pages data in on demand
+ * and shares it with the page cache, so reading a pack or loose object costs no
+ * copy into a user-space buffer. An empty file maps to an empty view.
+ */
+class MappedFile
+{
+public:
+    MappedFile() = default;
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    MappedFile(MappedFile &&other) noexcept
+        : ptr(other.ptr), length(other.length)
+    {
+        other.ptr = nullptr;
+        other.length = 0;
+    }
+
+    MappedFile &operator=(MappedFile &&other) noexcept
+    {
+        if (this != &other)
+        {
+            close();
+            ptr = other.ptr;
+            length = other.length;
+            other.ptr = nullptr;
+            other.length = 0;
+        }
+        return *this;
+    }
+
+    bool open(const std::string &filePath)
+    {
+        close();
+        int fd = ::open(filePath.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat st;
+        if (::fstat(fd, &st) != 0)
+        {
+            ::close(fd);
+            return false;
+        }
+
+        length = static_cast<size_t>(st.st_size);
+        if (length > 0)
+        {
+            void *p = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED)
+            {
+                ::close(fd);
+                length = 0;
+                return false;
+            }
+            ptr = static_cast<unsigned char *>(p);
+        }
+        ::close(fd); // the mapping stays valid without the descriptor
+        opened = true;
+        return true;
+    }
+
+    void close()
+    {
+        if (ptr)
+            ::munmap(ptr, length);
+        ptr = nullptr;
+        length = 0;
+        opened = false;
+    }
+
+    bool isOpen() const { return opened; }
+    const unsigned char *data() const { return ptr; }
+    size_t size() const { return length; }
+
+    std::string_view view() const
+    {
+        return std::string_view(reinterpret_cast<const char *>(ptr), length);
+    }
+
+private:
+    unsigned char *ptr = nullptr;
+    size_t length = 0;
+    bool opened = false;
+};
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "hash.hpp"
+#include "trace.hpp"
+
+/**
+ * Size-bounded LRU cache of inflated objects, keyed by id.
+ *
+ * Commits and trees are parsed in place (CommitView / TreeView point into the
+ * inflated buffer), so keeping the buffer is keeping the parsed object: a hit
+ * costs a hash lookup instead of an open, an inflate and a parse. Buffers are
+ * shared, so an entry evicted while a caller still walks it stays alive until
+ * that caller lets go.
+ *
+ * `capacity` bounds the total content bytes. An object larger than an eighth of
+ * it is never cached, so one big object cannot flush everything else.
+ *
+ * Hits, misses and evictions are counted here and as the trace counters
+ * "object.cache.hit", "object.cache.miss" and "object.cache.evict".
+ */
+class ObjectCache
+{
+public:
+    using Buffer = std::shared_ptr<const std::string>;
+
+    explicit ObjectCache(size_t capacity = 64u << 20) : capacity(capacity) {}
+
+    ObjectCache(const ObjectCache &) = delete;
+    ObjectCache &operator=(const ObjectCache &) = delete;
+
+    // --- 0 disables the cache (and drops everything in it) ---
+    void setCapacity(size_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        capacity = bytes;
+        evict();
+    }
+
+    // --- The cached buffer and its type, or null ---
+    Buffer find(const ObjectId &id, std::string &type)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = byId.find(id);
+        if (it == byId.end())
+        {
+            misses++;
+            traceCount("object.cache.miss");
+            return nullptr;
+        }
+        lru.splice(lru.begin(), lru, it->second); // most recently used first
+        hits++;
+        traceCount("object.cache.hit");
+        type = it->second->type;
+        return it->second->content;
+    }
+
+    void insert(const ObjectId &id, const std::string &type, Buffer content)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!content || content->size() > capacity / 8 || byId.count(id))
+            return;
+        used += content->size();
+        lru.push_front({id, type, std::move(content)});
+        byId[id] = lru.begin();
+        evict();
+    }
+
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> evictions{0};
+
+private:
+    struct Entry
+    {
+        ObjectId id;
+        std::string type;
+        Buffer content;
+    };
+
+    std::mutex mutex;
+    size_t capacity;
+    size_t used = 0;
+    std::list<Entry> lru;
+    std::unordered_map<ObjectId, std::list<Entry>::iterator> byId;
+
+    void evict()
+    {
+        while (used > capacity && !lru.empty())
+        {
+            used -= lru.back().content->size();
+            byId.erase(lru.back().id);
+            lru.pop_back();
+            evictions++;
+            traceCount("object.cache.evict");
+        }
+    }
+};
@@ -0,0 +1,1034 @@
+#pragma once
+
+#include <atomic>
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_set>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#ifdef MYGIT_HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include "batch_io.hpp"
+#include "chunker.hpp"
+#include "hash.hpp"
+#include "mapped_file.hpp"
+#include "object_cache.hpp"
+#include "pack.hpp"
+#include "trace.hpp"
+
+/**
+ * Loose object store under ".mygit/objects/xx/yyyy...".
+ *
+ * Every object is stored as "<type> <length>\0<content>", compressed, and named
+ * by the SHA-1 of that uncompressed header + content (exactly like git). zlib is
+ * the default so objects stay git-compatible; zstd can be selected with
+ * "compression = zstd" in the [core] section of the config when MyGit was built
+ * with it. Readers detect the format from the stream itself, so both can coexist.
+ *
+ * Objects that have been packed by "mygit gc" live in objects/pack/pack-<hash>.pack; reads
+ * fall back to the packs transparently when no loose file exists.
+ *
+ * Commits and trees that have been read stay in an in-memory LRU cache (see
+ * object_cache.hpp), so walks that come back to them skip the disk.
+ */
+enum class Compression
+{
+    Zlib,
+    Zstd
+};
+
+inline bool zstdAvailable()
+{
+#ifdef MYGIT_HAVE_ZSTD
+    return true;
+#else
+    return false;
+#endif
+}
+
+// --- Streaming decompressor: feed compressed chunks, receive inflated chunks ---
+class Inflater
+{
+public:
+    using Sink = std::function<bool(const char *, size_t)>;
+
+    ~Inflater()
+    {
+        if (zlibStarted)
+            inflateEnd(&zs);
+#ifdef MYGIT_HAVE_ZSTD
+        if (zstdCtx)
+            ZSTD_freeDCtx(zstdCtx);
+#endif
+    }
+
+    // Feed the next compressed chunk; returns false on corrupt input or if the sink gives up
+    bool feed(const char *data, size_t size, const Sink &sink)
+    {
+        if (!started)
+        {
+            started = true;
+            static const unsigned char zstdMagic[4] = {0x28, 0xb5, 0x2f, 0xfd};
+            isZstd = size >= 4 && std::memcmp(data, zstdMagic, 4) == 0;
+            if (isZstd)
+            {
+#ifdef MYGIT_HAVE_ZSTD
+                zstdCtx = ZSTD_createDCtx();
+#else
+                return false; // written by a zstd-enabled build
+#endif
+            }
+            else
+            {
+                std::memset(&zs, 0, sizeof(zs));
+                if (inflateInit(&zs) != Z_OK)
+                    return false;
+                zlibStarted = true;
+            }
+        }
+
+        return isZstd ? feedZstd(data, size, sink) : feedZlib(data, size, sink);
+    }
+
+    bool finished() const { return done; }
+
+private:
+    bool started = false;
+    bool isZstd = false;
+    bool done = false;
+    bool zlibStarted = false;
+    z_stream zs;
+#ifdef MYGIT_HAVE_ZSTD
+    ZSTD_DCtx *zstdCtx = nullptr;
+#endif
+    char out[64 * 1024];
+
+    bool feedZlib(const char *data, size_t size, const Sink &sink)
+    {
+        zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+        zs.avail_in = static_cast<uInt>(size);
+        while (zs.avail_in > 0 && !done)
+        {
+            zs.next_out = reinterpret_cast<Bytef *>(out);
+            zs.avail_out = sizeof(out);
+            int ret = inflate(&zs, Z_NO_FLUSH);
+            if (ret != Z_OK && ret != Z_STREAM_END)
+                return false;
+            size_t produced = sizeof(out) - zs.avail_out;
+            if (produced > 0 && !sink(out, produced))
+                return false;
+            if (ret == Z_STREAM_END)
+                done = true;
+            else if (produced == 0 && zs.avail_in > 0)
+                return false; // no progress: corrupt stream
+        }
+        return true;
+    }
+
+    bool feedZstd(const char *data, size_t size, const Sink &sink)
+    {
+#ifdef MYGIT_HAVE_ZSTD
+        ZSTD_inBuffer in = {data, size, 0};
+        while (in.pos < in.size)
+        {
+            ZSTD_outBuffer o = {out, sizeof(out), 0};
+            size_t ret = ZSTD_decompressStream(zstdCtx, &o, &in);
+            if (ZSTD_isError(ret))
+                return false;
+            if (o.pos > 0 && !sink(out, o.pos))
+                return false;
+            if (ret == 0)
+                done = true;
+        }
+        return true;
+#else
+        (void)data;
+        (void)size;
+        (void)sink;
+        return false;
+#endif
+    }
+};
+
+// --- Streaming compressor: feed plain chunks, receive compressed chunks ---
+class Deflater
+{
+public:
+    using Sink = std::function<bool(const char *, size_t)>;
+
+    explicit Deflater(Compression mode) : mode(mode)
+    {
+#ifdef MYGIT_HAVE_ZSTD
+        if (mode == Compression::Zstd)
+        {
+            zstdCtx = ZSTD_createCCtx();
+            ZSTD_CCtx_setParameter(zstdCtx, ZSTD_c_compressionLevel, 1);
+            ok = zstdCtx != nullptr;
+            return;
+        }
+#endif
+        this->mode = Compression::Zlib;
+        std::memset(&zs, 0, sizeof(zs));
+        // Loose objects favour speed, like git's core.looseCompression default
+        ok = deflateInit(&zs, Z_BEST_SPEED) == Z_OK;
+    }
+
+    ~Deflater()
+    {
+#ifdef MYGIT_HAVE_ZSTD
+        if (zstdCtx)
+            ZSTD_freeCCtx(zstdCtx);
+#endif
+        if (mode == Compression::Zlib && ok)
+            deflateEnd(&zs);
+    }
+
+    Deflater(const Deflater &) = delete;
+    Deflater &operator=(const Deflater &) = delete;
+
+    // Feed the next chunk; `last` flushes and terminates the stream
+    bool feed(const char *data, size_t size, bool last, const Sink &sink)
+    {
+        if (!ok)
+            return false;
+#ifdef MYGIT_HAVE_ZSTD
+        if (mode == Compression::Zstd)
+        {
+            ZSTD_inBuffer in = {data, size, 0};
+            ZSTD_EndDirective op = last ? ZSTD_e_end : ZSTD_e_continue;
+            while (true)
+            {
+                ZSTD_outBuffer o = {out, sizeof(out), 0};
+                size_t ret = ZSTD_compressStream2(zstdCtx, &o, &in, op);
+                if (ZSTD_isError(ret) || (o.pos > 0 && !sink(out, o.pos)))
+                    return ok = false;
+                if (last ? ret == 0 : in.pos == in.size)
+                    return true;
+            }
+        }
+#endif
+        zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+        zs.avail_in = static_cast<uInt>(size);
+        int flush = last ? Z_FINISH : Z_NO_FLUSH;
+        while (true)
+        {
+            zs.next_out = reinterpret_cast<Bytef *>(out);
+            zs.avail_out = sizeof(out);
+            int ret = deflate(&zs, flush);
+            if (ret == Z_STREAM_ERROR)
+                return ok = false;
+            size_t produced = sizeof(out) - zs.avail_out;
+            if (produced > 0 && !sink(out, produced))
+                return ok = false;
+            if (last ? ret == Z_STREAM_END : (zs.avail_in == 0 && zs.avail_out != 0))
+                return true;
+        }
+    }
+
+private:
+    Compression mode;
+    bool ok = false;
+    z_stream zs;
+#ifdef MYGIT_HAVE_ZSTD
+    ZSTD_CCtx *zstdCtx = nullptr;
+#endif
+    char out[64 * 1024];
+};
+
+// --- Compress a header + content pair into a single stream ---
+inline bool compressObject(const std::string &header, std::string_view content, Compression mode, std::string &out)
+{
+    out.clear();
+    auto append = [&](const char *data, size_t size)
+    {
+        out.append(data, size);
+        return true;
+    };
+    Deflater deflater(mode);
+    return deflater.feed(header.data(), header.size(), false, append) &&
+           deflater.feed(content.data(), content.size(), true, append);
+}
+
+// --- Object id of some content without storing it ---
+inline std::string objectHeader(const std::string &type, size_t size)
+{
+    std::string header = type + " " + std::to_string(size);
+    header.push_back('\0');
+    return header;
+}
+
+// --- The "<size>" of an object header: decimal digits only, and it must fit ---
+inline bool parseObjectSize(std::string_view digits, size_t &size)
+{
+    if (digits.empty() || digits.find_first_not_of("0123456789") != std::string_view::npos)
+        return false;
+    auto result = std::from_chars(digits.data(), digits.data() + digits.size(), size);
+    return result.ec == std::errc() && result.ptr == digits.data() + digits.size();
+}
+
+inline ObjectId hashObject(const std::string &type, std::string_view content)
+{
+    HashStream hasher;
+    hasher.update(objectHeader(type, content.size()));
+    hasher.update(content);
+    return hasher.finish();
+}
+
+// Chunk size for streaming file reads: memory use is bounded by this, not file size
+const size_t FILE_CHUNK_SIZE = 128 * 1024;
+
+// --- Read a file in fixed-size chunks, handing each chunk to `sink` ---
+// Fails if the file size changes while it is being read.
+inline bool readFileChunks(const std::string &filePath, uint64_t &size,
+                           const std::function<bool(const char *, size_t)> &onStart,
+                           const std::function<bool(const char *, size_t)> &sink)
+{
+    int fd = ::open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (::fstat(fd, &st) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    size = static_cast<uint64_t>(st.st_size);
+    if (onStart && !onStart(nullptr, size))
+    {
+        ::close(fd);
+        return false;
+    }
+
+    std::unique_ptr<char[]> buf(new char[FILE_CHUNK_SIZE]);
+    uint64_t total = 0;
+    bool ok = true;
+    while (ok)
+    {
+        ssize_t n = ::read(fd, buf.get(), FILE_CHUNK_SIZE);
+        if (n < 0)
+            ok = false;
+        if (n <= 0)
+            break;
+        total += static_cast<uint64_t>(n);
+        ok = total <= size && sink(buf.get(), static_cast<size_t>(n));
+    }
+    ::close(fd);
+    return ok && total == size;
+}
+
+// --- Object id of a file's content, hashed in fixed-size chunks ---
+inline ObjectId hashFile(const std::string &filePath, const std::string &type = "blob")
+{
+    TraceSpan span("hash.file");
+    HashStream hasher;
+    uint64_t size = 0;
+    bool ok = readFileChunks(
+        filePath, size,
+        [&](const char *, size_t total)
+        {
+            hasher.update(objectHeader(type, total));
+            return true;
+        },
+        [&](const char *data, size_t n)
+        {
+            hasher.update(data, n);
+            return true;
+        });
+    return ok ? hasher.finish() : ObjectId();
+}
+
+// --- Inflate a zlib loose object held in memory (header parsed, content sized exactly) ---
+inline bool inflateLoose(const unsigned char *data, size_t size, std::string &type, std::string &content)
+{
+    if (size < 2 || data[0] != 0x78)
+        return false; // not zlib
+
+    z_stream zs;
+    std::memset(&zs, 0, sizeof(zs));
+    if (inflateInit(&zs) != Z_OK)
+        return false;
+    zs.next_in = const_cast<Bytef *>(data);
+    zs.avail_in = static_cast<uInt>(size);
+
+    // Inflate just enough to see "<type> <size>\0"
+    char head[64];
+    zs.next_out = reinterpret_cast<Bytef *>(head);
+    zs.avail_out = sizeof(head);
+    int ret = Z_OK;
+    const char *nul = nullptr;
+    while (!nul && ret == Z_OK && zs.avail_out > 0)
+    {
+        ret = inflate(&zs, Z_SYNC_FLUSH);
+        nul = static_cast<const char *>(std::memchr(head, '\0', sizeof(head) - zs.avail_out));
+    }
+    const char *space = nul ? static_cast<const char *>(std::memchr(head, ' ', nul - head)) : nullptr;
+    if (!space || (ret != Z_OK && ret != Z_STREAM_END))
+    {
+        inflateEnd(&zs);
+        return false;
+    }
+
+    size_t objectSize;
+    if (!parseObjectSize(std::string_view(space + 1, nul - space - 1), objectSize))
+    {
+        inflateEnd(&zs);
+        return false;
+    }
+    type.assign(head, space - head);
+    size_t already = (sizeof(head) - zs.avail_out) - (nul + 1 - head);
+    if (already > objectSize)
+    {
+        inflateEnd(&zs);
+        return false;
+    }
+    content.resize(objectSize);
+    std::memcpy(&content[0], nul + 1, already);
+
+    if (ret != Z_STREAM_END)
+    {
+        // The rest goes directly into its final place
+        char scratch[1];
+        bool full = already == objectSize;
+        zs.next_out = reinterpret_cast<Bytef *>(full ? scratch : &content[already]);
+        zs.avail_out = static_cast<uInt>(full ? sizeof(scratch) : objectSize - already);
+        ret = inflate(&zs, Z_FINISH);
+        if (full && zs.avail_out == 0)
+            ret = Z_DATA_ERROR; // more data than the header promised
+    }
+    size_t total = zs.total_out;
+    inflateEnd(&zs);
+    return ret == Z_STREAM_END && total == objectSize + (nul + 1 - head);
+}
+
+struct ObjectStore
+{
+    std::string dir = ".mygit/objects";
+    Compression compression = Compression::Zlib;
+
+    std::string objectPath(const ObjectId &id) const
+    {
+        std::string hex = id.hex();
+        return dir + "/" + hex.substr(0, 2) + "/" + hex.substr(2);
+    }
+
+    // Counters for the write path (how much work dedup saved)
+    struct WriteStats
+    {
+        std::atomic<size_t> written{0};      // objects actually written
+        std::atomic<size_t> deduplicated{0}; // writes skipped because the object existed
+        std::atomic<uint64_t> bytesWritten{0};
+    };
+    mutable WriteStats stats;
+
+    // --- Does the object exist (loose or packed)? Answers are cached in-process ---
+    bool exists(const ObjectId &hash) const
+    {
+        if (hash.empty())
+            return false;
+        {
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            if (knownPresent.count(hash))
+                return true;
+            if (knownAbsent.count(hash))
+                return false;
+        }
+
+        bool found = std::filesystem::exists(objectPath(hash));
+        for (size_t i = 0; !found && i < packs().size(); i++)
+            found = packs()[i]->contains(hash);
+
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        (found ? knownPresent : knownAbsent).insert(hash);
+        return found;
+    }
+
+    // --- Packs under objects/pack, opened on first use ---
+    const std::vector<std::shared_ptr<Pack>> &packs() const
+    {
+        std::lock_guard<std::mutex> lock(packMutex);
+        if (!packsLoaded)
+        {
+            packsLoaded = true;
+            std::error_code ec;
+            for (auto &entry : std::filesystem::directory_iterator(dir + "/pack", ec))
+            {
+                if (entry.path().extension() != ".pack")
+                    continue;
+                auto pack = std::make_shared<Pack>();
+                if (pack->open(entry.path().string()))
+                    packList.push_back(pack);
+            }
+        }
+        return packList;
+    }
+
+    // Forget opened packs (after gc replaced them)
+    void reloadPacks()
+    {
+        std::lock_guard<std::mutex> lock(packMutex);
+        packsLoaded = false;
+        packList.clear();
+    }
+
+    // --- Hash and store an object, returning its id (empty on failure) ---
+    ObjectId write(const std::string &type, std::string_view content) const
+    {
+        TraceSpan span("object.write");
+        ObjectId hash = hashObject(type, content);
+
+        // Content-addressed: if it is already stored there is nothing to do
+        if (exists(hash))
+        {
+            freshen(hash);
+            stats.deduplicated++;
+            return hash;
+        }
+
+        std::string compressed;
+        if (!compressObject(objectHeader(type, content.size()), content, compression, compressed))
+            return ObjectId();
+        if (!(batching && io ? queueLoose(hash, std::move(compressed)) : writeLoose(hash, compressed)))
+            return ObjectId();
+        return hash;
+    }
+
+    // --- Touch the loose file of an object a write found already stored ---
+    // prune spares recently modified loose objects; without this, an old
+    // unreachable object that is about to be referenced again could be pruned
+    // before anything refers to it. Packed objects are left alone.
+    void freshen(const ObjectId &hash) const
+    {
+        ::utimensat(AT_FDCWD, objectPath(hash).c_str(), nullptr, 0);
+    }
+
+    // ---------- Batched writes ----------
+    // Between beginBatch() and endBatch(), write() compresses as usual but
+    // queues the loose file; the queue is written through `io` (batch_io.hpp)
+    // whenever it holds OBJECT_BATCH_BYTES, and at endBatch(). Queued objects
+    // count as present for deduplication but cannot be read back until then,
+    // so a batch must end before anything refers to its objects on disk.
+    static const size_t OBJECT_BATCH_BYTES = 32 << 20;
+    static const size_t OBJECT_BATCH_COUNT = 4096;
+    BatchIo *io = nullptr; // none: writes are never queued
+
+    void beginBatch() const { batching = true; }
+
+    // --- Write whatever is still queued; false if any object could not be written ---
+    bool endBatch() const
+    {
+        batching = false;
+        bool ok = flushQueue();
+        return !batchFailed.exchange(false) && ok;
+    }
+
+    // --- Store a file as an object without ever holding it in memory ---
+    // One read both hashes and compresses, straight into a temp file; the object
+    // is named by that hash, i.e. by the bytes that were really stored. If it
+    // turns out to exist already, the temp file is simply dropped.
+    ObjectId writeFile(const std::string &type, const std::string &filePath) const
+    {
+        TraceSpan span("object.write");
+        std::string tmp;
+        int fd = createTemp(dir, tmp);
+        if (fd < 0)
+            return ObjectId();
+
+        HashStream hasher;
+        Deflater deflater(compression);
+        uint64_t written = 0;
+        auto toFile = [&](const char *data, size_t n)
+        {
+            written += n;
+            return writeAll(fd, data, n);
+        };
+
+        uint64_t size = 0;
+        bool ok = readFileChunks(
+            filePath, size,
+            [&](const char *, size_t total)
+            {
+                std::string header = objectHeader(type, total);
+                hasher.update(header);
+                return deflater.feed(header.data(), header.size(), false, toFile);
+            },
+            [&](const char *data, size_t n)
+            {
+                hasher.update(data, n);
+                return deflater.feed(data, n, false, toFile);
+            });
+        ok = ok && deflater.feed(nullptr, 0, true, toFile);
+        ::fchmod(fd, 0444);
+        ok = ::close(fd) == 0 && ok;
+
+        ObjectId hash = hasher.finish();
+        if (ok && exists(hash))
+        {
+            ::unlink(tmp.c_str());
+            freshen(hash);
+            stats.deduplicated++;
+            return hash;
+        }
+        if (!ok || !installLoose(hash, tmp, written))
+        {
+            ::unlink(tmp.c_str());
+            return ObjectId();
+        }
+        traceCount("object.write.bytes", written);
+        return hash;
+    }
+
+    // ---------- Chunked files ----------
+    // Files of at least `chunkThreshold` bytes (0: never) are split with FastCDC
+    // (chunker.hpp). Every chunk is stored as an ordinary blob and the file as a
+    // "chunks" object listing them, which is the id trees and the index record:
+    //   per chunk: raw chunk id | u32 chunk length (big-endian)
+    // After an edit only the chunks around it are new; the rest deduplicate.
+    uint64_t chunkThreshold = 0;
+
+    bool isChunked(uint64_t fileSize) const { return chunkThreshold && fileSize >= chunkThreshold; }
+
+    // --- Is `hash` a chunk list (rather than a plain blob)? Only the header is read ---
+    bool isChunkList(const ObjectId &hash) const
+    {
+        std::string type;
+        uint64_t size;
+        return !hash.empty() && info(hash, type, size) && type == "chunks";
+    }
+
+    // --- Store a working tree file: as one blob, or chunked when it is large enough ---
+    ObjectId writeBlobFile(const std::string &filePath, uint64_t fileSize) const
+    {
+        return isChunked(fileSize) ? chunkFile(filePath, true) : writeFile("blob", filePath);
+    }
+
+    // --- Id writeBlobFile() would give the file, without storing anything ---
+    ObjectId hashBlobFile(const std::string &filePath, uint64_t fileSize) const
+    {
+        return isChunked(fileSize) ? chunkFile(filePath, false) : hashFile(filePath);
+    }
+
+    // --- Split a file into chunks, hashing (and with `store`, writing) each one ---
+    // The file is read in fixed-size blocks; at most CDC_MAX_SIZE bytes are kept,
+    // which is all the chunker ever looks at to find the next cut.
+    ObjectId chunkFile(const std::string &filePath, bool store) const
+    {
+        TraceSpan span("object.chunk");
+        std::string list, pending;
+        auto emit = [&](size_t length)
+        {
+            std::string_view chunk(pending.data(), length);
+            ObjectId id = store ? write("blob", chunk) : hashObject("blob", chunk);
+            if (id.empty())
+                return false;
+            list += id.raw();
+            putBE32(list, static_cast<uint32_t>(length));
+            pending.erase(0, length);
+            traceCount("object.chunk");
+            return true;
+        };
+
+        uint64_t size = 0;
+        bool ok = readFileChunks(filePath, size, nullptr,
+                                 [&](const char *data, size_t n)
+                                 {
+                                     pending.append(data, n);
+                                     while (pending.size() >= CDC_MAX_SIZE)
+                                         if (!emit(cdcNextCut(reinterpret_cast<const unsigned char *>(pending.data()), pending.size())))
+                                             return false;
+                                     return true;
+                                 });
+        while (ok && !pending.empty())
+            ok = emit(cdcNextCut(reinterpret_cast<const unsigned char *>(pending.data()), pending.size()));
+        if (!ok)
+            return ObjectId();
+        return store ? write("chunks", list) : hashObject("chunks", list);
+    }
+
+    // --- Call fn(chunk id, length) for every entry of a chunk list ---
+    template <typename Fn>
+    static bool forEachChunk(std::string_view list, Fn fn)
+    {
+        const size_t entrySize = hashAlgo().rawSize + 4;
+        if (list.size() % entrySize != 0)
+            return false;
+        for (size_t pos = 0; pos < list.size(); pos += entrySize)
+        {
+            const unsigned char *length = reinterpret_cast<const unsigned char *>(list.data() + pos + hashAlgo().rawSize);
+            if (!fn(ObjectId::fromRaw(list.substr(pos, hashAlgo().rawSize)), getBE32(length)))
+                return false;
+        }
+        return true;
+    }
+
+    // --- Content of a file: the blob itself, or its chunks put back together ---
+    bool readBlob(const ObjectId &hash, std::string &content) const
+    {
+        std::string type;
+        if (!read(hash, type, content))
+            return false;
+        if (type != "chunks")
+            return type == "blob";
+        std::string list = std::move(content);
+        content.clear();
+        std::string chunk;
+        return forEachChunk(list, [&](const ObjectId &id, uint32_t length)
+                            { return read(id, type, chunk) && type == "blob" && chunk.size() == length &&
+                                     (content += chunk, true); });
+    }
+
+    // --- Like readBlob(), but hands the content to `sink` piece by piece ---
+    bool streamBlob(const ObjectId &hash, const Inflater::Sink &sink) const
+    {
+        std::string type, list;
+        bool ok = stream(
+            hash, [&](const std::string &t, size_t) { type = t; },
+            [&](const char *data, size_t size)
+            {
+                if (type != "chunks")
+                    return sink(data, size);
+                list.append(data, size); // a chunk list is small: collect it first
+                return true;
+            });
+        if (!ok || type != "chunks")
+            return ok && type == "blob";
+        return forEachChunk(list, [&](const ObjectId &id, uint32_t)
+                            { return stream(id, [](const std::string &, size_t) {}, sink); });
+    }
+
+    // --- Store already-compressed object bytes under `hash` via temp file + rename ---
+    // Readers (and concurrent writers of the same object) never see a partial file.
+    bool writeLoose(const ObjectId &hash, const std::string &compressed) const
+    {
+        std::string tmp;
+        int fd = createTemp(dir, tmp);
+        if (fd < 0)
+            return false;
+
+        bool ok = writeAll(fd, compressed.data(), compressed.size());
+        // Objects are immutable and readable by everyone, like git's 0444 loose objects
+        ::fchmod(fd, 0444);
+        ok = ::close(fd) == 0 && ok;
+        if (!ok || !installLoose(hash, tmp, compressed.size()))
+        {
+            ::unlink(tmp.c_str());
+            return false;
+        }
+        traceCount("object.write.bytes", compressed.size());
+        return true;
+    }
+
+    // --- Stream an object's content to `sink` without holding the compressed file in memory ---
+    // `onHeader` is called once with the type and size before any content is delivered.
+    bool stream(const ObjectId &hash,
+                const std::function<void(const std::string &, size_t)> &onHeader,
+                const Inflater::Sink &sink) const
+    {
+        if (hash.empty())
+            return false;
+        std::ifstream file(objectPath(hash), std::ios::binary);
+        if (!file.is_open())
+        {
+            // Not loose: resolve it from a pack (deltas need the whole object anyway)
+            std::string type, content;
+            for (const auto &pack : packs())
+            {
+                if (pack->read(hash, type, content))
+                {
+                    onHeader(type, content.size());
+                    return content.empty() || sink(content.data(), content.size());
+                }
+            }
+            return false;
+        }
+
+        std::string header;
+        bool headerDone = false;
+        size_t expected = 0;
+        size_t received = 0;
+
+        auto headerSink = [&](const char *data, size_t size) -> bool
+        {
+            if (!headerDone)
+            {
+                const char *nul = static_cast<const char *>(std::memchr(data, '\0', size));
+                size_t take = nul ? static_cast<size_t>(nul - data) : size;
+                header.append(data, take);
+                if (!nul)
+                    return header.size() < 64; // a header is never this long
+                headerDone = true;
+
+                size_t space = header.find(' ');
+                if (space == std::string::npos ||
+                    !parseObjectSize(std::string_view(header).substr(space + 1), expected))
+                    return false; // corrupt header
+                onHeader(header.substr(0, space), expected);
+
+                data += take + 1;
+                size -= take + 1;
+            }
+            received += size;
+            return size == 0 || sink(data, size);
+        };
+
+        Inflater inflater;
+        char in[64 * 1024];
+        while (!inflater.finished() && file.read(in, sizeof(in)).gcount() > 0)
+        {
+            if (!inflater.feed(in, static_cast<size_t>(file.gcount()), headerSink))
+                return false;
+        }
+        return inflater.finished() && headerDone && received == expected;
+    }
+
+    // --- Type and size of an object, without inflating its content ---
+    bool info(const ObjectId &hash, std::string &type, uint64_t &size) const
+    {
+        if (hash.empty())
+            return false;
+        bool found = false;
+        if (::access(objectPath(hash).c_str(), F_OK) == 0)
+        {
+            // Stop the stream as soon as the header has been seen
+            stream(
+                hash,
+                [&](const std::string &t, size_t s)
+                {
+                    type = t;
+                    size = s;
+                    found = true;
+                },
+                [](const char *, size_t)
+                { return false; });
+            return found;
+        }
+        for (const auto &pack : packs())
+            if (pack->info(hash, type, size))
+                return true;
+        return false;
+    }
+
+    // Inflated commits and trees, shared by every reader of this store
+    mutable ObjectCache cache;
+
+    // --- Read a whole object into memory ---
+    // Commits and trees come from the cache when they were read before.
+    bool read(const ObjectId &hash, std::string &type, std::string &content) const
+    {
+        if (hash.empty())
+            return false;
+        if (ObjectCache::Buffer cached = cache.find(hash, type))
+        {
+            content = *cached;
+            return true;
+        }
+        if (!readUncached(hash, type, content))
+            return false;
+        if (type != "blob")
+            cache.insert(hash, type, std::make_shared<const std::string>(content));
+        return true;
+    }
+
+    // --- Like read(), but shares the cached buffer instead of copying it ---
+    // For walks that parse a commit or tree in place and may come back to it.
+    ObjectCache::Buffer load(const ObjectId &hash, std::string &type) const
+    {
+        if (hash.empty())
+            return nullptr;
+        if (ObjectCache::Buffer cached = cache.find(hash, type))
+            return cached;
+        std::string content;
+        if (!readUncached(hash, type, content))
+            return nullptr;
+        auto buffer = std::make_shared<const std::string>(std::move(content));
+        if (type != "blob") // blobs are read once per operation and would push out the trees
+            cache.insert(hash, type, buffer);
+        return buffer;
+    }
+
+    // --- Read a whole object from disk, bypassing the cache ---
+    // Loose objects are mapped and inflated straight into `content`: one
+    // allocation of exactly the object size, no intermediate copies.
+    bool readUncached(const ObjectId &hash, std::string &type, std::string &content) const
+    {
+        TraceSpan span("object.read");
+        if (hash.empty())
+            return false;
+        traceCount("object.read");
+
+        MappedFile file;
+        if (file.open(objectPath(hash)))
+        {
+            if (inflateLoose(file.data(), file.size(), type, content))
+            {
+                traceCount("object.read.bytes", content.size());
+                return true;
+            }
+            // Not a zlib stream (zstd): fall through to the streaming reader
+        }
+
+        content.clear();
+        bool ok = stream(
+            hash,
+            [&](const std::string &t, size_t size)
+            {
+                type = t;
+                content.reserve(size);
+            },
+            [&](const char *data, size_t size)
+            {
+                content.append(data, size);
+                return true;
+            });
+        traceCount("object.read.bytes", content.size());
+        return ok;
+    }
+
+private:
+    static int createTemp(const std::string &where, std::string &tmp)
+    {
+        tmp = where + "/tmp_obj_XXXXXX";
+        return ::mkstemp(&tmp[0]);
+    }
+
+    static bool writeAll(int fd, const char *data, size_t left)
+    {
+        while (left > 0)
+        {
+            ssize_t n = ::write(fd, data, left);
+            if (n <= 0)
+                return false;
+            data += n;
+            left -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    void ensureFanout(const std::string &prefix) const
+    {
+        {
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            if (knownDirs.count(prefix))
+                return;
+        }
+        // Another writer may be creating the same fan-out directory
+        std::error_code ec;
+        std::filesystem::create_directories(dir + "/" + prefix, ec);
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        knownDirs.insert(prefix);
+    }
+
+    // Rename a finished temp file to its object path and record it as present
+    bool installLoose(const ObjectId &hash, const std::string &tmp, uint64_t bytes) const
+    {
+        ensureFanout(hash.hex().substr(0, 2));
+        if (std::rename(tmp.c_str(), objectPath(hash).c_str()) != 0)
+            return false;
+
+        stats.written++;
+        stats.bytesWritten += bytes;
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        knownAbsent.erase(hash);
+        knownPresent.insert(hash);
+        return true;
+    }
+
+    // --- Add a compressed object to the batch, writing the batch out once it is full ---
+    bool queueLoose(const ObjectId &hash, std::string compressed) const
+    {
+        bool full;
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            if (!queuedIds.insert(hash).second)
+            {
+                stats.deduplicated++;
+                return true;
+            }
+            queuedBytes += compressed.size();
+            queue.emplace_back(hash, std::move(compressed));
+            full = queuedBytes >= OBJECT_BATCH_BYTES || queue.size() >= OBJECT_BATCH_COUNT;
+        }
+        {
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            knownAbsent.erase(hash);
+            knownPresent.insert(hash);
+        }
+        if (full && !flushQueue())
+            batchFailed = true;
+        return true;
+    }
+
+    // --- Write the queued objects in one batch: temp files, then renames ---
+    bool flushQueue() const
+    {
+        std::vector<std::pair<ObjectId, std::string>> objects;
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            objects.swap(queue);
+            queuedBytes = 0;
+        }
+        if (objects.empty())
+            return true;
+
+        TraceSpan span("object.write.batch");
+        static std::atomic<uint64_t> tmpCounter{0};
+        std::string tmpPrefix = dir + "/tmp_obj_" + std::to_string(::getpid()) + "_";
+        std::vector<BatchIo::FileWrite> files(objects.size());
+        for (size_t i = 0; i < objects.size(); i++)
+        {
+            ensureFanout(objects[i].first.hex().substr(0, 2));
+            files[i].tmpPath = tmpPrefix + std::to_string(tmpCounter++);
+            files[i].path = objectPath(objects[i].first);
+            files[i].data = objects[i].second;
+        }
+        // Objects are immutable and readable by everyone, like git's 0444 loose objects
+        std::vector<char> ok;
+        io->writeFiles(files, 0444, ok);
+
+        bool all = true;
+        std::scoped_lock lock(queueMutex, cacheMutex);
+        for (size_t i = 0; i < objects.size(); i++)
+        {
+            if (ok[i])
+            {
+                stats.written++;
+                stats.bytesWritten += objects[i].second.size();
+                traceCount("object.write.bytes", objects[i].second.size());
+                continue;
+            }
+            std::cerr << "Error: cannot write object " << objects[i].first << "\n";
+            knownPresent.erase(objects[i].first);
+            queuedIds.erase(objects[i].first);
+            all = false;
+        }
+        return all;
+    }
+
+    mutable bool batching = false;
+    mutable std::atomic<bool> batchFailed{false};
+    mutable std::mutex queueMutex;
+    mutable std::vector<std::pair<ObjectId, std::string>> queue;
+    mutable std::unordered_set<ObjectId> queuedIds;
+    mutable size_t queuedBytes = 0;
+
+    mutable std::mutex cacheMutex;
+    mutable std::unordered_set<ObjectId> knownPresent;
+    mutable std::unordered_set<ObjectId> knownAbsent;
+    mutable std::unordered_set<std::string> knownDirs; // fan-out directories that exist
+
+    mutable std::mutex packMutex;
+    mutable bool packsLoaded = false;
+    mutable std::vector<std::shared_ptr<Pack>> packList;
+};
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <cstring>
+#include <string>
+#include <string_view>
+#include "hash.hpp"
+
+/**
+ * Non-owning, parsed views of commit and tree objects.
+ *
+ * The views point straight into the buffer an object was inflated into, so
+ * walking history or listing a tree allocates nothing per line or per entry.
+ * A view is only valid while that buffer is alive and unchanged.
+ */
+
+// ---------- Commit view ----------
+struct CommitView
+{
+    std::string_view tree;
+    std::string_view author;
+    std::string_view message; // everything after the blank line
+
+    // Raw "parent <hash>\n" lines, in order
+    std::string_view parentLines;
+
+    std::string_view firstParent() const
+    {
+        if (parentLines.size() < 7)
+            return {};
+        size_t eol = parentLines.find('\n');
+        return parentLines.substr(7, (eol == std::string_view::npos ? parentLines.size() : eol) - 7);
+    }
+
+    template <typename Fn>
+    void forEachParent(Fn fn) const
+    {
+        std::string_view rest = parentLines;
+        while (rest.size() > 7)
+        {
+            size_t eol = rest.find('\n');
+            size_t end = eol == std::string_view::npos ? rest.size() : eol;
+            fn(rest.substr(7, end - 7));
+            if (eol == std::string_view::npos)
+                break;
+            rest.remove_prefix(eol + 1);
+        }
+    }
+};
+
+// --- Parse commit content: header lines, a blank line, then the message ---
+inline bool parseCommit(std::string_view content, CommitView &commit)
+{
+    commit = CommitView();
+    size_t pos = 0;
+    size_t parentStart = std::string_view::npos, parentEnd = 0;
+    while (pos < content.size())
+    {
+        size_t eol = content.find('\n', pos);
+        if (eol == std::string_view::npos)
+            eol = content.size();
+        std::string_view line = content.substr(pos, eol - pos);
+
+        if (line.empty())
+        {
+            commit.message = eol < content.size() ? content.substr(eol + 1) : std::string_view();
+            break;
+        }
+        if (line.compare(0, 5, "tree ") == 0)
+            commit.tree = line.substr(5);
+        else if (line.compare(0, 7, "parent ") == 0)
+        {
+            if (parentStart == std::string_view::npos)
+                parentStart = pos;
+            parentEnd = eol;
+        }
+        else if (line.compare(0, 7, "author ") == 0)
+            commit.author = line.substr(7);
+        pos = eol + 1;
+    }
+    if (parentStart != std::string_view::npos)
+        commit.parentLines = content.substr(parentStart, parentEnd - parentStart);
+    return !commit.tree.empty();
+}
+
+// ---------- Tree view ----------
+struct TreeEntryView
+{
+    std::string_view mode;
+    std::string_view name;
+    std::string_view rawHash; // hashAlgo().rawSize raw bytes
+
+    ObjectId hash() const { return ObjectId::fromRaw(rawHash); }
+};
+
+// Iterates "<mode> <name>\0<raw id>" entries in place
+class TreeView
+{
+public:
+    explicit TreeView(std::string_view content) : content(content) {}
+
+    class iterator
+    {
+    public:
+        iterator(std::string_view content, size_t pos) : content(content), pos(pos) { parse(); }
+
+        const TreeEntryView &operator*() const { return entry; }
+        const TreeEntryView *operator->() const { return &entry; }
+
+        iterator &operator++()
+        {
+            pos = next;
+            parse();
+            return *this;
+        }
+
+        bool operator!=(const iterator &other) const { return pos != other.pos; }
+        bool operator==(const iterator &other) const { return pos == other.pos; }
+
+    private:
+        std::string_view content;
+        size_t pos;
+        size_t next = 0;
+        TreeEntryView entry;
+
+        void parse()
+        {
+            if (pos >= content.size())
+            {
+                pos = content.size();
+                return;
+            }
+            const size_t idSize = hashAlgo().rawSize;
+            size_t space = content.find(' ', pos);
+            size_t nul = space == std::string_view::npos ? space : content.find('\0', space);
+            if (nul == std::string_view::npos || nul + 1 + idSize > content.size())
+            {
+                pos = content.size(); // truncated entry: stop
+                return;
+            }
+            entry.mode = content.substr(pos, space - pos);
+            entry.name = content.substr(space + 1, nul - space - 1);
+            entry.rawHash = content.substr(nul + 1, idSize);
+            next = nul + 1 + idSize;
+        }
+    };
+
+    iterator begin() const { return iterator(content, 0); }
+    iterator end() const { return iterator(content, content.size()); }
+
+private:
+    std::string_view content;
+};
@@ -0,0 +1,993 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "hash.hpp"
+#include "mapped_file.hpp"
+
+/**
+ * Packfiles: many objects in one file, with an index for lookup by hash.
+ *
+ * The layout follows git's pack v2 / idx v2 formats:
+ *
+ *   .pack  "PACK" | u32 version (2) | u32 object count
+ *          per object: type+size varint header, [delta base], zlib data
+ *          checksum of everything above
+ *
+ *   .idx   "\377tOc" | u32 version (2) | u32 fanout[256]
+ *          sorted raw object ids | u32 crc32 per object
+ *          u32 offset per object (MSB set = index into the 64-bit table)
+ *          u64 large offsets | pack checksum | idx checksum
+ *
+ * Ids and checksums are 20 bytes (SHA-1) or 32 bytes (SHA-256), following the
+ * repository's object format.
+ *
+ * The fan-out table gives, for every first byte, how many ids sort at or below
+ * it, so a lookup is a binary search over a tiny slice of the id table.
+ *
+ * Similar blobs are stored as OFS_DELTA entries: a list of copy/insert
+ * instructions against an earlier object in the same pack.
+ */
+
+enum PackObjectType
+{
+    PACK_COMMIT = 1,
+    PACK_TREE = 2,
+    PACK_BLOB = 3,
+    PACK_TAG = 4,
+    PACK_CHUNKS = 5, // MyGit's chunk lists; git leaves 5 unused
+    PACK_OFS_DELTA = 6,
+    PACK_REF_DELTA = 7
+};
+
+inline int packTypeFromName(const std::string &type)
+{
+    if (type == "commit")
+        return PACK_COMMIT;
+    if (type == "tree")
+        return PACK_TREE;
+    if (type == "blob")
+        return PACK_BLOB;
+    if (type == "tag")
+        return PACK_TAG;
+    if (type == "chunks")
+        return PACK_CHUNKS;
+    return 0;
+}
+
+inline std::string packTypeName(int type)
+{
+    switch (type)
+    {
+    case PACK_COMMIT:
+        return "commit";
+    case PACK_TREE:
+        return "tree";
+    case PACK_BLOB:
+        return "blob";
+    case PACK_TAG:
+        return "tag";
+    case PACK_CHUNKS:
+        return "chunks";
+    default:
+        return "";
+    }
+}
+
+// --- Big-endian helpers shared by the pack and idx writers/readers ---
+inline void putBE32(std::string &buf, uint32_t v)
+{
+    for (int shift = 24; shift >= 0; shift -= 8)
+        buf.push_back(static_cast<char>((v >> shift) & 0xff));
+}
+
+inline uint32_t getBE32(const unsigned char *p)
+{
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+// --- zlib helpers for whole buffers ---
+inline bool zlibCompress(const std::string &data, std::string &out, int level = Z_DEFAULT_COMPRESSION)
+{
+    uLongf size = compressBound(data.size());
+    out.resize(size);
+    if (compress2(reinterpret_cast<Bytef *>(&out[0]), &size,
+                  reinterpret_cast<const Bytef *>(data.data()), data.size(), level) != Z_OK)
+        return false;
+    out.resize(size);
+    return true;
+}
+
+inline bool zlibInflate(const unsigned char *data, size_t size, size_t expected, std::string &out)
+{
+    out.resize(expected);
+    z_stream zs;
+    std::memset(&zs, 0, sizeof(zs));
+    if (inflateInit(&zs) != Z_OK)
+        return false;
+    zs.next_in = const_cast<Bytef *>(data);
+    zs.avail_in = static_cast<uInt>(size);
+    // zlib wants somewhere to write even when nothing is expected (empty blob)
+    char none;
+    zs.next_out = reinterpret_cast<Bytef *>(out.empty() ? &none : &out[0]);
+    zs.avail_out = static_cast<uInt>(out.size());
+    int ret = inflate(&zs, Z_FINISH);
+    inflateEnd(&zs);
+    return ret == Z_STREAM_END && zs.total_out == expected;
+}
+
+// Inflate no more than the first `limit` bytes (fewer if the stream is shorter)
+inline bool zlibInflatePrefix(const unsigned char *data, size_t size, size_t limit, std::string &out)
+{
+    out.resize(limit);
+    z_stream zs;
+    std::memset(&zs, 0, sizeof(zs));
+    if (inflateInit(&zs) != Z_OK)
+        return false;
+    zs.next_in = const_cast<Bytef *>(data);
+    zs.avail_in = static_cast<uInt>(size);
+    zs.next_out = reinterpret_cast<Bytef *>(&out[0]);
+    zs.avail_out = static_cast<uInt>(limit);
+    int ret = inflate(&zs, Z_SYNC_FLUSH);
+    inflateEnd(&zs);
+    out.resize(zs.total_out);
+    return ret == Z_OK || ret == Z_STREAM_END || (ret == Z_BUF_ERROR && zs.avail_out == 0);
+}
+
+// ---------- Delta encoding (git's copy/insert instruction format) ----------
+
+inline void putDeltaSize(std::string &out, uint64_t size)
+{
+    do
+    {
+        unsigned char c = size & 0x7f;
+        size >>= 7;
+        if (size)
+            c |= 0x80;
+        out.push_back(static_cast<char>(c));
+    } while (size);
+}
+
+inline bool getDeltaSize(const std::string &delta, size_t &pos, uint64_t &size)
+{
+    size = 0;
+    int shift = 0;
+    while (pos < delta.size())
+    {
+        unsigned char c = static_cast<unsigned char>(delta[pos++]);
+        size |= uint64_t(c & 0x7f) << shift;
+        shift += 7;
+        if (!(c & 0x80))
+            return true;
+    }
+    return false;
+}
+
+// Copy `size` bytes starting at `offset` of the base
+inline void putDeltaCopy(std::string &out, uint64_t offset, uint64_t size)
+{
+    // A single copy instruction covers at most 0xffffff bytes
+    while (size > 0)
+    {
+        uint32_t chunk = static_cast<uint32_t>(std::min<uint64_t>(size, 0xffffff));
+        unsigned char op = 0x80;
+        std::string args;
+        for (int i = 0; i < 4; i++)
+        {
+            unsigned char b = (offset >> (8 * i)) & 0xff;
+            if (b)
+            {
+                op |= 1 << i;
+                args.push_back(static_cast<char>(b));
+            }
+        }
+        for (int i = 0; i < 3; i++)
+        {
+            unsigned char b = (chunk >> (8 * i)) & 0xff;
+            if (b)
+            {
+                op |= 0x10 << i;
+                args.push_back(static_cast<char>(b));
+            }
+        }
+        out.push_back(static_cast<char>(op));
+        out += args;
+        offset += chunk;
+        size -= chunk;
+    }
+}
+
+// Literal bytes, at most 127 per instruction
+inline void putDeltaInsert(std::string &out, const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        size_t chunk = std::min<size_t>(size, 127);
+        out.push_back(static_cast<char>(chunk));
+        out.append(data, chunk);
+        data += chunk;
+        size -= chunk;
+    }
+}
+
+/**
+ * Build a delta that turns `base` into `target`. Every aligned 16-byte block of
+ * the base is indexed by hash; the target is scanned with a rolling hash and
+ * each block hit is extended as far as the bytes keep matching. Returns false if
+ * the delta would not be smaller than `maxSize` (storing the object whole is
+ * then cheaper).
+ */
+inline bool createDelta(const std::string &base, const std::string &target, size_t maxSize, std::string &delta)
+{
+    const size_t BLOCK = 16;
+    delta.clear();
+    putDeltaSize(delta, base.size());
+    putDeltaSize(delta, target.size());
+    if (base.size() < BLOCK || target.size() < BLOCK)
+        return false;
+
+    const uint32_t MULT = 0x01000193;
+    uint32_t outFactor = 1; // MULT^(BLOCK-1)
+    for (size_t i = 1; i < BLOCK; i++)
+        outFactor *= MULT;
+
+    auto blockHash = [&](const char *p)
+    {
+        uint32_t h = 0;
+        for (size_t i = 0; i < BLOCK; i++)
+            h = h * MULT + static_cast<unsigned char>(p[i]);
+        return h;
+    };
+
+    // Base block index: hash -> first offset with that hash
+    std::unordered_map<uint32_t, uint32_t> blocks;
+    blocks.reserve(base.size() / BLOCK);
+    for (size_t off = 0; off + BLOCK <= base.size(); off += BLOCK)
+        blocks.emplace(blockHash(&base[off]), static_cast<uint32_t>(off));
+
+    size_t pos = 0;        // current scan position in target
+    size_t literal = 0;    // start of pending literal bytes
+    uint32_t h = blockHash(&target[0]);
+    while (pos + BLOCK <= target.size())
+    {
+        auto it = blocks.find(h);
+        if (it != blocks.end() && std::memcmp(&base[it->second], &target[pos], BLOCK) == 0)
+        {
+            size_t baseOff = it->second;
+            size_t tgtOff = pos;
+
+            // Extend backwards into the pending literal run
+            while (tgtOff > literal && baseOff > 0 && base[baseOff - 1] == target[tgtOff - 1])
+            {
+                baseOff--;
+                tgtOff--;
+            }
+            // Extend forwards
+            size_t len = pos - tgtOff + BLOCK;
+            while (baseOff + len < base.size() && tgtOff + len < target.size() && base[baseOff + len] == target[tgtOff + len])
+                len++;
+
+            putDeltaInsert(delta, target.data() + literal, tgtOff - literal);
+            putDeltaCopy(delta, baseOff, len);
+            if (delta.size() >= maxSize)
+                return false;
+
+            pos = tgtOff + len;
+            literal = pos;
+            if (pos + BLOCK <= target.size())
+                h = blockHash(&target[pos]);
+            continue;
+        }
+
+        // Roll the hash one byte forward
+        if (pos + BLOCK < target.size())
+            h = (h - static_cast<unsigned char>(target[pos]) * outFactor) * MULT + static_cast<unsigned char>(target[pos + BLOCK]);
+        pos++;
+        if (delta.size() + (pos - literal) >= maxSize)
+            return false;
+    }
+
+    putDeltaInsert(delta, target.data() + literal, target.size() - literal);
+    return delta.size() < maxSize;
+}
+
+// --- Rebuild an object from its base and a delta ---
+inline bool applyDelta(const std::string &base, const std::string &delta, std::string &out)
+{
+    size_t pos = 0;
+    uint64_t baseSize, targetSize;
+    if (!getDeltaSize(delta, pos, baseSize) || !getDeltaSize(delta, pos, targetSize) || baseSize != base.size())
+        return false;
+
+    out.clear();
+    out.reserve(targetSize);
+    while (pos < delta.size())
+    {
+        unsigned char op = static_cast<unsigned char>(delta[pos++]);
+        if (op & 0x80)
+        {
+            uint64_t offset = 0, size = 0;
+            for (int i = 0; i < 4; i++)
+                if (op & (1 << i))
+                {
+                    if (pos >= delta.size())
+                        return false;
+                    offset |= uint64_t(static_cast<unsigned char>(delta[pos++])) << (8 * i);
+                }
+            for (int i = 0; i < 3; i++)
+                if (op & (0x10 << i))
+                {
+                    if (pos >= delta.size())
+                        return false;
+                    size |= uint64_t(static_cast<unsigned char>(delta[pos++])) << (8 * i);
+                }
+            if (size == 0)
+                size = 0x10000;
+            if (offset + size > base.size())
+                return false;
+            out.append(base, offset, size);
+        }
+        else if (op != 0)
+        {
+            if (pos + op > delta.size())
+                return false;
+            out.append(delta, pos, op);
+            pos += op;
+        }
+        else
+            return false; // reserved
+    }
+    return out.size() == targetSize;
+}
+
+// ---------- Resolved delta bases ----------
+// Objects a walk over one pack has already resolved, by offset, so each base of
+// a delta chain is inflated once rather than once per delta built on it. Meant
+// for one thread reading entries in offset order (bases come before deltas);
+// when full it simply starts over.
+class PackBaseCache
+{
+public:
+    explicit PackBaseCache(size_t capacity = 64 << 20) : capacity(capacity) {}
+
+    bool find(uint64_t offset, int &type, std::string &content) const
+    {
+        auto it = entries.find(offset);
+        if (it == entries.end())
+            return false;
+        type = it->second.first;
+        content = *it->second.second;
+        return true;
+    }
+
+    void insert(uint64_t offset, int type, const std::string &content)
+    {
+        if (content.size() > capacity / 4)
+            return;
+        if (bytes + content.size() > capacity)
+        {
+            entries.clear();
+            bytes = 0;
+        }
+        if (entries.emplace(offset, std::make_pair(type, std::make_shared<const std::string>(content))).second)
+            bytes += content.size();
+    }
+
+private:
+    size_t capacity;
+    size_t bytes = 0;
+    std::unordered_map<uint64_t, std::pair<int, std::shared_ptr<const std::string>>> entries;
+};
+
+// ---------- Pack reader ----------
+
+class Pack
+{
+public:
+    std::string packPath;
+
+    // --- Map the .pack and the .idx that belongs to it ---
+    bool open(const std::string &pack)
+    {
+        packPath = pack;
+        idSize = hashAlgo().rawSize;
+        std::string idxPath = pack.substr(0, pack.size() - 5) + ".idx";
+        if (!idx.open(idxPath) || !packFile.open(pack))
+            return false;
+
+        const unsigned char *p = idx.data();
+        if (idx.size() < 8 + 256 * 4 + 2 * idSize || std::memcmp(p, "\377tOc", 4) != 0 || getBE32(p + 4) != 2)
+            return false;
+        count = getBE32(p + 8 + 255 * 4);
+        if (idx.size() < 8 + 256 * 4 + count * (idSize + 8ull) + 2 * idSize)
+            return false;
+        if (packFile.size() < 12 + idSize || std::memcmp(packFile.data(), "PACK", 4) != 0)
+            return false;
+
+        // Entry i ends where the next-higher offset begins (or at the trailing checksum)
+        sortedOffsets.reserve(count);
+        for (uint32_t i = 0; i < count; i++)
+            sortedOffsets.push_back(offsetAt(i));
+        std::sort(sortedOffsets.begin(), sortedOffsets.end());
+        return true;
+    }
+
+    uint32_t size() const { return count; }
+
+    // Id of the i-th object (ids are sorted)
+    ObjectId hashAt(uint32_t i) const
+    {
+        return ObjectId::fromRaw(idx.data() + idIndexStart() + i * idSize, idSize);
+    }
+
+    // Offset of the i-th object in the .pack
+    uint64_t offsetOf(uint32_t i) const { return offsetAt(i); }
+
+    bool contains(const ObjectId &id) const
+    {
+        uint64_t offset;
+        return findOffset(id, offset);
+    }
+
+    // --- Fan-out + binary search lookup ---
+    bool findOffset(const ObjectId &id, uint64_t &offset) const
+    {
+        if (id.size() != idSize)
+            return false;
+        return findRawOffset(reinterpret_cast<const char *>(id.data()), offset);
+    }
+
+    bool findRawOffset(const char *raw, uint64_t &offset) const
+    {
+        uint32_t pos;
+        if (!findRawPosition(raw, pos))
+            return false;
+        offset = offsetAt(pos);
+        return true;
+    }
+
+    // --- Position of an object in the sorted id table (what hashAt() takes) ---
+    bool findPosition(const ObjectId &id, uint32_t &pos) const
+    {
+        return id.size() == idSize && findRawPosition(reinterpret_cast<const char *>(id.data()), pos);
+    }
+
+    bool findRawPosition(const char *raw, uint32_t &pos) const
+    {
+        const unsigned char *p = idx.data();
+        unsigned char first = static_cast<unsigned char>(raw[0]);
+        uint32_t lo = first == 0 ? 0 : getBE32(p + 8 + (first - 1) * 4);
+        uint32_t hi = getBE32(p + 8 + first * 4);
+        while (lo < hi)
+        {
+            uint32_t mid = lo + (hi - lo) / 2;
+            int cmp = std::memcmp(p + idIndexStart() + mid * idSize, raw, idSize);
+            if (cmp == 0)
+            {
+                pos = mid;
+                return true;
+            }
+            if (cmp < 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return false;
+    }
+
+    // --- Trailing checksum of the .pack (also its name) ---
+    ObjectId checksum() const
+    {
+        return ObjectId::fromRaw(packFile.data() + packFile.size() - idSize, idSize);
+    }
+
+    // --- Both trailers: the .pack's checksum, and the .idx's (which repeats the pack's) ---
+    bool verifyChecksums() const
+    {
+        size_t packBody = packFile.size() - idSize, idxBody = idx.size() - idSize;
+        return hashBytes(packFile.data(), packBody) == checksum() &&
+               ObjectId::fromRaw(idx.data() + idxBody - idSize, idSize) == checksum() &&
+               hashBytes(idx.data(), idxBody) == ObjectId::fromRaw(idx.data() + idxBody, idSize);
+    }
+
+    // --- Does the i-th object's stored entry still match the crc32 the .idx recorded? ---
+    bool verifyCrc(uint32_t i) const
+    {
+        const unsigned char *p;
+        size_t n;
+        if (!entryBytes(offsetAt(i), p, n))
+            return false;
+        return static_cast<uint32_t>(crc32(0, p, static_cast<uInt>(n))) == getBE32(idx.data() + crcStart() + i * 4ull);
+    }
+
+    bool read(const ObjectId &id, std::string &type, std::string &content) const
+    {
+        uint64_t offset;
+        if (!findOffset(id, offset))
+            return false;
+        int t;
+        if (!readAt(offset, t, content, 0))
+            return false;
+        type = packTypeName(t);
+        return true;
+    }
+
+    // --- Type and size without resolving the object ---
+    // A delta's size is the target size at the start of its (first few inflated)
+    // bytes; its type is the type at the end of the base chain.
+    bool info(const ObjectId &id, std::string &type, uint64_t &size) const
+    {
+        uint64_t offset;
+        if (!findOffset(id, offset))
+            return false;
+        bool haveSize = false;
+        for (int depth = 0; depth <= 64; depth++)
+        {
+            const unsigned char *p;
+            size_t n;
+            if (!entryBytes(offset, p, n))
+                return false;
+
+            size_t pos = 0;
+            unsigned char c = p[pos++];
+            int t = (c >> 4) & 7;
+            uint64_t entrySize = c & 15;
+            int shift = 4;
+            while (c & 0x80)
+            {
+                if (pos >= n)
+                    return false;
+                c = p[pos++];
+                entrySize |= uint64_t(c & 0x7f) << shift;
+                shift += 7;
+            }
+
+            if (t != PACK_OFS_DELTA && t != PACK_REF_DELTA)
+            {
+                type = packTypeName(t);
+                if (!haveSize)
+                    size = entrySize;
+                return true;
+            }
+
+            uint64_t baseOffset;
+            size_t dataStart;
+            if (t == PACK_OFS_DELTA)
+            {
+                if (pos >= n)
+                    return false;
+                c = p[pos++];
+                uint64_t rel = c & 0x7f;
+                while (c & 0x80)
+                {
+                    if (pos >= n)
+                        return false;
+                    c = p[pos++];
+                    rel = ((rel + 1) << 7) | (c & 0x7f);
+                }
+                if (rel > offset)
+                    return false;
+                baseOffset = offset - rel;
+                dataStart = pos;
+            }
+            else
+            {
+                if (pos + idSize > n || !findRawOffset(reinterpret_cast<const char *>(p + pos), baseOffset))
+                    return false;
+                dataStart = pos + idSize;
+            }
+
+            if (!haveSize)
+            {
+                // Two varints (base size, target size): at most 20 bytes
+                std::string head;
+                if (!zlibInflatePrefix(p + dataStart, n - dataStart, 20, head))
+                    return false;
+                size_t hp = 0;
+                uint64_t baseSize;
+                if (!getDeltaSize(head, hp, baseSize) || !getDeltaSize(head, hp, size))
+                    return false;
+                haveSize = true;
+            }
+            offset = baseOffset;
+        }
+        return false; // delta chain too long / cyclic
+    }
+
+    // --- Read and fully resolve the object stored at `offset` ---
+    // Compressed bytes are inflated straight out of the mapping into `content`.
+    // With `bases`, objects (and the bases along their chain) are looked up in
+    // and added to that cache.
+    bool readAt(uint64_t offset, int &type, std::string &content, int depth, PackBaseCache *bases = nullptr) const
+    {
+        if (bases && bases->find(offset, type, content))
+            return true;
+        if (!resolveAt(offset, type, content, depth, bases))
+            return false;
+        if (bases)
+            bases->insert(offset, type, content);
+        return true;
+    }
+
+private:
+    MappedFile idx;
+    MappedFile packFile;
+    uint32_t count = 0;
+    size_t idSize = 20; // raw id and checksum length
+    std::vector<uint64_t> sortedOffsets;
+
+    // --- readAt() without the cache: parse the entry, resolving a delta against its base ---
+    bool resolveAt(uint64_t offset, int &type, std::string &content, int depth, PackBaseCache *bases) const
+    {
+        if (depth > 64)
+            return false; // delta chain too long / cyclic
+
+        const unsigned char *p;
+        size_t n;
+        if (!entryBytes(offset, p, n))
+            return false;
+
+        // type + size header
+        size_t pos = 0;
+        unsigned char c = p[pos++];
+        type = (c >> 4) & 7;
+        uint64_t size = c & 15;
+        int shift = 4;
+        while (c & 0x80)
+        {
+            if (pos >= n)
+                return false;
+            c = p[pos++];
+            size |= uint64_t(c & 0x7f) << shift;
+            shift += 7;
+        }
+
+        if (type == PACK_OFS_DELTA || type == PACK_REF_DELTA)
+        {
+            std::string base;
+            int baseType;
+            if (type == PACK_OFS_DELTA)
+            {
+                if (pos >= n)
+                    return false;
+                c = p[pos++];
+                uint64_t rel = c & 0x7f;
+                while (c & 0x80)
+                {
+                    if (pos >= n)
+                        return false;
+                    c = p[pos++];
+                    rel = ((rel + 1) << 7) | (c & 0x7f);
+                }
+                if (rel > offset || !readAt(offset - rel, baseType, base, depth + 1, bases))
+                    return false;
+            }
+            else
+            {
+                uint64_t baseOffset;
+                if (pos + idSize > n || !findRawOffset(reinterpret_cast<const char *>(p + pos), baseOffset) ||
+                    !readAt(baseOffset, baseType, base, depth + 1, bases))
+                    return false;
+                pos += idSize;
+            }
+
+            std::string delta;
+            if (!zlibInflate(p + pos, n - pos, size, delta) || !applyDelta(base, delta, content))
+                return false;
+            type = baseType;
+            return true;
+        }
+
+        return zlibInflate(p + pos, n - pos, size, content);
+    }
+
+    size_t idIndexStart() const { return 8 + 256 * 4; }
+    size_t crcStart() const { return idIndexStart() + count * idSize; }
+    size_t offsetStart() const { return crcStart() + count * 4ull; }
+    size_t largeOffsetStart() const { return offsetStart() + count * 4ull; }
+
+    uint64_t offsetAt(uint32_t i) const
+    {
+        const unsigned char *p = idx.data();
+        uint32_t off = getBE32(p + offsetStart() + i * 4ull);
+        if (!(off & 0x80000000u))
+            return off;
+        const unsigned char *large = p + largeOffsetStart() + (off & 0x7fffffffu) * 8ull;
+        return (uint64_t(getBE32(large)) << 32) | getBE32(large + 4);
+    }
+
+    // Bytes of one entry (header + compressed data), pointing into the mapping
+    bool entryBytes(uint64_t offset, const unsigned char *&p, size_t &n) const
+    {
+        auto next = std::upper_bound(sortedOffsets.begin(), sortedOffsets.end(), offset);
+        uint64_t end = next == sortedOffsets.end() ? packFile.size() - idSize : *next;
+        if (end <= offset || end > packFile.size())
+            return false;
+        p = packFile.data() + offset;
+        n = static_cast<size_t>(end - offset);
+        return true;
+    }
+};
+
+// ---------- Pack writer ----------
+
+// What writePack needs up front; content is loaded (by PackLoader) only when
+// the object's turn comes, so the whole repository is never in memory at once
+struct PackInput
+{
+    ObjectId hash;
+    std::string type;
+    uint64_t size = 0;    // uncompressed content size
+    std::string nameHint; // file name the blob was seen under (groups similar blobs)
+};
+
+using PackLoader = std::function<bool(const PackInput &, std::string &content)>;
+
+struct PackStats
+{
+    size_t objects = 0;
+    size_t deltas = 0;
+    uint64_t bytesIn = 0;  // uncompressed content
+    uint64_t bytesOut = 0; // pack file size
+};
+
+// git's name hash: sorts by the last characters of the name so that files with
+// the same extension (and same basename) land next to each other
+inline uint32_t packNameHash(const std::string &name)
+{
+    uint32_t hash = 0;
+    for (unsigned char c : name)
+    {
+        if (std::isspace(c))
+            continue;
+        hash = (hash >> 2) + (uint32_t(c) << 24);
+    }
+    return hash;
+}
+
+// --- Write all of `data` to `fd`, retrying short writes ---
+inline bool packWriteAll(int fd, const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t n = ::write(fd, data, size);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// --- Flush `fd` to disk and close it; false if either fails (e.g. ENOSPC) ---
+inline bool packSyncClose(int fd)
+{
+    bool ok = ::fsync(fd) == 0;
+    return ::close(fd) == 0 && ok;
+}
+
+/**
+ * Write `objects` into "<dir>/pack-<checksum>.pack" + ".idx".
+ *
+ * Blobs are ordered by name hash and size (largest first, like git), and each
+ * one tries the previous `window` blobs as delta bases, keeping the smallest
+ * delta that beats storing it whole. Delta chains are capped at `maxDepth`.
+ *
+ * Only the current object and the blobs of the delta window are held in
+ * memory: entries are streamed into a temporary file and hashed on the way,
+ * and the file is renamed once the checksum (its name) is known.
+ */
+inline bool writePack(const std::string &dir, std::vector<PackInput> &objects, const PackLoader &load,
+                      std::string &packName, PackStats &stats, size_t window = 10, int maxDepth = 50)
+{
+    // Non-blobs first (commits, trees), then blobs grouped for delta search
+    std::stable_sort(objects.begin(), objects.end(), [](const PackInput &a, const PackInput &b)
+                     {
+        bool ab = a.type == "blob", bb = b.type == "blob";
+        if (ab != bb)
+            return !ab;
+        if (!ab)
+            return packTypeFromName(a.type) < packTypeFromName(b.type);
+        uint32_t ha = packNameHash(a.nameHint), hb = packNameHash(b.nameHint);
+        if (ha != hb)
+            return ha < hb;
+        return a.size > b.size; });
+
+    std::string base = dir + "/tmp_pack_" + std::to_string(::getpid());
+    int fd = ::open((base + ".pack").c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return false;
+    auto fail = [&]()
+    {
+        if (fd >= 0)
+            ::close(fd);
+        ::unlink((base + ".pack").c_str());
+        return false;
+    };
+
+    HashStream hasher;
+    uint64_t written = 0;
+    auto emit = [&](const std::string &bytes)
+    {
+        hasher.update(bytes);
+        written += bytes.size();
+        return packWriteAll(fd, bytes.data(), bytes.size());
+    };
+
+    std::string header = "PACK";
+    putBE32(header, 2);
+    putBE32(header, static_cast<uint32_t>(objects.size()));
+    if (!emit(header))
+        return fail();
+
+    std::vector<uint64_t> offsets(objects.size());
+    std::vector<uint32_t> crcs(objects.size());
+    std::vector<int> depth(objects.size(), 0);
+    std::deque<std::pair<size_t, std::string>> recent; // blobs of the delta window, oldest first
+    std::string content, entry, compressed;
+
+    for (size_t i = 0; i < objects.size(); i++)
+    {
+        const PackInput &obj = objects[i];
+        if (!load(obj, content))
+            return fail();
+        stats.bytesIn += content.size();
+
+        // --- Delta search over the window of previous blobs, nearest first ---
+        while (!recent.empty() && recent.front().first + window < i)
+            recent.pop_front();
+        std::string bestDelta;
+        size_t bestBase = 0;
+        if (obj.type == "blob")
+        {
+            size_t maxSize = content.size() / 2; // only worth it if at least half is saved
+            for (auto it = recent.rbegin(); it != recent.rend(); ++it)
+            {
+                size_t b = it->first;
+                if (depth[b] >= maxDepth)
+                    continue;
+                std::string delta;
+                size_t limit = bestDelta.empty() ? maxSize : bestDelta.size();
+                if (createDelta(it->second, content, limit, delta))
+                {
+                    bestDelta.swap(delta);
+                    bestBase = b;
+                }
+            }
+        }
+
+        offsets[i] = written;
+        entry.clear();
+        const std::string &payload = bestDelta.empty() ? content : bestDelta;
+        int type = bestDelta.empty() ? packTypeFromName(obj.type) : PACK_OFS_DELTA;
+
+        // type + size varint
+        uint64_t size = payload.size();
+        unsigned char c = static_cast<unsigned char>((type << 4) | (size & 15));
+        size >>= 4;
+        while (size)
+        {
+            entry.push_back(static_cast<char>(c | 0x80));
+            c = size & 0x7f;
+            size >>= 7;
+        }
+        entry.push_back(static_cast<char>(c));
+
+        if (!bestDelta.empty())
+        {
+            // Base offset, relative and in git's "offset - 1 per continuation" encoding
+            uint64_t rel = offsets[i] - offsets[bestBase];
+            unsigned char buf[16];
+            int p = 15;
+            buf[p] = rel & 0x7f;
+            while (rel >>= 7)
+                buf[--p] = static_cast<unsigned char>(0x80 | (--rel & 0x7f));
+            entry.append(reinterpret_cast<char *>(buf + p), 16 - p);
+            depth[i] = depth[bestBase] + 1;
+            stats.deltas++;
+        }
+
+        if (!zlibCompress(payload, compressed))
+            return fail();
+        entry += compressed;
+
+        crcs[i] = static_cast<uint32_t>(crc32(0, reinterpret_cast<const Bytef *>(entry.data()), entry.size()));
+        if (!emit(entry))
+            return fail();
+
+        if (obj.type == "blob")
+            recent.emplace_back(i, std::move(content));
+        content.clear();
+    }
+
+    std::string packChecksum(hasher.finish().raw());
+    bool ok = packWriteAll(fd, packChecksum.data(), packChecksum.size());
+    ok = packSyncClose(fd) && ok;
+    fd = -1;
+    if (!ok)
+        return fail();
+    written += packChecksum.size();
+
+    // --- idx: ids sorted, with crc and offset tables in the same order ---
+    std::vector<size_t> order(objects.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b)
+              { return objects[a].hash < objects[b].hash; });
+
+    std::string idx = "\377tOc";
+    putBE32(idx, 2);
+    uint32_t fanout[256] = {0};
+    for (const auto &obj : objects)
+        fanout[obj.hash.data()[0]]++;
+    for (int i = 1; i < 256; i++)
+        fanout[i] += fanout[i - 1];
+    for (int i = 0; i < 256; i++)
+        putBE32(idx, fanout[i]);
+    for (size_t i : order)
+        idx += objects[i].hash.raw();
+    for (size_t i : order)
+        putBE32(idx, crcs[i]);
+
+    std::string large;
+    uint32_t largeCount = 0;
+    for (size_t i : order)
+    {
+        if (offsets[i] < 0x80000000ull)
+            putBE32(idx, static_cast<uint32_t>(offsets[i]));
+        else
+        {
+            putBE32(idx, 0x80000000u | largeCount++);
+            putBE32(large, static_cast<uint32_t>(offsets[i] >> 32));
+            putBE32(large, static_cast<uint32_t>(offsets[i]));
+        }
+    }
+    idx += large;
+    idx += packChecksum;
+    idx += hashBytes(idx).raw();
+
+    fd = ::open((base + ".idx").c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    ok = fd >= 0 && packWriteAll(fd, idx.data(), idx.size());
+    ok = fd >= 0 && packSyncClose(fd) && ok;
+    fd = -1;
+    if (!ok)
+    {
+        ::unlink((base + ".idx").c_str());
+        return fail();
+    }
+
+    // Both files are complete and on disk: rename them so readers never see a partial pack
+    packName = "pack-" + rawToHex(packChecksum);
+    std::string target = dir + "/" + packName;
+    if (std::rename((base + ".pack").c_str(), (target + ".pack").c_str()) != 0)
+    {
+        ::unlink((base + ".idx").c_str());
+        return fail();
+    }
+    if (std::rename((base + ".idx").c_str(), (target + ".idx").c_str()) != 0)
+    {
+        ::unlink((base + ".idx").c_str());
+        return false;
+    }
+
+    stats.objects = objects.size();
+    stats.bytesOut = written;
+    return true;
+}
@@ -0,0 +1,340 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "hash.hpp"
+#include "lockfile.hpp"
+#include "mapped_file.hpp"
+
+/**
+ * Refs: one file per ref under refs/ ("loose"), plus a single "packed-refs"
+ * file that holds many refs at once. A loose ref wins over a packed one, so
+ * updating a ref only ever writes its loose file; pack-refs moves the loose
+ * files into packed-refs again.
+ *
+ * packed-refs (the same text format as git's):
+ *   "# pack-refs with: sorted\n"
+ *   "<hex id> <refname>\n"  ... sorted by refname
+ * Being sorted, one ref is found with a binary search over the mapped file.
+ *
+ * Every change goes through a RefTransaction: all refs involved are locked
+ * ("<ref>.lock", see lockfile.hpp), their current values are checked against
+ * what the caller expects (compare-and-swap), and only then are the new values
+ * renamed into place. Two processes updating the same ref cannot both
+ * succeed: the second one either waits for the lock or sees a value it did not
+ * expect and fails without writing anything.
+ */
+
+// Locks on refs are held only for a moment; wait this long before giving up
+const int REF_LOCK_TIMEOUT_MS = 1000;
+
+// ---------- packed-refs ----------
+class PackedRefs
+{
+public:
+    // --- Map `file`; a missing file is an empty set of refs ---
+    bool load(const std::string &file)
+    {
+        begin = 0;
+        if (!map.open(file))
+            return errno == ENOENT;
+        const char *p = text();
+        if (map.size() > 0 && p[0] == '#')
+        {
+            const char *nl = static_cast<const char *>(std::memchr(p, '\n', map.size()));
+            begin = nl ? static_cast<size_t>(nl - p) + 1 : map.size();
+        }
+        return true;
+    }
+
+    // --- Binary search for `name` (the lines are sorted by refname) ---
+    bool find(std::string_view name, ObjectId &id) const
+    {
+        size_t lo = begin, hi = map.size();
+        while (lo < hi)
+        {
+            // Back up from the middle to the start of its line
+            size_t start = lo + (hi - lo) / 2;
+            while (start > lo && text()[start - 1] != '\n')
+                start--;
+            size_t end;
+            std::string_view refName, hex;
+            parseLine(start, end, hex, refName);
+            int cmp = refName.compare(name);
+            if (cmp == 0)
+            {
+                id = ObjectId::fromHex(hex);
+                return !id.empty();
+            }
+            if (cmp < 0)
+                lo = end;
+            else
+                hi = start;
+        }
+        return false;
+    }
+
+    // --- fn(name, id) for every ref, in name order ---
+    template <typename Fn>
+    void forEach(Fn fn) const
+    {
+        for (size_t pos = begin, end; pos < map.size(); pos = end)
+        {
+            std::string_view hex, name;
+            parseLine(pos, end, hex, name);
+            ObjectId id = ObjectId::fromHex(hex);
+            if (!id.empty() && !name.empty())
+                fn(name, id);
+        }
+    }
+
+private:
+    MappedFile map;
+    size_t begin = 0; // first ref line, after the header
+
+    const char *text() const { return reinterpret_cast<const char *>(map.data()); }
+
+    // --- "<hex> <name>\n" at `start`; `end` is the start of the next line ---
+    void parseLine(size_t start, size_t &end, std::string_view &hex, std::string_view &name) const
+    {
+        std::string_view rest(text() + start, map.size() - start);
+        size_t nl = rest.find('\n');
+        std::string_view line = rest.substr(0, nl);
+        end = nl == std::string_view::npos ? map.size() : start + nl + 1;
+        size_t space = line.find(' ');
+        hex = line.substr(0, space);
+        name = space == std::string_view::npos ? std::string_view() : line.substr(space + 1);
+    }
+};
+
+// ---------- Reading refs ----------
+// --- Id stored in a loose ref file (false if there is none) ---
+inline bool readLooseRef(const std::string &file, ObjectId &id)
+{
+    std::ifstream in(file);
+    std::string hash;
+    if (!(in >> hash))
+        return false;
+    id = ObjectId::fromHex(hash);
+    return !id.empty();
+}
+
+// --- Value of `name` ("refs/heads/main", "HEAD" when detached): loose, else packed ---
+inline ObjectId readRef(const std::string &gitDir, const std::string &name)
+{
+    ObjectId id;
+    if (readLooseRef(gitDir + "/" + name, id))
+        return id;
+    PackedRefs packed;
+    if (packed.load(gitDir + "/packed-refs") && packed.find(name, id))
+        return id;
+    return ObjectId();
+}
+
+// --- Every ref whose name starts with `prefix` (e.g. "refs/heads/"), by name ---
+inline std::map<std::string, ObjectId> listRefs(const std::string &gitDir, const std::string &prefix)
+{
+    std::map<std::string, ObjectId> refs;
+    PackedRefs packed;
+    if (packed.load(gitDir + "/packed-refs"))
+        packed.forEach([&](std::string_view name, const ObjectId &id)
+                       {
+            if (name.compare(0, prefix.size(), prefix) == 0)
+                refs[std::string(name)] = id; });
+
+    std::error_code ec;
+    std::string dir = gitDir + "/" + prefix;
+    for (auto it = std::filesystem::recursive_directory_iterator(dir, ec); !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+    {
+        ObjectId id;
+        if (it->is_regular_file() && it->path().extension() != ".lock" && readLooseRef(it->path().string(), id))
+            refs[prefix + std::filesystem::relative(it->path(), dir).generic_string()] = id;
+    }
+    return refs;
+}
+
+// ---------- Transactions ----------
+struct RefUpdate
+{
+    std::string name;
+    ObjectId newId;   // empty: delete the ref
+    ObjectId oldId;   // expected current value; empty: the ref must not exist
+    bool checkOld = false;
+    bool verifyOnly = false; // only check oldId, change nothing
+};
+
+class RefTransaction
+{
+public:
+    explicit RefTransaction(const std::string &gitDir) : gitDir(gitDir) {}
+
+    // --- Set `name` to `newId`, whatever it was before ---
+    void update(const std::string &name, const ObjectId &newId)
+    {
+        updates.push_back({name, newId, ObjectId(), false, false});
+    }
+
+    // --- Set `name` to `newId` if it is still `oldId` (empty: if it does not exist yet) ---
+    void update(const std::string &name, const ObjectId &newId, const ObjectId &oldId)
+    {
+        updates.push_back({name, newId, oldId, true, false});
+    }
+
+    void remove(const std::string &name) { updates.push_back({name, ObjectId(), ObjectId(), false, false}); }
+
+    void remove(const std::string &name, const ObjectId &oldId)
+    {
+        updates.push_back({name, ObjectId(), oldId, true, false});
+    }
+
+    // --- Fail the transaction unless `name` is `oldId` when it commits ---
+    void verify(const std::string &name, const ObjectId &oldId)
+    {
+        updates.push_back({name, ObjectId(), oldId, true, true});
+    }
+
+    // --- Lock everything, check the old values and write the new ones, then rename them in ---
+    // A lock that cannot be taken, an unexpected old value or a failed write
+    // leaves every ref untouched. Only a rename failing in the last step (the
+    // disk going away) can leave the transaction partly applied: loose refs are
+    // renamed first, packed-refs last, and a deleted ref's loose file is removed
+    // only after that, so it keeps hiding the packed value until the very end.
+    bool commit()
+    {
+        std::sort(updates.begin(), updates.end(), [](const RefUpdate &a, const RefUpdate &b)
+                  { return a.name < b.name; }); // a fixed order, so two transactions cannot deadlock
+        for (size_t i = 1; i < updates.size(); i++)
+            if (updates[i].name == updates[i - 1].name)
+                return fail(updates[i].name, "is updated more than once");
+
+        std::vector<LockFile> locks(updates.size());
+        bool deletes = false;
+        for (size_t i = 0; i < updates.size(); i++)
+        {
+            const RefUpdate &u = updates[i];
+            std::string file = gitDir + "/" + u.name;
+            std::error_code ec;
+            std::filesystem::create_directories(std::filesystem::path(file).parent_path(), ec);
+            if (ec || !locks[i].acquire(file, false, REF_LOCK_TIMEOUT_MS))
+                return fail(u.name, "cannot be locked");
+
+            // Checked under the lock: nobody can change it until we are done
+            ObjectId current = readRef(gitDir, u.name);
+            if (u.checkOld && current != u.oldId)
+                return fail(u.name, current.empty()      ? "does not exist"
+                                    : u.oldId.empty()   ? "already exists"
+                                                        : "has moved to " + current.hex());
+            if (!u.verifyOnly && u.newId.empty())
+                deletes = true;
+            else if (!u.verifyOnly && !locks[i].write(u.newId.hex() + "\n"))
+                return fail(u.name, "cannot be written");
+        }
+
+        // --- A deleted ref must also leave packed-refs, or it would show through ---
+        LockFile packedLock;
+        if (deletes && !rewritePacked(packedLock))
+            return fail("packed-refs", "cannot be rewritten");
+
+        // --- Everything is checked and written: rename it all into place ---
+        for (size_t i = 0; i < updates.size(); i++)
+        {
+            const RefUpdate &u = updates[i];
+            if (!u.verifyOnly && !u.newId.empty() && !locks[i].commit())
+                return fail(u.name, "cannot be replaced");
+        }
+        if (packedLock.isLocked() && !packedLock.commit())
+            return fail("packed-refs", "cannot be replaced");
+        for (const RefUpdate &u : updates)
+        {
+            std::error_code ec;
+            if (!u.verifyOnly && u.newId.empty())
+                std::filesystem::remove(gitDir + "/" + u.name, ec); // its lock goes with `locks`
+        }
+        return true;
+    }
+
+private:
+    std::string gitDir;
+    std::vector<RefUpdate> updates;
+
+    bool fail(const std::string &name, const std::string &why) const
+    {
+        std::cerr << "Error: ref " << name << " " << why << ".\n";
+        return false;
+    }
+
+    // --- Write packed-refs without the deleted refs into `lock` (left unlocked if unchanged) ---
+    bool rewritePacked(LockFile &lock) const
+    {
+        std::string file = gitDir + "/packed-refs";
+        if (!lock.acquire(file, false, REF_LOCK_TIMEOUT_MS))
+            return false;
+        PackedRefs packed;
+        if (!packed.load(file))
+            return false;
+        std::string out = "# pack-refs with: sorted\n";
+        bool changed = false;
+        packed.forEach([&](std::string_view name, const ObjectId &id)
+                       {
+            bool deleted = std::any_of(updates.begin(), updates.end(), [&](const RefUpdate &u)
+                                       { return !u.verifyOnly && u.newId.empty() && u.name == name; });
+            if (deleted)
+                changed = true;
+            else
+                out += id.hex() + " " + std::string(name) + "\n"; });
+        if (!changed)
+        {
+            lock.rollback();
+            return true;
+        }
+        return lock.write(out);
+    }
+};
+
+// ---------- pack-refs ----------
+// --- Move every loose ref under refs/ into packed-refs; returns the number packed ---
+// A loose file is only removed if it still holds the value that was packed.
+inline bool packRefs(const std::string &gitDir, size_t &count)
+{
+    std::string file = gitDir + "/packed-refs";
+    LockFile lock;
+    if (!lock.acquire(file, false, REF_LOCK_TIMEOUT_MS))
+        return false;
+    std::map<std::string, ObjectId> refs = listRefs(gitDir, "refs/");
+    std::string out = "# pack-refs with: sorted\n";
+    for (const auto &ref : refs)
+        out += ref.second.hex() + " " + ref.first + "\n";
+    if (!lock.write(out) || !lock.commit())
+        return false;
+    count = refs.size();
+
+    std::error_code ec;
+    for (const auto &ref : refs)
+    {
+        std::string loose = gitDir + "/" + ref.first;
+        LockFile refLock;
+        ObjectId id;
+        if (!readLooseRef(loose, id) || !refLock.acquire(loose, true))
+            continue;
+        if (readLooseRef(loose, id) && id == ref.second)
+            std::filesystem::remove(loose, ec);
+    }
+
+    // --- Drop directories left empty (refs/heads and refs/tags stay) ---
+    std::vector<std::filesystem::path> dirs;
+    for (auto it = std::filesystem::recursive_directory_iterator(gitDir + "/refs", ec); !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+        if (it->is_directory())
+            dirs.push_back(it->path());
+    std::sort(dirs.rbegin(), dirs.rend()); // children before their parents
+    for (const auto &dir : dirs)
+        if (dir.parent_path() != std::filesystem::path(gitDir + "/refs") && std::filesystem::is_empty(dir, ec))
+            std::filesystem::remove(dir, ec);
+    return true;
+}
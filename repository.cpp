@@ -0,0 +1,3572 @@
+#include "repository.hpp"
+
+#include <iostream>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <ctime>
+#include <chrono>
+#include <unordered_map>
+#include <unordered_set>
+#include <map>
+#include <set>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <iterator>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <charconv>
+#include "diff.hpp"
+#include "hash.hpp"
+#include "object_view.hpp"
+#include "thread_pool.hpp"
+#include "trace.hpp"
+
+namespace fs = std::filesystem;
+
+Repository::Repository()
+{
+    // Every id this process reads or writes uses the repository's object format
+    auto cfg = readConfig();
+    const HashAlgo *algo = cfg.count("objectformat") ? hashAlgoByName(cfg["objectformat"]) : &SHA1_ALGO;
+    if (!algo)
+    {
+        std::cerr << "Error: unknown object format '" << cfg["objectformat"] << "', using sha1.\n";
+        algo = &SHA1_ALGO;
+    }
+    setHashAlgo(*algo);
+}
+
+bool Repository::isInitialized() const
+{
+    return fs::exists(path) && fs::exists(path + "/objects");
+}
+
+bool Repository::init(const std::string &objectFormat)
+{
+    if (isInitialized())
+    {
+        std::cout << "Reinitialized MyGit in " << fs::absolute(path) << "\n";
+        return false;
+    }
+    const HashAlgo *algo = hashAlgoByName(objectFormat);
+    if (!algo)
+    {
+        std::cerr << "Error: unknown object format '" << objectFormat << "' (sha1 or sha256).\n";
+        return false;
+    }
+    setHashAlgo(*algo);
+
+    // create directory structure
+    fs::create_directories(path + "/objects");
+    fs::create_directories(path + "/refs/heads");
+    fs::create_directories(path + "/refs/tags");
+
+    std::ofstream(path + "/HEAD") << "ref: refs/heads/main\n";
+
+    // create basic config file
+    writeConfig({{"objectformat", algo->name}});
+
+    std::cout << "Initialized MyGit repository in " << fs::absolute(path) << "\n";
+    return true;
+}
+
+std::map<std::string, std::string> Repository::readConfig() const
+{
+    // Create a map to store key-value pairs (like "name" -> "Alice", "email" -> "alice@example.com")
+    std::map<std::string, std::string> cfg;
+
+    // Open the config file from the .mygit directory
+    std::ifstream f(path + "/config");
+    if (!f.is_open())
+        return cfg;
+
+    std::string line;
+    // Read the config file line by line
+    while (std::getline(f, line))
+    {
+        // If the line contains "name", extract the substring after '=' and store it as the author name
+        if (line.find("name") != std::string::npos)
+            cfg["name"] = line.substr(line.find("=") + 1);
+
+        // If the line contains "email", extract the substring after '=' and store it as the author email
+        else if (line.find("email") != std::string::npos)
+            cfg["email"] = line.substr(line.find("=") + 1);
+
+        // Object compression ("zlib" or "zstd") for newly written objects
+        else if (line.find("compression") != std::string::npos)
+            cfg["compression"] = line.substr(line.find("=") + 1);
+
+        // Hash behind every object id ("sha1" or "sha256"), fixed at init
+        else if (line.find("objectformat") != std::string::npos)
+            cfg["objectformat"] = line.substr(line.find("=") + 1);
+
+        // In-memory cache of inflated commits and trees, in MiB (0 disables it)
+        else if (line.find("objectcache") != std::string::npos)
+            cfg["objectcache"] = line.substr(line.find("=") + 1);
+
+        // Files of at least this many MiB are stored in content-defined chunks
+        else if (line.find("chunkthreshold") != std::string::npos)
+            cfg["chunkthreshold"] = line.substr(line.find("=") + 1);
+
+        // Batched file I/O backend: "sync" (the default), "uring" or "threads"
+        else if (line.find("ioengine") != std::string::npos)
+            cfg["ioengine"] = line.substr(line.find("=") + 1);
+    }
+
+    // --- Trim leading whitespace from each value (e.g., " Alice" → "Alice") ---
+    for (auto &p : cfg)
+    {
+        if (!p.second.empty() && p.second.front() == ' ')
+            p.second.erase(0, p.second.find_first_not_of(' '));
+    }
+    return cfg;
+}
+
+void Repository::writeConfig(const std::map<std::string, std::string> &values)
+{
+    auto get = [&](const std::string &key, const std::string &fallback)
+    {
+        auto it = values.find(key);
+        return it != values.end() && !it->second.empty() ? it->second : fallback;
+    };
+
+    // git only accepts [extensions] from format version 1 on
+    std::string objectFormat = get("objectformat", SHA1_ALGO.name);
+    bool extensions = objectFormat != SHA1_ALGO.name;
+
+    std::ofstream cfg(path + "/config", std::ios::trunc);
+    cfg << "[core]\n"
+        << "    repositoryformatversion = " << (extensions ? 1 : 0) << "\n"
+        << "    filemode = true\n"
+        << "    bare = false\n"
+        << "    compression = " << get("compression", "zlib") << "\n";
+    if (values.count("objectcache"))
+        cfg << "    objectcache = " << values.at("objectcache") << "\n";
+    if (values.count("chunkthreshold"))
+        cfg << "    chunkthreshold = " << values.at("chunkthreshold") << "\n";
+    if (values.count("ioengine"))
+        cfg << "    ioengine = " << values.at("ioengine") << "\n";
+    if (extensions)
+        cfg << "[extensions]\n"
+            << "    objectformat = " << objectFormat << "\n";
+    cfg << "[user]\n"
+        << "    name = " << get("name", "Unknown") << "\n"
+        << "    email = " << get("email", "unknown@example.com") << "\n";
+}
+
+ObjectStore &Repository::objectStore() const
+{
+    if (storeInstance)
+        return *storeInstance;
+
+    storeInstance = std::make_unique<ObjectStore>();
+    ObjectStore &store = *storeInstance;
+    store.dir = path + "/objects";
+
+    auto cfg = readConfig();
+    if (cfg.count("compression") && cfg["compression"] == "zstd")
+    {
+        if (zstdAvailable())
+            store.compression = Compression::Zstd;
+        else
+            std::cerr << "Warning: built without zstd support, writing zlib objects.\n";
+    }
+    if (cfg.count("objectcache"))
+        store.cache.setCapacity(std::strtoull(cfg["objectcache"].c_str(), nullptr, 10) << 20);
+    if (cfg.count("chunkthreshold"))
+        store.chunkThreshold = std::strtoull(cfg["chunkthreshold"].c_str(), nullptr, 10) << 20;
+    if (batchIo().backend() != BatchIo::Backend::Sync)
+        store.io = &batchIo(); // with sync I/O the pool's own writes are just as good
+    return store;
+}
+
+BatchIo &Repository::batchIo() const
+{
+    if (!ioInstance)
+    {
+        auto cfg = readConfig();
+        ioInstance = std::make_unique<BatchIo>(BatchIo::backendFromName(cfg.count("ioengine") ? cfg["ioengine"] : ""));
+        BatchIo::Backend backend = ioInstance->backend();
+        traceCount(backend == BatchIo::Backend::Uring     ? "io.backend.uring"
+                   : backend == BatchIo::Backend::Threads ? "io.backend.threads"
+                                                          : "io.backend.sync");
+    }
+    return *ioInstance;
+}
+
+// ---------- Commit-graph ----------
+
+std::string Repository::commitGraphPath() const
+{
+    return path + "/objects/info/commit-graph";
+}
+
+const CommitGraph &Repository::commitGraph() const
+{
+    if (!graphInstance)
+    {
+        graphInstance = std::make_unique<CommitGraph>();
+        graphInstance->load(commitGraphPath());
+    }
+    return *graphInstance;
+}
+
+bool Repository::readCommitEntry(const ObjectId &hash, CommitGraphEntry &entry) const
+{
+    std::string type;
+    ObjectCache::Buffer content = objectStore().load(hash, type);
+    return content && type == "commit" && parseCommitEntry(hash, *content, entry);
+}
+
+bool Repository::parseCommitEntry(const ObjectId &hash, std::string_view content, CommitGraphEntry &entry)
+{
+    CommitView commit;
+    if (!parseCommit(content, commit))
+        return false;
+    entry = CommitGraphEntry();
+    entry.hash = hash;
+    entry.tree = ObjectId::fromHex(commit.tree);
+    commit.forEachParent([&](std::string_view parent)
+                         { entry.parents.push_back(ObjectId::fromHex(parent)); });
+
+    // "Name <email> <seconds> [zone]": the timestamp follows the closing '>'
+    size_t gt = commit.author.rfind('>');
+    if (gt != std::string_view::npos)
+    {
+        for (size_t i = gt + 1; i < commit.author.size(); i++)
+        {
+            char c = commit.author[i];
+            if (c >= '0' && c <= '9')
+                entry.time = entry.time * 10 + (c - '0');
+            else if (entry.time)
+                break;
+        }
+    }
+    return true;
+}
+
+bool Repository::updateCommitGraph(const std::vector<ObjectId> &tips)
+{
+    uint32_t pos;
+    if (std::all_of(tips.begin(), tips.end(), [&](const ObjectId &tip)
+                    { return commitGraph().find(tip, pos); }))
+        return true;
+
+    LockFile lock;
+    if (!lockCommitGraph(lock))
+        return false;
+    graphInstance.reset(); // another writer may have replaced it since it was mapped
+    const CommitGraph &graph = commitGraph();
+    std::vector<CommitGraphEntry> entries;
+    graph.entries(entries);
+
+    std::set<ObjectId> added;
+    std::vector<ObjectId> pending(tips.begin(), tips.end());
+    while (!pending.empty())
+    {
+        ObjectId hash = pending.back();
+        pending.pop_back();
+        if (graph.find(hash, pos) || !added.insert(hash).second)
+            continue;
+        CommitGraphEntry entry;
+        if (!readCommitEntry(hash, entry))
+        {
+            std::cerr << "Error: cannot read commit " << hash << "\n";
+            return false;
+        }
+        pending.insert(pending.end(), entry.parents.begin(), entry.parents.end());
+        entries.push_back(std::move(entry));
+    }
+    if (added.empty())
+        return true;
+    return writeGraphFile(lock, std::move(entries));
+}
+
+bool Repository::lockCommitGraph(LockFile &lock)
+{
+    std::error_code ec;
+    fs::create_directories(path + "/objects/info", ec);
+    return lock.acquire(commitGraphPath(), false, REF_LOCK_TIMEOUT_MS);
+}
+
+bool Repository::writeGraphFile(LockFile &lock, std::vector<CommitGraphEntry> entries)
+{
+    graphInstance.reset(); // unmap before the file is replaced
+    if (!writeCommitGraph(lock, std::move(entries)))
+    {
+        std::cerr << "Error: cannot write commit-graph.\n";
+        return false;
+    }
+    return true;
+}
+
+// ---------- HEAD and branches ----------
+
+std::string Repository::readHeadRef() const
+{
+    std::string head;
+    std::ifstream headFile(path + "/HEAD");
+    std::getline(headFile, head);
+    return head.compare(0, 5, "ref: ") == 0 ? head.substr(5) : "";
+}
+
+std::string Repository::currentBranch() const
+{
+    std::string ref = readHeadRef();
+    return ref.compare(0, 11, "refs/heads/") == 0 ? ref.substr(11) : "";
+}
+
+ObjectId Repository::readHeadCommit() const
+{
+    std::string ref = readHeadRef();
+    return readRef(path, ref.empty() ? "HEAD" : ref);
+}
+
+bool Repository::writeRef(const std::string &ref, const std::string &value)
+{
+    std::error_code ec;
+    fs::create_directories(fs::path(path + "/" + ref).parent_path(), ec);
+    LockFile lock;
+    if (!lock.acquire(path + "/" + ref) || !lock.write(value) || !lock.commit())
+    {
+        std::cerr << "Error: cannot update " << ref << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool Repository::updateHead(const ObjectId &commitHash, const ObjectId &expected)
+{
+    std::string ref = readHeadRef();
+    RefTransaction transaction(path);
+    transaction.update(ref.empty() ? "HEAD" : ref, commitHash, expected);
+    return transaction.commit();
+}
+
+bool Repository::branchExists(const std::string &name) const
+{
+    return !readRef(path, "refs/heads/" + name).empty();
+}
+
+bool Repository::isValidBranchName(const std::string &name)
+{
+    if (name.empty() || name[0] == '-' || name[0] == '/' || name.back() == '/' || name.back() == '.' ||
+        name.find("..") != std::string::npos || name.find("//") != std::string::npos || name == "HEAD")
+        return false;
+    if (name.size() >= 5 && name.compare(name.size() - 5, 5, ".lock") == 0)
+        return false;
+    for (unsigned char c : name)
+        if (c < 0x20 || c == 0x7f || c == ' ' || std::strchr("~^:?*[\\", c))
+            return false;
+    return true;
+}
+
+bool Repository::branch(const std::vector<std::string> &args)
+{
+    if (!isInitialized())
+    {
+        std::cerr << "Error: not a MyGit repository.\n";
+        return false;
+    }
+
+    if (args.empty())
+    {
+        std::string current = currentBranch();
+        for (const auto &ref : listRefs(path, "refs/heads/"))
+        {
+            std::string name = ref.first.substr(11);
+            std::cout << (name == current ? "* " : "  ") << name << "\n";
+        }
+        return true;
+    }
+
+    if (args[0] == "-d" || args[0] == "-D")
+    {
+        if (args.size() != 2 || !branchExists(args[1]))
+        {
+            std::cerr << "Error: branch '" << (args.size() > 1 ? args[1] : "") << "' not found.\n";
+            return false;
+        }
+        if (args[1] == currentBranch())
+        {
+            std::cerr << "Error: cannot delete the branch '" << args[1] << "' which is checked out.\n";
+            return false;
+        }
+        std::string ref = "refs/heads/" + args[1];
+        RefTransaction transaction(path);
+        transaction.remove(ref, readRef(path, ref));
+        if (!transaction.commit())
+            return false;
+        std::cout << "Deleted branch " << args[1] << "\n";
+        return true;
+    }
+
+    const std::string &name = args[0];
+    if (!isValidBranchName(name))
+    {
+        std::cerr << "Error: '" << name << "' is not a valid branch name.\n";
+        return false;
+    }
+    if (branchExists(name))
+    {
+        std::cerr << "Error: a branch named '" << name << "' already exists.\n";
+        return false;
+    }
+    ObjectId start = resolveRevision(args.size() > 1 ? args[1] : "HEAD");
+    if (start.empty() || readCommitTree(start).empty())
+    {
+        std::cerr << "Error: not a valid commit: " << (args.size() > 1 ? args[1] : "HEAD") << "\n";
+        return false;
+    }
+    RefTransaction transaction(path);
+    transaction.update("refs/heads/" + name, start, ObjectId()); // fails if it was created meanwhile
+    return transaction.commit();
+}
+
+ObjectId Repository::resolveRevision(const std::string &rev) const
+{
+    if (rev == "HEAD")
+        return readHeadCommit();
+
+    for (const char *prefix : {"", "refs/heads/", "refs/tags/"})
+    {
+        if (!*prefix && rev.compare(0, 5, "refs/") != 0)
+            continue;
+        ObjectId id = readRef(path, prefix + rev);
+        if (!id.empty())
+            return id;
+    }
+
+    bool isHex = rev.size() >= 4 && rev.size() <= hashAlgo().hexSize &&
+                 rev.find_first_not_of("0123456789abcdef") == std::string::npos;
+    if (!isHex)
+        return ObjectId();
+    if (rev.size() == hashAlgo().hexSize)
+        return ObjectId::fromHex(rev);
+
+    std::vector<uint32_t> matches = commitGraph().findPrefix(rev);
+    if (matches.size() == 1)
+        return commitGraph().hashAt(matches[0]);
+    if (matches.size() > 1)
+        std::cerr << "Error: short id " << rev << " is ambiguous.\n";
+    return ObjectId();
+}
+
+bool Repository::graphPosition(const std::string &rev, uint32_t &pos)
+{
+    ObjectId hash = resolveRevision(rev);
+    if (hash.empty())
+    {
+        std::cerr << "Error: unknown revision " << rev << "\n";
+        return false;
+    }
+    if (commitGraph().find(hash, pos))
+        return true;
+    if (!updateCommitGraph({hash}) || !commitGraph().find(hash, pos))
+    {
+        std::cerr << "Error: " << rev << " is not a commit.\n";
+        return false;
+    }
+    return true;
+}
+
+void Repository::setAuthorName(const std::string &name)
+{
+    if (!isInitialized())
+    {
+        std::cerr << "Not a MyGit repository.\n";
+        return;
+    }
+
+    auto cfgmap = readConfig();
+    cfgmap["name"] = name;
+    writeConfig(cfgmap);
+    std::cout << "Author name set to: " << name << "\n";
+}
+
+void Repository::setAuthorEmail(const std::string &email)
+{
+    if (!isInitialized())
+    {
+        std::cerr << "Not a MyGit repository.\n";
+        return;
+    }
+
+    auto cfgmap = readConfig();
+    cfgmap["email"] = email;
+    writeConfig(cfgmap);
+    std::cout << "Author email set to: " << email << "\n";
+}
+
+bool Repository::hashFileToBlob(const ObjectStore &store, const std::string &filePath, const struct stat &st, IndexEntry &entry,
+                                const std::string *content)
+{
+    // Stream it into a blob; the hash uniquely identifies the file by its content.
+    // A symlink is stored as a blob holding its target path, like git does.
+    std::error_code ec;
+    ObjectId hash = content               ? store.write("blob", *content)
+                    : S_ISLNK(st.st_mode) ? store.write("blob", fs::read_symlink(filePath, ec).string())
+                                          : store.writeBlobFile(filePath, static_cast<uint64_t>(st.st_size));
+    if (hash.empty())
+    {
+        std::cerr << "Error: cannot write object for " << filePath << "\n";
+        return false;
+    }
+
+    // Record the blob and the stat data it was hashed with
+    entry.path = filePath;
+    entry.hash = hash;
+    fillStatData(entry, st);
+    return true;
+}
+
+ObjectId Repository::hashWorktreeFile(const std::string &filePath, const struct stat &st) const
+{
+    std::error_code ec;
+    if (S_ISLNK(st.st_mode))
+        return hashObject("blob", fs::read_symlink(filePath, ec).string());
+    return objectStore().hashBlobFile(filePath, static_cast<uint64_t>(st.st_size));
+}
+
+std::vector<size_t> Repository::readSmallFiles(const std::vector<std::string> &files, const std::vector<struct stat> &stats,
+                                               const std::vector<size_t> &which,
+                                               const std::function<void(size_t, std::string &)> &fn) const
+{
+    const ObjectStore &store = objectStore();
+    if (batchIo().backend() == BatchIo::Backend::Sync)
+        return which; // nothing to overlap: streaming each file is as fast
+    std::vector<size_t> rest;
+    std::vector<std::string> paths, contents;
+    std::vector<uint64_t> sizes;
+    std::vector<size_t> batch;
+    std::vector<int> errors;
+    uint64_t batchBytes = 0;
+    auto flush = [&]
+    {
+        batchIo().readFiles(paths, sizes, contents, errors);
+        for (size_t k = 0; k < batch.size(); k++)
+        {
+            if (errors[k])
+                rest.push_back(batch[k]); // changed under us: the caller takes the slow path
+            else
+                fn(batch[k], contents[k]);
+        }
+        paths.clear(), sizes.clear(), batch.clear(), contents.clear();
+        batchBytes = 0;
+    };
+    for (size_t i : which)
+    {
+        uint64_t size = static_cast<uint64_t>(stats[i].st_size);
+        if (!S_ISREG(stats[i].st_mode) || size > BATCH_READ_MAX_FILE || store.isChunked(size))
+        {
+            rest.push_back(i);
+            continue;
+        }
+        paths.push_back(files[i]);
+        sizes.push_back(size);
+        batch.push_back(i);
+        batchBytes += size;
+        if (batchBytes >= BATCH_READ_BYTES || batch.size() >= BATCH_READ_FILES)
+            flush();
+    }
+    if (!batch.empty())
+        flush();
+    return rest;
+}
+
+std::vector<ObjectId> Repository::hashWorktreeFiles(const std::vector<std::string> &files,
+                                                    const std::vector<struct stat> &stats) const
+{
+    std::vector<ObjectId> hashes(files.size());
+    std::vector<size_t> all(files.size());
+    for (size_t i = 0; i < files.size(); i++)
+        all[i] = i;
+    for (size_t i : readSmallFiles(files, stats, all, [&](size_t i, std::string &content)
+                                   { hashes[i] = hashObject("blob", content); }))
+        hashes[i] = hashWorktreeFile(files[i], stats[i]);
+    return hashes;
+}
+
+IgnoreRules &Repository::ignoreRules() const
+{
+    if (!ignoreInstance)
+        ignoreInstance = std::make_unique<IgnoreRules>();
+    return *ignoreInstance;
+}
+
+void Repository::walkFiles(const std::string &dir, const Index &index, std::vector<std::string> &files) const
+{
+    TraceSpan span("fs.walk");
+    size_t before = files.size();
+    IgnoreRules &ignore = ignoreRules();
+    int ignoredDepth = -1; // inside an ignored directory that holds tracked files: only those are taken
+    std::error_code ec;
+    for (auto it = fs::recursive_directory_iterator(dir, ec); it != fs::recursive_directory_iterator(); it.increment(ec))
+    {
+        if (ec)
+            break;
+        if (it->path().filename() == ".mygit")
+        {
+            it.disable_recursion_pending();
+            continue;
+        }
+        if (ignoredDepth >= it.depth())
+            ignoredDepth = -1;
+
+        std::string file = it->path().lexically_normal().generic_string();
+        if (file.rfind("./", 0) == 0)
+            file.erase(0, 2);
+        bool isDir = it->is_directory(ec) && !it->is_symlink(ec);
+        if (isDir)
+        {
+            if (ignoredDepth < 0 && ignore.isIgnored(file, true))
+            {
+                if (!index.hasEntriesUnder(file))
+                    it.disable_recursion_pending();
+                else
+                    ignoredDepth = it.depth();
+            }
+            continue;
+        }
+        if ((ignoredDepth >= 0 || ignore.isIgnored(file, false)) && !index.entries.count(file))
+            continue;
+        files.push_back(file);
+    }
+    traceCount("fs.walk.files", files.size() - before);
+}
+
+std::vector<std::string> Repository::collectFiles(const std::vector<std::string> &paths, const Index &index,
+                                                  std::vector<std::string> &dirs, const std::set<std::string> *changed)
+{
+    std::vector<std::string> files;
+    for (const auto &p : paths)
+    {
+        std::string name = fs::path(p).lexically_normal().generic_string();
+        if (name.size() > 1 && name.back() == '/')
+            name.pop_back();
+
+        if (!fs::is_directory(fs::symlink_status(name)))
+        {
+            files.push_back(name);
+            continue;
+        }
+
+        dirs.push_back(name);
+        if (!changed)
+        {
+            walkFiles(name, index, files);
+            continue;
+        }
+        std::string prefix = name == "." ? "" : name + "/";
+        for (auto it = changed->lower_bound(prefix); it != changed->end() && it->compare(0, prefix.size(), prefix) == 0; ++it)
+        {
+            struct stat st;
+            if (::lstat(it->c_str(), &st) != 0)
+                continue; // deleted: the caller drops it from the index
+            bool isDir = S_ISDIR(st.st_mode);
+            if (ignoreRules().isExcluded(*it, isDir) && !(isDir ? index.hasEntriesUnder(*it) : index.entries.count(*it)))
+                continue;
+            if (isDir)
+                walkFiles(*it, index, files);
+            else
+                files.push_back(*it);
+        }
+    }
+    std::sort(files.begin(), files.end());
+    files.erase(std::unique(files.begin(), files.end()), files.end());
+    return files;
+}
+
+const UntrackedDir &Repository::scanUntracked(Index &index, const std::string &dir, bool &changed) const
+{
+    std::string prefix = dir.empty() ? "" : dir + "/";
+    UntrackedDir fresh;
+    struct stat st;
+    if (::lstat(dir.empty() ? "." : dir.c_str(), &st) == 0)
+        fresh.setStat(st);
+    if (::lstat((prefix + ".mygitignore").c_str(), &st) == 0)
+        fresh.setIgnoreStat(st);
+
+    // A directory modified after the index was written may change again within
+    // the same timestamp, so it is only trusted once the index is newer
+    auto cached = index.untrackedCache.find(dir);
+    if (cached != index.untrackedCache.end() && cached->second.sameStat(fresh) &&
+        !index.isRacy(fresh.mtimeSec, fresh.mtimeNsec))
+    {
+        traceCount("untracked.cache.hit");
+        return cached->second;
+    }
+    traceCount("untracked.cache.miss");
+
+    // New rules here apply to everything below: drop what was cached for it
+    if (cached == index.untrackedCache.end() || !cached->second.sameIgnore(fresh))
+    {
+        for (auto it = index.untrackedCache.lower_bound(prefix);
+             it != index.untrackedCache.end() && it->first.compare(0, prefix.size(), prefix) == 0;)
+            it = dir.empty() && it->first.empty() ? std::next(it) : index.untrackedCache.erase(it);
+    }
+
+    IgnoreRules &ignore = ignoreRules();
+    std::error_code ec;
+    for (auto &entry : fs::directory_iterator(dir.empty() ? "." : dir, ec))
+    {
+        std::string name = entry.path().filename().string();
+        if (name == ".mygit")
+            continue;
+        std::string rel = prefix + name;
+        bool isDir = entry.is_directory(ec) && !entry.is_symlink(ec);
+        if ((!isDir && index.entries.count(rel)) || ignore.isIgnored(rel, isDir))
+            continue;
+        (isDir ? fresh.dirs : fresh.files).push_back(name);
+    }
+    changed = true;
+    return index.untrackedCache[dir] = std::move(fresh);
+}
+
+bool Repository::add(const std::vector<std::string> &paths)
+{
+    TraceSpan span("add");
+    if (!isInitialized())
+    {
+        std::cerr << "Error: not a MyGit repository. \n";
+        return false;
+    }
+
+    for (const auto &p : paths)
+    {
+        if (!fs::exists(fs::symlink_status(p)))
+        {
+            std::cerr << "Error: file not found: " << p << "\n";
+            return false;
+        }
+    }
+
+    // Held until the new index is written, so concurrent adds cannot lose entries
+    LockFile indexLock;
+    if (!indexLock.acquire(path + "/index"))
+        return false;
+
+    Index index;
+    if (!index.load(path + "/index"))
+    {
+        std::cerr << "Error: index file is corrupt.\n";
+        return false;
+    }
+
+    // With a running fsmonitor, directories are not walked: only paths changed
+    // since the last status, plus what that status found dirty or untracked
+    std::set<std::string> changedPaths;
+    FsMonitorAnswer fsmonitor;
+    bool incremental = fsmonitorQuery(fsmonitorSocket(), index.fsmonitorToken, fsmonitor) && !fsmonitor.full;
+    if (incremental)
+        changedPaths = fsmonitorCandidates(index, fsmonitor);
+
+    std::vector<std::string> dirs;
+    std::vector<std::string> files = collectFiles(paths, index, dirs, incremental ? &changedPaths : nullptr);
+
+    // --- Stat stage (one batch) ---
+    // Unchanged since it was staged: no read, no hash, no write
+    std::vector<struct stat> stats;
+    std::vector<int> errors;
+    std::atomic<bool> failed{false};
+    batchIo().lstatAll(files, stats, errors);
+    std::vector<size_t> todo;
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        auto it = index.entries.find(files[i]);
+        if (errors[i])
+            failed = true;
+        else if (it == index.entries.end() || !index.isUpToDate(it->second, stats[i]))
+            todo.push_back(i);
+    }
+
+    // --- Hash + write stage (parallel) ---
+    // Small files are read in batches and hashed on the pool; the rest are
+    // streamed by the pool. New objects are queued and written in batches.
+    // The index is only read here; each task writes into its own result slot.
+    std::vector<IndexEntry> results(files.size());
+    std::vector<char> changed(files.size(), 0);
+    ObjectStore &store = objectStore();
+    {
+        TraceSpan hashSpan("add.hash");
+        ThreadPool pool;
+        store.beginBatch();
+        auto stage = [&](size_t i, const std::string *content)
+        {
+            if (hashFileToBlob(store, files[i], stats[i], results[i], content))
+                changed[i] = 1;
+            else
+                failed = true;
+        };
+        std::vector<size_t> rest = readSmallFiles(files, stats, todo, [&](size_t i, std::string &content)
+                                                  { pool.submit([&, i, content = std::move(content)]
+                                                                { stage(i, &content); }); });
+        for (size_t i : rest)
+            pool.submit([&, i]
+                        { stage(i, nullptr); });
+        if (!pool.wait())
+        {
+            std::cerr << "Error: hashing failed: " << pool.error() << "\n";
+            failed = true;
+        }
+    }
+    if (!store.endBatch())
+    {
+        std::cerr << "Error: some objects could not be written; nothing was staged.\n";
+        return false;
+    }
+
+    // --- Batched index update ---
+    size_t hashed = 0;
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        if (!changed[i])
+            continue;
+        hashed++;
+        index.stage(results[i]);
+        std::cout << "Added file " << files[i] << " as blob " << results[i].hash << "\n";
+    }
+    if (hashed > 1 || store.stats.deduplicated > 0)
+        std::cout << "Hashed " << hashed << " file(s): " << store.stats.written << " new object(s) written, "
+                  << store.stats.deduplicated << " already stored\n";
+
+    // Tracked files that disappeared from an added directory are dropped from the index
+    for (const auto &dir : dirs)
+    {
+        std::string prefix = dir == "." ? "" : dir + "/";
+        std::vector<std::string> gone;
+        auto check = [&](const std::string &file)
+        {
+            struct stat st;
+            if (::lstat(file.c_str(), &st) != 0 || S_ISDIR(st.st_mode))
+                gone.push_back(file); // deleted, or replaced by a directory
+        };
+        if (incremental)
+        {
+            for (auto c = changedPaths.lower_bound(prefix); c != changedPaths.end() && c->rfind(prefix, 0) == 0; ++c)
+                forEachTrackedUnder(index, *c, [&](const IndexEntry &entry)
+                                    { check(entry.path); });
+        }
+        else
+        {
+            for (auto it = index.entries.lower_bound(prefix); it != index.entries.end() && it->first.rfind(prefix, 0) == 0; ++it)
+                check(it->first);
+        }
+        std::sort(gone.begin(), gone.end());
+        gone.erase(std::unique(gone.begin(), gone.end()), gone.end());
+        for (const auto &file : gone)
+            index.remove(file);
+    }
+
+    // Adding a path (or dropping it from the index) marks its merge conflict resolved
+    std::vector<std::string> unmerged = readMergeConflicts();
+    if (!unmerged.empty())
+    {
+        std::set<std::string> added(files.begin(), files.end());
+        std::string remaining;
+        for (const auto &file : unmerged)
+        {
+            bool tracked = false, resolved = false;
+            forEachTrackedUnder(index, file, [&](const IndexEntry &entry)
+                                {
+                tracked = true;
+                resolved = resolved || added.count(entry.path) > 0; });
+            if (tracked && !resolved)
+                remaining += file + "\n";
+        }
+        std::error_code ec;
+        if (remaining.empty())
+            fs::remove(path + "/MERGE_CONFLICTS", ec);
+        else
+            writeRef("MERGE_CONFLICTS", remaining);
+    }
+
+    if (!index.save(indexLock))
+    {
+        std::cerr << "Error: cannot write index.\n";
+        return false;
+    }
+    return !failed;
+}
+
+// ---------- BUILD TREES FROM INDEX ----------
+
+ObjectId Repository::writeTreeFromIndex(Index &index, const std::string &dir)
+{
+    auto cached = index.cacheTree.find(dir);
+    if (cached != index.cacheTree.end())
+        return cached->second;
+
+    std::string prefix = dir.empty() ? "" : dir + "/";
+    Tree tree;
+    auto it = index.entries.lower_bound(prefix);
+    while (it != index.entries.end() && it->first.compare(0, prefix.size(), prefix) == 0)
+    {
+        std::string rest = it->first.substr(prefix.size());
+        size_t slash = rest.find('/');
+
+        TreeEntry entry;
+        if (slash == std::string::npos)
+        {
+            entry.mode = gitMode(it->second.mode);
+            entry.name = rest;
+            entry.hash = it->second.hash;
+            ++it;
+        }
+        else
+        {
+            std::string sub = rest.substr(0, slash);
+            entry.mode = "40000";
+            entry.name = sub;
+            entry.hash = writeTreeFromIndex(index, prefix + sub);
+            if (entry.hash.empty())
+                return ObjectId();
+            // Skip the whole subdirectory: '0' is the byte right after '/'
+            it = index.entries.lower_bound(prefix + sub + "0");
+        }
+        tree.entries.push_back(entry);
+    }
+
+    sortTreeEntries(tree);
+
+    ObjectId hash = writeTree(tree);
+    if (!hash.empty())
+        index.cacheTree[dir] = hash;
+    return hash;
+}
+
+// ---------- Read Tree Object (recursively) ----------
+
+void Repository::readTreeRecursive(const ObjectId &treeHash, const std::string &prefix,
+                                   std::map<std::string, TreeEntry> &files,
+                                   const Index *index, std::set<std::string> *cleanDirs) const
+{
+    std::string type;
+    ObjectCache::Buffer content = objectStore().load(treeHash, type);
+    if (!content || type != "tree")
+        return;
+
+    for (const auto &view : TreeView(*content))
+    {
+        TreeEntry entry;
+        entry.mode = std::string(view.mode);
+        entry.name = prefix + std::string(view.name);
+        entry.hash = view.hash();
+
+        if (entry.mode == "40000")
+        {
+            if (index && cleanDirs)
+            {
+                auto cached = index->cacheTree.find(entry.name);
+                if (cached != index->cacheTree.end() && cached->second == entry.hash)
+                {
+                    cleanDirs->insert(entry.name);
+                    continue;
+                }
+            }
+            readTreeRecursive(entry.hash, entry.name + "/", files, index, cleanDirs);
+            continue;
+        }
+        files[entry.name] = entry;
+    }
+}
+
+ObjectId Repository::readCommitTree(const ObjectId &commitHash) const
+{
+    std::string type;
+    CommitView commit;
+    ObjectCache::Buffer content = objectStore().load(commitHash, type);
+    if (!content || type != "commit" || !parseCommit(*content, commit))
+        return ObjectId();
+    return ObjectId::fromHex(commit.tree);
+}
+
+// ---------- Write Tree Object ----------
+
+ObjectId Repository::writeTree(const Tree &tree)
+{
+    std::string content;
+    for (const auto &entry : tree.entries)
+    {
+        content += entry.mode + " " + entry.name;
+        content.push_back('\0');
+        content += entry.hash.raw();
+    }
+    return objectStore().write("tree", content);
+}
+
+ObjectId Repository::commit(const std::string &message)
+{
+    TraceSpan span("commit");
+    if (!isInitialized())
+    {
+        std::cerr << "Error: not a MyGit repository.\n";
+        return ObjectId();
+    }
+
+    // Ensure there is an index
+    LockFile indexLock;
+    if (!indexLock.acquire(path + "/index"))
+        return ObjectId();
+    Index index;
+    if (!index.load(path + "/index") || index.entries.empty())
+    {
+        std::cerr << "Nothing to commit.\n";
+        return ObjectId();
+    }
+
+    // A merge that stopped for conflicts can only be concluded once they are resolved
+    std::vector<std::string> unmerged = readMergeConflicts();
+    if (!unmerged.empty())
+    {
+        std::cerr << "Error: committing is not possible because you have unmerged files:\n";
+        for (const auto &file : unmerged)
+            std::cerr << "    " << file << "\n";
+        std::cerr << "Fix them up in the work tree, then use 'mygit add <file>'.\n";
+        return ObjectId();
+    }
+    ObjectId mergeHead = readMergeHead();
+
+    // build the tree objects (unchanged directories are reused from the cache tree);
+    // the new trees are written in one batch, before the index refers to them
+    TraceSpan treeSpan("commit.write-tree");
+    objectStore().beginBatch();
+    ObjectId treeHash = writeTreeFromIndex(index);
+    if (!objectStore().endBatch())
+        treeHash = ObjectId();
+    treeSpan.stop();
+    if (treeHash.empty())
+    {
+        std::cerr << "Error: cannot write tree object.\n";
+        return ObjectId();
+    }
+    index.save(indexLock); // keep the refreshed cache tree
+
+    // Find parent commit
+    ObjectId parentHash = readHeadCommit();
+
+    // The index holds the full snapshot, so an unchanged tree means nothing was staged
+    // (a merge is recorded even if it did not change the tree)
+    if (!parentHash.empty() && mergeHead.empty() && readCommitTree(parentHash) == treeHash)
+    {
+        std::cerr << "Nothing to commit.\n";
+        return ObjectId();
+    }
+
+    // Create commit object
+    std::ostringstream commitBuf;
+    commitBuf << "tree " << treeHash << "\n";
+    if (!parentHash.empty())
+        commitBuf << "parent " << parentHash << "\n";
+    if (!mergeHead.empty())
+        commitBuf << "parent " << mergeHead << "\n";
+
+    // read name/email from config
+    auto cfg = readConfig();
+    std::string authorName = cfg.count("name") ? cfg["name"] : "Unknown";
+    std::string authorEmail = cfg.count("email") ? cfg["email"] : "unknown@example.com";
+
+    commitBuf << "author " << authorName << " <" << authorEmail << "> "
+              << std::time(nullptr) << "\n\n";
+
+    commitBuf << message << "\n";
+
+    ObjectId commitHash = objectStore().write("commit", commitBuf.str());
+    if (commitHash.empty())
+    {
+        std::cerr << "Error: cannot write commit object.\n";
+        return ObjectId();
+    }
+
+    if (!updateHead(commitHash, parentHash))
+        return ObjectId();
+    clearMergeState();
+    updateCommitGraph({commitHash}); // only the new commit is read; the rest is copied
+
+    // The index is kept (as Git does): it now matches the new commit and keeps
+    // the stat data that lets status skip re-hashing unchanged files.
+
+    std::string branchName = currentBranch();
+    std::cout << "[" << (branchName.empty() ? "detached HEAD" : branchName) << " "
+              << commitHash.hex().substr(0, 7) << "] " << message << "\n";
+    return commitHash;
+}
+
+void Repository::logCommits(size_t maxCount, const std::string &rev)
+{
+    TraceSpan span("log");
+    if (!isInitialized())
+    {
+        std::cerr << "Not a MyGit repository.\n";
+        return;
+    }
+    if (rev == "HEAD" && readHeadCommit().empty())
+    {
+        std::cerr << "No commits yet.\n";
+        return;
+    }
+
+    uint32_t start;
+    if (maxCount == 0 || !graphPosition(rev, start))
+        return;
+
+    // The parsed view points into the (cached) inflated commit
+    ObjectStore &store = objectStore();
+    const CommitGraph &graph = commitGraph();
+    std::string type;
+    CommitView commit;
+    size_t shown = 0;
+    graph.walk(start, [&](uint32_t pos)
+               {
+        ObjectId commitHash = graph.hashAt(pos);
+        ObjectCache::Buffer content = store.load(commitHash, type);
+        if (!content || type != "commit" || !parseCommit(*content, commit))
+        {
+            std::cerr << "Error: cannot open commit " << commitHash << "\n";
+            return false;
+        }
+
+        std::cout << "commit " << commitHash << "\n";
+        if (!commit.author.empty())
+            std::cout << "Author: " << commit.author << "\n";
+        std::cout << "\n    " << commit.message << "\n";
+        return ++shown < maxCount; });
+}
+
+bool Repository::revList(const std::string &rev, size_t maxCount, bool countOnly)
+{
+    uint32_t start;
+    if (!isInitialized() || !graphPosition(rev, start))
+        return false;
+
+    const CommitGraph &graph = commitGraph();
+    size_t shown = 0;
+    if (maxCount > 0)
+    {
+        graph.walk(start, [&](uint32_t pos)
+                   {
+            if (!countOnly)
+                std::cout << graph.hashAt(pos) << "\n";
+            return ++shown < maxCount; });
+    }
+    if (countOnly)
+        std::cout << shown << "\n";
+    return true;
+}
+
+bool Repository::mergeBase(const std::string &a, const std::string &b)
+{
+    uint32_t posA, posB;
+    if (!isInitialized() || !graphPosition(a, posA) || !graphPosition(b, posB))
+        return false;
+    // the second lookup may have rewritten the graph, so resolve a again
+    if (!graphPosition(a, posA))
+        return false;
+
+    const CommitGraph &graph = commitGraph();
+    std::vector<uint32_t> bases = graph.mergeBases(posA, posB);
+    if (bases.empty())
+        return false;
+    for (uint32_t base : bases)
+        std::cout << graph.hashAt(base) << "\n";
+    return true;
+}
+
+bool Repository::isAncestor(const std::string &ancestor, const std::string &descendant)
+{
+    uint32_t posA, posD;
+    if (!isInitialized() || !graphPosition(ancestor, posA) || !graphPosition(descendant, posD) ||
+        !graphPosition(ancestor, posA))
+        return false;
+    return commitGraph().isAncestor(posA, posD);
+}
+
+// ---------- Diff ----------
+
+void Repository::diffTrees(const ObjectId &oldTree, const ObjectId &newTree, const std::string &prefix,
+                           std::vector<FileChange> &changes) const
+{
+    if (oldTree == newTree)
+        return;
+    std::string type;
+    ObjectCache::Buffer oldContent = objectStore().load(oldTree, type);
+    ObjectCache::Buffer newContent = objectStore().load(newTree, type);
+
+    // Entries are in git order, so a merge walk on "name" / "name/" pairs them up
+    TreeView oldView(oldContent ? *oldContent : std::string_view()), newView(newContent ? *newContent : std::string_view());
+    auto a = oldView.begin(), b = newView.begin();
+    auto key = [](const TreeEntryView &e)
+    {
+        std::string k(e.name);
+        if (e.mode == "40000")
+            k += '/';
+        return k;
+    };
+    auto emit = [&](const TreeEntryView *from, const TreeEntryView *to)
+    {
+        const TreeEntryView &any = from ? *from : *to;
+        std::string path = prefix + std::string(any.name);
+        if (any.mode == "40000")
+        {
+            diffTrees(from ? from->hash() : ObjectId(), to ? to->hash() : ObjectId(), path + "/", changes);
+            return;
+        }
+        FileChange change;
+        change.path = path;
+        if (from)
+        {
+            change.oldMode.assign(from->mode);
+            change.oldHash = from->hash();
+        }
+        if (to)
+        {
+            change.newMode.assign(to->mode);
+            change.newHash = to->hash();
+        }
+        if (change.oldHash != change.newHash || change.oldMode != change.newMode)
+            changes.push_back(std::move(change));
+    };
+
+    while (a != oldView.end() || b != newView.end())
+    {
+        if (b == newView.end() || (a != oldView.end() && key(*a) < key(*b)))
+        {
+            emit(&*a, nullptr);
+            ++a;
+        }
+        else if (a == oldView.end() || key(*b) < key(*a))
+        {
+            emit(nullptr, &*b);
+            ++b;
+        }
+        else
+        {
+            if (a->rawHash != b->rawHash || a->mode != b->mode)
+                emit(&*a, &*b);
+            ++a;
+            ++b;
+        }
+    }
+}
+
+void Repository::diffIndexToHead(const Index &index, std::vector<FileChange> &changes) const
+{
+    std::map<std::string, TreeEntry> committed;
+    std::set<std::string> cleanDirs;
+    ObjectId head = readHeadCommit();
+    if (!head.empty())
+    {
+        ObjectId treeHash = readCommitTree(head);
+        auto root = index.cacheTree.find("");
+        if (root != index.cacheTree.end() && root->second == treeHash)
+            return;
+        readTreeRecursive(treeHash, "", committed, &index, &cleanDirs);
+    }
+
+    auto inCleanDir = [&](const std::string &file)
+    {
+        for (size_t slash = file.find('/'); slash != std::string::npos; slash = file.find('/', slash + 1))
+            if (cleanDirs.count(file.substr(0, slash)))
+                return true;
+        return false;
+    };
+
+    std::map<std::string, FileChange> byPath;
+    for (const auto &[file, entry] : index.entries)
+    {
+        auto it = committed.find(file);
+        if (it == committed.end() && inCleanDir(file))
+            continue;
+        std::string mode = gitMode(entry.mode);
+        if (it != committed.end() && it->second.hash == entry.hash && it->second.mode == mode)
+            continue;
+        FileChange &change = byPath[file];
+        change.path = file;
+        change.newMode = mode;
+        change.newHash = entry.hash;
+        if (it != committed.end())
+        {
+            change.oldMode = it->second.mode;
+            change.oldHash = it->second.hash;
+        }
+    }
+    for (const auto &[file, entry] : committed)
+    {
+        if (index.entries.count(file))
+            continue;
+        FileChange &change = byPath[file];
+        change.path = file;
+        change.oldMode = entry.mode;
+        change.oldHash = entry.hash;
+    }
+    for (auto &[file, change] : byPath)
+        changes.push_back(std::move(change));
+}
+
+void Repository::diffWorktreeToIndex(const Index &index, std::vector<FileChange> &changes) const
+{
+    for (const auto &[file, entry] : index.entries)
+    {
+        struct stat st;
+        FileChange change;
+        change.path = file;
+        change.oldMode = gitMode(entry.mode);
+        change.oldHash = entry.hash;
+        if (::lstat(file.c_str(), &st) != 0)
+        {
+            changes.push_back(std::move(change)); // deleted
+            continue;
+        }
+        if (index.isUpToDate(entry, st))
+            continue;
+        change.newMode = gitMode(st.st_mode);
+        change.newHash = hashWorktreeFile(file, st);
+        change.newFromWorktree = true;
+        if (change.newHash != change.oldHash || change.newMode != change.oldMode)
+            changes.push_back(std::move(change));
+    }
+}
+
+bool Repository::loadSide(const ObjectId &hash, bool fromWorktree, const std::string &file, std::string &content) const
+{
+    content.clear();
+    if (hash.empty())
+        return true;
+    if (!fromWorktree)
+        return objectStore().readBlob(hash, content);
+    std::error_code ec;
+    if (fs::is_symlink(fs::symlink_status(file, ec)))
+    {
+        content = fs::read_symlink(file, ec).string();
+        return !ec;
+    }
+    std::ifstream in(file, std::ios::binary);
+    content.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return static_cast<bool>(in) || in.eof();
+}
+
+void Repository::printFileChange(const FileChange &change) const
+{
+    const std::string zero = "0000000";
+    std::cout << "diff --git a/" << change.path << " b/" << change.path << "\n";
+    if (change.oldHash.empty())
+        std::cout << "new file mode " << change.newMode << "\n";
+    else if (change.newHash.empty())
+        std::cout << "deleted file mode " << change.oldMode << "\n";
+    else if (change.oldMode != change.newMode)
+        std::cout << "old mode " << change.oldMode << "\nnew mode " << change.newMode << "\n";
+
+    if (change.oldHash == change.newHash)
+        return; // mode change only
+    std::cout << "index " << (change.oldHash.empty() ? zero : change.oldHash.hex().substr(0, 7)) << ".."
+              << (change.newHash.empty() ? zero : change.newHash.hex().substr(0, 7));
+    if (change.oldMode == change.newMode)
+        std::cout << " " << change.oldMode;
+    std::cout << "\n";
+
+    // Chunked files are large binaries: do not load them just to say so
+    std::string oldName = change.oldHash.empty() ? "/dev/null" : "a/" + change.path;
+    std::string newName = change.newHash.empty() ? "/dev/null" : "b/" + change.path;
+    struct stat st;
+    if (objectStore().isChunkList(change.oldHash) ||
+        (change.newFromWorktree ? ::lstat(change.path.c_str(), &st) == 0 && S_ISREG(st.st_mode) &&
+                                      objectStore().isChunked(static_cast<uint64_t>(st.st_size))
+                                : objectStore().isChunkList(change.newHash)))
+    {
+        std::cout << "Binary files " << oldName << " and " << newName << " differ\n";
+        return;
+    }
+
+    std::string oldContent, newContent;
+    if (!loadSide(change.oldHash, false, change.path, oldContent) ||
+        !loadSide(change.newHash, change.newFromWorktree, change.path, newContent))
+    {
+        std::cerr << "Error: cannot read contents of " << change.path << "\n";
+        return;
+    }
+
+    if (isBinaryContent(oldContent) || isBinaryContent(newContent))
+    {
+        std::cout << "Binary files " << oldName << " and " << newName << " differ\n";
+        return;
+    }
+    std::cout << "--- " << oldName << "\n+++ " << newName << "\n";
+    writeUnifiedDiff(std::cout, oldContent, newContent);
+}
+
+bool Repository::diff(const std::vector<std::string> &args)
+{
+    TraceSpan span("diff");
+    if (!isInitialized())
+    {
+        std::cerr << "Error: not a MyGit repository.\n";
+        return false;
+    }
+
+    std::vector<FileChange> changes;
+    if (args.size() == 2)
+    {
+        ObjectId oldTree, newTree;
+        for (size_t i = 0; i < 2; i++)
+        {
+            ObjectId hash = resolveRevision(args[i]);
+            ObjectId tree = hash.empty() ? ObjectId() : readCommitTree(hash);
+            if (tree.empty())
+            {
+                std::cerr << "Error: unknown revision " << args[i] << "\n";
+                return false;
+            }
+            (i == 0 ? oldTree : newTree) = tree;
+        }
+        diffTrees(oldTree, newTree, "", changes);
+    }
+    else if (args.size() <= 1)
+    {
+        bool cached = args.size() == 1 && (args[0] == "--cached" || args[0] == "--staged");
+        if (args.size() == 1 && !cached)
+        {
+            std::cerr << "Usage: mygit diff [--cached | <commit> <commit>]\n";
+            return false;
+        }
+        Index index;
+        if (!index.load(path + "/index"))
+        {
+            std::cerr << "Error: index file is corrupt.\n";
+            return false;
+        }
+        if (cached)
+            diffIndexToHead(index, changes);
+        else
+            diffWorktreeToIndex(index, changes);
+    }
+    else
+    {
+        std::cerr << "Usage: mygit diff [--cached | <commit> <commit>]\n";
+        return false;
+    }
+
+    for (const auto &change : changes)
+        printFileChange(change);
+    return true;
+}
+
+// ---------- Checkout ----------
+
+bool Repository::materializeFile(const std::string &file, const ObjectId &hash, const std::string &mode)
+{
+    ::unlink(file.c_str()); // also replaces symlinks and read-only files cleanly
+    ObjectStore &store = objectStore();
+
+    if (mode == "120000")
+    {
+        std::string type, target;
+        return store.read(hash, type, target) && ::symlink(target.c_str(), file.c_str()) == 0;
+    }
+
+    mode_t perms = mode == "100755" ? 0755 : 0644;
+    int fd = ::open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, perms);
+    if (fd < 0)
+        return false;
+    bool ok = store.streamBlob(
+        hash, [&](const char *data, size_t size)
+        {
+            while (size > 0)
+            {
+                ssize_t n = ::write(fd, data, size);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    return false;
+                data += n;
+                size -= static_cast<size_t>(n);
+            }
+            return true;
+        });
+    ok = ::fchmod(fd, perms) == 0 && ok; // the umask must not change the recorded mode
+    return ::close(fd) == 0 && ok;
+}
+
+std::vector<std::string> Repository::blockedPaths(const Index &index, const std::vector<FileChange> &changes) const
+{
+    std::vector<std::string> conflicts;
+    for (const auto &change : changes)
+    {
+        auto it = index.entries.find(change.path);
+        bool stagedMatchesHead = change.oldHash.empty()
+                                     ? it == index.entries.end()
+                                     : it != index.entries.end() && it->second.hash == change.oldHash &&
+                                           gitMode(it->second.mode) == change.oldMode;
+        struct stat st;
+        bool onDisk = ::lstat(change.path.c_str(), &st) == 0;
+        bool dirty = !stagedMatchesHead;
+        if (!dirty && it == index.entries.end())
+        {
+            // Something untracked is in the way. A directory is fine if all it
+            // holds is tracked, since those files go away with the switch.
+            dirty = onDisk;
+            if (onDisk && S_ISDIR(st.st_mode))
+            {
+                std::error_code walkEc;
+                dirty = false;
+                for (auto f = fs::recursive_directory_iterator(change.path, walkEc);
+                     !walkEc && f != fs::recursive_directory_iterator(); f.increment(walkEc))
+                    if (!f->is_directory() && !index.entries.count(f->path().generic_string()))
+                        dirty = true;
+            }
+        }
+        else if (!dirty && onDisk && !index.isUpToDate(it->second, st))
+            dirty = gitMode(st.st_mode) != gitMode(it->second.mode) ||
+                    hashWorktreeFile(change.path, st) != it->second.hash;
+        if (dirty)
+            conflicts.push_back(change.path);
+    }
+    return conflicts;
+}
+
+bool Repository::applyChanges(Index &index, const std::vector<FileChange> &changes)
+{
+    // --- Deletions first, so a file can turn into a directory and back ---
+    std::error_code ec;
+    std::set<std::string> emptied;
+    std::vector<size_t> writes;
+    for (size_t i = 0; i < changes.size(); i++)
+    {
+        const FileChange &change = changes[i];
+        if (!change.newHash.empty())
+        {
+            writes.push_back(i);
+            continue;
+        }
+        fs::remove(change.path, ec);
+        index.remove(change.path);
+        for (fs::path dir = fs::path(change.path).parent_path(); !dir.empty(); dir = dir.parent_path())
+            emptied.insert(dir.string());
+    }
+    for (auto it = emptied.rbegin(); it != emptied.rend(); ++it) // deepest first
+        if (fs::is_empty(*it, ec))
+            fs::remove(*it, ec);
+
+    // Directories are created up front so the parallel writers never race on them
+    for (size_t i : writes)
+    {
+        fs::path parent = fs::path(changes[i].path).parent_path();
+        if (!parent.empty())
+            fs::create_directories(parent, ec);
+    }
+
+    // --- Write changed files in parallel ---
+    std::vector<IndexEntry> results(changes.size());
+    std::atomic<bool> failed{false};
+    {
+        TraceSpan writeSpan("checkout.write");
+        ThreadPool pool;
+        for (size_t i : writes)
+        {
+            pool.submit([&, i]
+                        {
+                const FileChange &change = changes[i];
+                struct stat st;
+                if (!materializeFile(change.path, change.newHash, change.newMode) ||
+                    ::lstat(change.path.c_str(), &st) != 0)
+                {
+                    std::cerr << "Error: cannot write " << change.path << "\n";
+                    failed = true;
+                    return;
+                }
+                results[i].path = change.path;
+                results[i].hash = change.newHash;
+                fillStatData(results[i], st); });
+        }
+        if (!pool.wait())
+        {
+            std::cerr << "Error: writing files failed: " << pool.error() << "\n";
+            failed = true;
+        }
+    }
+    for (size_t i : writes)
+        if (!results[i].path.empty())
+            index.stage(results[i]);
+
+
+    // Rebuild the cache tree for the directories that changed (objects already exist)
+    writeTreeFromIndex(index);
+    return !failed;
+}
+
+bool Repository::checkout(const std::string &target, bool createBranch)
+{
+    TraceSpan span("checkout");
+    if (!isInitialized())
+    {
+        std::cerr << "Error: not a MyGit repository.\n";
+        return false;
+    }
+
+    LockFile indexLock;
+    if (!indexLock.acquire(path + "/index"))
+        return false;
+    Index index;
+    if (!index.load(path + "/index"))
+    {
+        std::cerr << "Error: index file is corrupt.\n";
+        return false;
+    }
+
+    // --- Resolve what to switch to ---
+    ObjectId currentCommit = readHeadCommit();
+    ObjectId targetCommit;
+    bool toBranch = createBranch || branchExists(target);
+    if (createBranch)
+    {
+        if (!isValidBranchName(target) || branchExists(target))
+        {
+            std::cerr << "Error: cannot create branch '" << target << "'.\n";
+            return false;
+        }
+        targetCommit = currentCommit;
+    }
+    else
+    {
+        if (toBranch && target == currentBranch())
+        {
+            std::cout << "Already on '" << target << "'\n";
+            return true;
+        }
+        targetCommit = resolveRevision(target);
+        if (targetCommit.empty() || readCommitTree(targetCommit).empty())
+        {
+            std::cerr << "Error: pathspec '" << target << "' did not match any branch or commit.\n";
+            return false;
+        }
+    }
+
+    ObjectId currentTree = currentCommit.empty() ? ObjectId() : readCommitTree(currentCommit);
+    ObjectId targetTree = targetCommit.empty() ? ObjectId() : readCommitTree(targetCommit);
+    std::vector<FileChange> changes;
+    diffTrees(currentTree, targetTree, "", changes);
+
+    std::vector<std::string> conflicts = blockedPaths(index, changes);
+    if (!conflicts.empty())
+    {
+        std::cerr << "Error: your local changes to the following files would be overwritten by checkout:\n";
+        for (const auto &file : conflicts)
+            std::cerr << "    " << file << "\n";
+        std::cerr << "Commit them or undo them before you switch.\n";
+        return false;
+    }
+
+    bool written = applyChanges(index, changes);
+    if (!index.save(indexLock))
+    {
+        std::cerr << "Error: cannot write index.\n";
+        return false;
+    }
+    if (!written)
+        return false;
+
+    // --- Move HEAD ---
+    if (createBranch)
+    {
+        if (!currentCommit.empty())
+        {
+            RefTransaction transaction(path);
+            transaction.update("refs/heads/" + target, currentCommit, ObjectId());
+            if (!transaction.commit())
+                return false;
+        }
+        writeRef("HEAD", "ref: refs/heads/" + target + "\n");
+        std::cout << "Switched to a new branch '" << target << "'\n";
+    }
+    else if (toBranch)
+    {
+        writeRef("HEAD", "ref: refs/heads/" + target + "\n");
+        std::cout << "Switched to branch '" << target << "'\n";
+    }
+    else
+    {
+        writeRef("HEAD", targetCommit.hex() + "\n");
+        std::cout << "HEAD is now at " << targetCommit.hex().substr(0, 7) << "\n";
+    }
+    if (changes.size() > 0)
+        std::cout << "Updated " << changes.size() << " path(s).\n";
+    return true;
+}
+
+// ---------- Merge ----------
+
+ObjectId Repository::readMergeHead() const
+{
+    std::string hash;
+    std::ifstream(path + "/MERGE_HEAD") >> hash;
+    return ObjectId::fromHex(hash);
+}
+
+std::vector<std::string> Repository::readMergeConflicts() const
+{
+    std::vector<std::string> conflicts;
+    std::ifstream in(path + "/MERGE_CONFLICTS");
+    std::string line;
+    while (std::getline(in, line))
+        if (!line.empty())
+            conflicts.push_back(line);
+    return conflicts;
+}
+
+bool Repository::writeMergeState(const ObjectId &theirs, const std::vector<std::string> &conflicts)
+{
+    std::string list;
+    for (const auto &file : conflicts)
+        list += file + "\n";
+    std::error_code ec;
+    fs::remove(path + "/MERGE_CONFLICTS", ec);
+    return writeRef("MERGE_HEAD", theirs.hex() + "\n") && (list.empty() || writeRef("MERGE_CONFLICTS", list));
+}
+
+void Repository::clearMergeState()
+{
+    std::error_code ec;
+    fs::remove(path + "/MERGE_HEAD", ec);
+    fs::remove(path + "/MERGE_CONFLICTS", ec);
+}
+
+bool Repository::mergeTrees(const ObjectId &base, const ObjectId &ours, const ObjectId &theirs,
+                            const std::string &prefix, const std::string &theirsLabel,
+                            std::vector<std::string> &conflicts, ObjectId &result)
+{
+    // Only one side changed, or both the same way: that tree is the result as is
+    if (ours == theirs || base == theirs)
+    {
+        result = ours;
+        return true;
+    }
+    if (base == ours)
+    {
+        result = theirs;
+        return true;
+    }
+
+    // --- Line up the entries of the three trees by name ---
+    ObjectStore &store = objectStore();
+    const ObjectId *trees[3] = {&base, &ours, &theirs};
+    std::string type;
+    ObjectCache::Buffer contents[3];
+    std::vector<TreeEntryView> views[3];
+    for (int i = 0; i < 3; i++)
+    {
+        if (trees[i]->empty())
+            continue;
+        contents[i] = store.load(*trees[i], type);
+        if (!contents[i] || type != "tree")
+        {
+            std::cerr << "Error: cannot read tree " << *trees[i] << "\n";
+            return false;
+        }
+        for (const auto &entry : TreeView(*contents[i]))
+            views[i].push_back(entry);
+    }
+    std::map<std::string_view, std::array<const TreeEntryView *, 3>> byName;
+    for (int i = 0; i < 3; i++)
+        for (const auto &entry : views[i])
+            byName[entry.name][i] = &entry;
+
+    auto same = [](const TreeEntryView *x, const TreeEntryView *y)
+    { return x && y ? x->mode == y->mode && x->rawHash == y->rawHash : x == y; };
+    auto isTree = [](const TreeEntryView *e)
+    { return e && e->mode == "40000"; };
+
+    Tree tree;
+    for (const auto &[name, side] : byName)
+    {
+        const TreeEntryView *b = side[0], *o = side[1], *t = side[2];
+        std::string file = prefix + std::string(name);
+        TreeEntry entry;
+        entry.name = std::string(name);
+
+        const TreeEntryView *pick = nullptr;
+        if (same(o, t) || same(b, t))
+            pick = o;
+        else if (same(b, o))
+            pick = t;
+        else if ((!b || isTree(b)) && (!o || isTree(o)) && (!t || isTree(t)))
+        {
+            // Directories on every side that has the name: conflicts are found per file
+            if (!mergeTrees(b ? b->hash() : ObjectId(), o ? o->hash() : ObjectId(), t ? t->hash() : ObjectId(),
+                            file + "/", theirsLabel, conflicts, entry.hash))
+                return false;
+            if (entry.hash.empty())
+                continue; // everything below was deleted
+            entry.mode = "40000";
+            tree.entries.push_back(entry);
+            continue;
+        }
+        else if (o && t && !isTree(o) && !isTree(t))
+        {
+            // --- Changed on both sides: merge the contents line by line ---
+            std::cout << "Auto-merging " << file << "\n";
+            std::string baseText, oursText, theirsText, merged;
+            bool chunked = store.isChunkList(o->hash()) || store.isChunkList(t->hash());
+            if (!chunked && ((b && !isTree(b) && !store.readBlob(b->hash(), baseText)) ||
+                             !store.readBlob(o->hash(), oursText) || !store.readBlob(t->hash(), theirsText)))
+            {
+                std::cerr << "Error: cannot read contents of " << file << "\n";
+                return false;
+            }
+            bool clean = false;
+            if (chunked)
+            {
+                entry.mode.assign(o->mode); // large binary: keep ours as it is stored
+                entry.hash = o->hash();
+                std::cout << "CONFLICT (content): Merge conflict in " << file << "\n";
+                conflicts.push_back(file);
+                tree.entries.push_back(entry);
+                continue;
+            }
+            if (o->mode == "120000" || t->mode == "120000" || isBinaryContent(oursText) || isBinaryContent(theirsText))
+            {
+                merged = oursText; // no line merge for symlinks and binaries: keep ours
+                entry.mode.assign(o->mode);
+            }
+            else
+            {
+                clean = mergeLines(baseText, oursText, theirsText, "HEAD", theirsLabel, merged);
+                entry.mode.assign(b && b->mode == o->mode ? t->mode : o->mode);
+            }
+            if (!clean)
+            {
+                std::cout << "CONFLICT (content): Merge conflict in " << file << "\n";
+                conflicts.push_back(file);
+            }
+            entry.hash = store.write("blob", merged);
+            if (entry.hash.empty())
+                return false;
+            tree.entries.push_back(entry);
+            continue;
+        }
+        else
+        {
+            // Deleted on one side and changed on the other, or a file against a
+            // directory: keep what is there (ours first) and let the user decide
+            pick = o ? o : t;
+            std::cout << "CONFLICT (" << (o && t ? "file/directory" : "modify/delete") << "): " << file << "\n";
+            conflicts.push_back(file);
+        }
+
+        if (pick)
+        {
+            entry.mode.assign(pick->mode);
+            entry.hash = pick->hash();
+            tree.entries.push_back(entry);
+        }
+    }
+
+    result = ObjectId();
+    if (tree.entries.empty())
+        return true;
+    sortTreeEntries(tree);
+    result = writeTree(tree);
+    return !result.empty();
+}
+
+bool Repository::merge(const std::string &rev)
+{
+    TraceSpan span("merge");
+    if (!isInitialized())
+    {
+        std::cerr << "Error: not a MyGit repository.\n";
+        return false;
+    }
+    if (!readMergeHead().empty())
+    {
+        std::cerr << "Error: a merge is in progress; resolve it and commit first.\n";
+        return false;
+    }
+
+    ObjectId ours = readHeadCommit();
+    ObjectId theirs = resolveRevision(rev);
+    if (ours.empty())
+    {
+        std::cerr << "Error: no commits yet.\n";
+        return false;
+    }
+    if (theirs.empty() || readCommitTree(theirs).empty())
+    {
+        std::cerr << "Error: not something we can merge: " << rev << "\n";
+        return false;
+    }
+
+    // --- Merge base: generation-ordered walk over the commit-graph ---
+    // the second lookup may have rewritten the graph, so resolve HEAD again
+    TraceSpan baseSpan("merge.base");
+    uint32_t posOurs, posTheirs;
+    if (!graphPosition("HEAD", posOurs) || !graphPosition(theirs.hex(), posTheirs) || !graphPosition("HEAD", posOurs))
+        return false;
+    const CommitGraph &graph = commitGraph();
+    std::vector<uint32_t> bases = graph.mergeBases(posOurs, posTheirs);
+    baseSpan.stop();
+    bool fastForward = false;
+    for (uint32_t base : bases)
+    {
+        if (base == posTheirs)
+        {
+            std::cout << "Already up to date.\n";
+            return true;
+        }
+        fastForward = fastForward || base == posOurs;
+    }
+
+    LockFile indexLock;
+    if (!indexLock.acquire(path + "/index"))
+        return false;
+    Index index;
+    if (!index.load(path + "/index"))
+    {
+        std::cerr << "Error: index file is corrupt.\n";
+        return false;
+    }
+    // The merge result is staged on top of HEAD, so nothing else may be staged
+    std::vector<FileChange> staged;
+    diffIndexToHead(index, staged);
+    if (!staged.empty())
+    {
+        std::cerr << "Error: you have staged changes; commit them before you merge.\n";
+        return false;
+    }
+
+    // --- Merged tree (with several merge bases the first one is used) ---
+    ObjectId oursTree = readCommitTree(ours), theirsTree = readCommitTree(theirs);
+    ObjectId mergedTree = theirsTree;
+    std::vector<std::string> conflicts;
+    if (!fastForward)
+    {
+        TraceSpan treeSpan("merge.trees");
+        ObjectId baseTree = bases.empty() ? ObjectId() : readCommitTree(graph.hashAt(bases[0]));
+        if (!mergeTrees(baseTree, oursTree, theirsTree, "", rev, conflicts, mergedTree))
+            return false;
+        if (mergedTree.empty())
+            mergedTree = writeTree(Tree());
+    }
+
+    // --- Update the working tree and index like a checkout of the merged tree ---
+    std::vector<FileChange> changes;
+    diffTrees(oursTree, mergedTree, "", changes);
+    std::vector<std::string> blocked = blockedPaths(index, changes);
+    if (!blocked.empty())
+    {
+        std::cerr << "Error: your local changes to the following files would be overwritten by merge:\n";
+        for (const auto &file : blocked)
+            std::cerr << "    " << file << "\n";
+        std::cerr << "Commit them or undo them before you merge.\n";
+        return false;
+    }
+    bool written = applyChanges(index, changes);
+    if (!index.save(indexLock))
+    {
+        std::cerr << "Error: cannot write index.\n";
+        return false;
+    }
+    if (!written)
+        return false;
+
+    if (fastForward)
+    {
+        std::cout << "Updating " << ours.hex().substr(0, 7) << ".." << theirs.hex().substr(0, 7) << "\nFast-forward\n";
+        if (changes.size() > 0)
+            std::cout << "Updated " << changes.size() << " path(s).\n";
+        return updateHead(theirs, ours);
+    }
+
+    if (!writeMergeState(theirs, conflicts))
+        return false;
+    if (!conflicts.empty())
+    {
+        std::cout << "Automatic merge failed; fix conflicts and then commit the result.\n";
+        return false;
+    }
+    return !commit("Merge " + std::string(branchExists(rev) ? "branch '" : "commit '") + rev + "'").empty();
+}
+
+bool Repository::gc()
+{
+    TraceSpan span("gc");
+    if (!isInitialized())
+    {
+        std::cerr << "Error: not a MyGit repository.\n";
+        return false;
+    }
+
+    size_t packedRefs;
+    if (!packRefs(path, packedRefs))
+        std::cerr << "Warning: could not pack refs.\n";
+
+    ObjectStore &store = objectStore();
+    std::string objectsDir = path + "/objects";
+    std::string packDir = objectsDir + "/pack";
+
+    // --- Collect loose objects and everything already packed (full repack) ---
+    std::set<ObjectId> hashes;
+    std::vector<std::string> looseFiles;
+    for (auto &fan : fs::directory_iterator(objectsDir))
+    {
+        std::string prefix = fan.path().filename().string();
+        if (prefix.size() != 2 || !fan.is_directory())
+            continue;
+        for (auto &obj : fs::directory_iterator(fan.path()))
+        {
+            ObjectId hash = ObjectId::fromHex(prefix + obj.path().filename().string());
+            if (hash.empty())
+                continue; // not an object (e.g. a leftover temp file)
+            hashes.insert(hash);
+            looseFiles.push_back(obj.path().string());
+        }
+    }
+
+    std::vector<std::string> oldPacks;
+    for (const auto &pack : store.packs())
+    {
+        oldPacks.push_back(pack->packPath);
+        for (uint32_t i = 0; i < pack->size(); i++)
+            hashes.insert(pack->hashAt(i));
+    }
+
+    if (hashes.empty())
+    {
+        std::cout << "Nothing to pack.\n";
+        return true;
+    }
+
+    // --- Only ids, types and sizes are kept; writePack loads each object when it gets to it ---
+    std::vector<PackInput> objects;
+    objects.reserve(hashes.size());
+    for (const auto &hash : hashes)
+    {
+        PackInput obj;
+        obj.hash = hash;
+        if (!store.info(hash, obj.type, obj.size))
+        {
+            std::cerr << "Error: cannot read object " << hash << "\n";
+            return false;
+        }
+        objects.push_back(std::move(obj));
+    }
+
+    // --- Name hints: blobs that share a file name are the best delta candidates ---
+    std::unordered_map<ObjectId, std::string> names;
+    std::string type, content;
+    for (const auto &obj : objects)
+    {
+        if (obj.type != "tree")
+            continue;
+        if (!store.readUncached(obj.hash, type, content))
+        {
+            std::cerr << "Error: cannot read object " << obj.hash << "\n";
+            return false;
+        }
+        for (const auto &entry : TreeView(content))
+            names[entry.hash()] = fs::path(entry.name).filename().string();
+    }
+    for (auto &obj : objects)
+    {
+        auto it = names.find(obj.hash);
+        if (it != names.end())
+            obj.nameHint = it->second;
+    }
+    names.clear();
+
+    // Every object is read exactly once more: keep them out of the cache.
+    // Commits are parsed for the commit-graph on the way.
+    std::vector<CommitGraphEntry> commits;
+    auto load = [&](const PackInput &obj, std::string &out)
+    {
+        if (!store.readUncached(obj.hash, type, out))
+        {
+            std::cerr << "Error: cannot read object " << obj.hash << "\n";
+            return false;
+        }
+        CommitGraphEntry entry;
+        if (type == "commit" && parseCommitEntry(obj.hash, out, entry))
+            commits.push_back(std::move(entry));
+        return true;
+    };
+
+    fs::create_directories(packDir);
+    std::string packName;
+    PackStats stats;
+    if (!writePack(packDir, objects, load, packName, stats))
+    {
+        std::cerr << "Error: cannot write pack.\n";
+        return false;
+    }
+
+    // --- Make sure the new pack serves every object before deleting anything ---
+    Pack pack;
+    if (!pack.open(packDir + "/" + packName + ".pack"))
+    {
+        std::cerr << "Error: cannot read back new pack.\n";
+        return false;
+    }
+    for (const auto &hash : hashes)
+    {
+        if (!pack.contains(hash))
+        {
+            std::cerr << "Error: new pack is missing " << hash << "\n";
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    for (const auto &file : looseFiles)
+        fs::remove(file, ec);
+    for (auto &fan : fs::directory_iterator(objectsDir))
+    {
+        if (fan.path().filename().string().size() == 2 && fs::is_empty(fan.path(), ec))
+            fs::remove(fan.path(), ec);
+    }
+    for (const auto &old : oldPacks)
+    {
+        if (fs::path(old).filename() == packName + ".pack")
+            continue;
+        fs::remove(old, ec);
+        fs::remove(old.substr(0, old.size() - 5) + ".idx", ec);
+        fs::remove(PackBitmaps::pathFor(old), ec);
+    }
+    store.reloadPacks();
+
+    // --- Rebuild the commit-graph from every commit that was packed ---
+    LockFile graphLock;
+    if (!commits.empty() && lockCommitGraph(graphLock))
+        writeGraphFile(graphLock, std::move(commits));
+
+    // --- Reachability bitmaps for the new pack (everything reachable is in it) ---
+    if (!writeBitmaps(pack, objects))
+        std::cerr << "Warning: could not write reachability bitmaps.\n";
+
+    std::cout << "Packed " << stats.objects << " objects (" << stats.deltas << " deltas) into "
+              << packName << ".pack: " << (stats.bytesIn + 1023) / 1024 << " KiB -> "
+              << (stats.bytesOut + 1023) / 1024 << " KiB\n";
+    return true;
+}
+
+// ---------- Refs ----------
+bool Repository::updateRefs(const std::vector<std::string> &options)
+{
+    if (!isInitialized())
+    {
+        std::cerr << "Error: not a MyGit repository.\n";
+        return false;
+    }
+    bool noDeref = !options.empty() && options[0] == "--no-deref";
+    std::vector<std::string> args(options.begin() + (noDeref ? 1 : 0), options.end());
+
+    // --- A value: empty or all zeros means "no ref" ---
+    auto value = [&](const std::string &rev, ObjectId &id)
+    {
+        id = ObjectId();
+        if (rev.empty() || rev.find_first_not_of('0') == std::string::npos)
+            return true;
+        id = resolveRevision(rev);
+        if (id.empty())
+            std::cerr << "Error: not a valid object name: " << rev << "\n";
+        return !id.empty();
+    };
+    auto validName = [](const std::string &ref)
+    {
+        bool ok = ref == "HEAD" || (ref.compare(0, 5, "refs/") == 0 && isValidBranchName(ref.substr(5)));
+        if (!ok)
+            std::cerr << "Error: invalid ref name: " << ref << "\n";
+        return ok;
+    };
+    // A symbolic HEAD stands for its branch, as in updateHead; --no-deref writes HEAD itself
+    std::string headRef = noDeref ? "" : readHeadRef();
+    auto target = [&](const std::string &ref)
+    { return ref == "HEAD" && !headRef.empty() ? headRef : ref; };
+
+    RefTransaction transaction(path);
+    ObjectId newId, oldId;
+    if (args.size() == 1 && args[0] == "--stdin")
+    {
+        // update <ref> <new> [<old>] | create <ref> <new> | delete <ref> [<old>] | verify <ref> [<old>]
+        std::string line;
+        while (std::getline(std::cin, line))
+        {
+            std::istringstream in(line);
+            std::string command, ref, first, second;
+            in >> command >> ref >> first >> second;
+            if (command.empty())
+                continue;
+            if (!validName(ref))
+                return false;
+            ref = target(ref);
+            if (command == "update" && !first.empty() && value(first, newId) && value(second, oldId))
+                second.empty() ? transaction.update(ref, newId) : transaction.update(ref, newId, oldId);
+            else if (command == "create" && !first.empty() && value(first, newId))
+                transaction.update(ref, newId, ObjectId());
+            else if (command == "delete" && value(first, oldId))
+                first.empty() ? transaction.remove(ref) : transaction.remove(ref, oldId);
+            else if (command == "verify" && value(first, oldId))
+                transaction.verify(ref, oldId);
+            else
+            {
+                std::cerr << "Error: bad update-ref line: " << line << "\n";
+                return false;
+            }
+        }
+        return transaction.commit();
+    }
+
+    bool remove = !args.empty() && args[0] == "-d";
+    size_t n = args.size() - (remove ? 1 : 0);
+    if (remove ? n < 1 || n > 2 : n < 2 || n > 3)
+    {
+        std::cerr << "Usage: mygit update-ref [--no-deref] [-d] <ref> [<new>] [<old>]\n"
+                     "       mygit update-ref [--no-deref] --stdin\n";
+        return false;
+    }
+    if (!validName(args[remove ? 1 : 0]))
+        return false;
+    const std::string ref = target(args[remove ? 1 : 0]);
+    if (remove)
+    {
+        if (n == 2 && !value(args[2], oldId))
+            return false;
+        n == 2 ? transaction.remove(ref, oldId) : transaction.remove(ref);
+    }
+    else
+    {
+        if (!value(args[1], newId) || (n == 3 && !value(args[2], oldId)))
+            return false;
+        if (newId.empty())
+        {
+            std::cerr << "Error: " << args[1] << " is not a valid new value (use -d to delete).\n";
+            return false;
+        }
+        n == 3 ? transaction.update(ref, newId, oldId) : transaction.update(ref, newId);
+    }
+    return transaction.commit();
+}
+
+bool Repository::packAllRefs()
+{
+    if (!isInitialized())
+    {
+        std::cerr << "Error: not a MyGit repository.\n";
+        return false;
+    }
+    size_t count;
+    if (!packRefs(path, count))
+    {
+        std::cerr << "Error: cannot write packed-refs.\n";
+        return false;
+    }
+    std::cout << "Packed " << count << " ref(s).\n";
+    return true;
+}
+
+// ---------- Reachability ----------
+std::vector<ObjectId> Repository::refTips() const
+{
+    std::vector<ObjectId> tips;
+    for (const auto &ref : listRefs(path, "refs/"))
+        tips.push_back(ref.second);
+    for (const ObjectId &id : {readHeadCommit(), readMergeHead()})
+        if (!id.empty())
+            tips.push_back(id);
+    std::sort(tips.begin(), tips.end());
+    tips.erase(std::unique(tips.begin(), tips.end()), tips.end());
+    return tips;
+}
+
+std::shared_ptr<Pack> Repository::bitmappedPack(PackBitmaps &bitmaps) const
+{
+    for (const auto &pack : objectStore().packs())
+        if (bitmaps.load(*pack))
+            return pack;
+    return nullptr;
+}
+
+bool Repository::markReachable(const std::vector<ObjectId> &roots, ObjectPositions &positions,
+                               const std::function<bool(const ObjectId &, Bitmap &)> &bitmapOf, Bitmap &result) const
+{
+    TraceSpan span("reach.walk");
+    ObjectStore &store = objectStore();
+    const CommitGraph &graph = commitGraph();
+    std::vector<ObjectId> commits, trees, blobs;
+    auto unseen = [&](const ObjectId &id)
+    { return !result.get(positions.position(id)); };
+
+    for (const auto &root : roots)
+    {
+        std::string type;
+        uint64_t size;
+        if (!store.info(root, type, size))
+        {
+            std::cerr << "Error: missing object " << root << "\n";
+            return false;
+        }
+        (type == "commit" ? commits : type == "tree" ? trees : blobs).push_back(root);
+    }
+
+    // --- Commits first: a commit with a bitmap ends the walk down its line ---
+    Bitmap stored;
+    while (!commits.empty())
+    {
+        ObjectId commit = commits.back();
+        commits.pop_back();
+        if (!unseen(commit))
+            continue;
+        if (bitmapOf && bitmapOf(commit, stored))
+        {
+            traceCount("reach.bitmap");
+            result |= stored;
+            continue;
+        }
+        traceCount("reach.commit");
+        result.set(positions.position(commit));
+
+        uint32_t pos;
+        if (graph.find(commit, pos))
+        {
+            trees.push_back(graph.treeAt(pos));
+            graph.forEachParent(pos, [&](uint32_t parent)
+                                { commits.push_back(graph.hashAt(parent)); });
+            continue;
+        }
+        CommitGraphEntry entry;
+        if (!readCommitEntry(commit, entry))
+        {
+            std::cerr << "Error: cannot read commit " << commit << "\n";
+            return false;
+        }
+        trees.push_back(entry.tree);
+        commits.insert(commits.end(), entry.parents.begin(), entry.parents.end());
+    }
+
+    // --- Then trees, so that whatever the bitmaps cover is never read ---
+    while (!trees.empty())
+    {
+        ObjectId tree = trees.back();
+        trees.pop_back();
+        if (!unseen(tree))
+            continue;
+        result.set(positions.position(tree));
+        std::string type;
+        ObjectCache::Buffer content = store.load(tree, type);
+        if (!content || type != "tree")
+        {
+            std::cerr << "Error: cannot read tree " << tree << "\n";
+            return false;
+        }
+        traceCount("reach.tree");
+        for (const auto &entry : TreeView(*content))
+        {
+            if (entry.mode == "160000")
+                continue; // a submodule commit lives in another repository
+            ObjectId id = entry.hash();
+            if (unseen(id))
+                (entry.mode == "40000" ? trees : blobs).push_back(id);
+        }
+    }
+
+    // --- Blobs (and tags); a chunk list brings its chunks along ---
+    std::string list, type;
+    for (const auto &blob : blobs)
+    {
+        if (!unseen(blob))
+            continue;
+        result.set(positions.position(blob));
+        if (!store.isChunkList(blob))
+            continue;
+        if (!store.read(blob, type, list) ||
+            !ObjectStore::forEachChunk(list, [&](const ObjectId &chunk, uint32_t)
+                                       { result.set(positions.position(chunk)); return true; }))
+        {
+            std::cerr << "Error: cannot read chunk list " << blob << "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Repository::writeBitmaps(const Pack &pack, const std::vector<PackInput> &objects)
+{
+    TraceSpan span("gc.bitmaps");
+    Bitmap kinds[4];
+    for (const auto &obj : objects)
+    {
+        uint32_t pos;
+        if (!pack.findPosition(obj.hash, pos))
+            return false;
+        kinds[obj.type == "commit" ? PackBitmaps::COMMITS
+              : obj.type == "tree" ? PackBitmaps::TREES
+              : obj.type == "blob" ? PackBitmaps::BLOBS
+                                   : PackBitmaps::OTHERS]
+            .set(pos);
+    }
+
+    // --- Select the ref tips and every BITMAP_INTERVAL-th generation ---
+    // Following the highest-generation parent lowers the generation by exactly
+    // one per step, so from any commit a selected one is at most that far away.
+    const CommitGraph &graph = commitGraph();
+    std::vector<uint32_t> selected;
+    std::vector<char> isTip(graph.size(), 0);
+    for (const auto &tip : refTips())
+    {
+        uint32_t pos;
+        if (graph.find(tip, pos))
+            isTip[pos] = 1;
+    }
+    for (uint32_t pos = 0; pos < graph.size(); pos++)
+        if (isTip[pos] || graph.generationAt(pos) % BITMAP_INTERVAL == 0)
+            selected.push_back(pos);
+    std::sort(selected.begin(), selected.end(), [&](uint32_t a, uint32_t b)
+              { return graph.generationAt(a) < graph.generationAt(b); });
+
+    // --- Oldest first, so each walk stops at the bitmaps built before it ---
+    std::unordered_map<ObjectId, size_t> built;
+    std::vector<std::pair<ObjectId, Bitmap>> commits;
+    ObjectPositions positions(&pack);
+    auto bitmapOf = [&](const ObjectId &id, Bitmap &out)
+    {
+        auto it = built.find(id);
+        if (it == built.end())
+            return false;
+        out = commits[it->second].second;
+        return true;
+    };
+    for (uint32_t pos : selected)
+    {
+        ObjectId commit = graph.hashAt(pos);
+        Bitmap reach;
+        if (!markReachable({commit}, positions, bitmapOf, reach) || positions.hasExtra())
+            return false; // something reachable is not in the pack
+        built[commit] = commits.size();
+        commits.emplace_back(commit, std::move(reach));
+    }
+    return writePackBitmaps(pack, kinds, std::move(commits));
+}
+
+bool Repository::revListObjects(const std::vector<std::string> &include, const std::vector<std::string> &exclude,
+                                bool countOnly)
+{
+    if (!isInitialized())
+    {
+        std::cerr << "Error: not a MyGit repository.\n";
+        return false;
+    }
+    auto resolveAll = [&](const std::vector<std::string> &revs, std::vector<ObjectId> &ids)
+    {
+        for (const auto &rev : revs)
+        {
+            if (rev == "--all")
+            {
+                std::vector<ObjectId> tips = refTips();
+                ids.insert(ids.end(), tips.begin(), tips.end());
+                continue;
+            }
+            ObjectId id = resolveObject(rev);
+            if (id.empty())
+            {
+                std::cerr << "Error: unknown revision " << rev << "\n";
+                return false;
+            }
+            ids.push_back(id);
+        }
+        return true;
+    };
+    std::vector<ObjectId> wantIds, haveIds;
+    if (!resolveAll(include, wantIds) || !resolveAll(exclude, haveIds))
+        return false;
+
+    PackBitmaps bitmaps;
+    std::shared_ptr<Pack> pack = bitmappedPack(bitmaps);
+    ObjectPositions positions(pack.get());
+    auto bitmapOf = [&](const ObjectId &id, Bitmap &out)
+    { return pack && bitmaps.find(id, out); };
+
+    Bitmap want, have;
+    if (!markReachable(wantIds, positions, bitmapOf, want) || !markReachable(haveIds, positions, bitmapOf, have))
+        return false;
+    want.andNot(have);
+
+    if (countOnly)
+        std::cout << want.count() << "\n";
+    else
+        want.forEach([&](size_t pos)
+                     { std::cout << positions.idAt(static_cast<uint32_t>(pos)) << "\n"; });
+    return true;
+}
+
+bool Repository::countObjects(bool verbose)
+{
+    if (!isInitialized())
+    {
+        std::cerr << "Error: not a MyGit repository.\n";
+        return false;
+    }
+    std::error_code ec;
+    uint64_t loose = 0, looseBytes = 0;
+    for (auto &fan : fs::directory_iterator(path + "/objects", ec))
+    {
+        std::string prefix = fan.path().filename().string();
+        if (prefix.size() != 2 || !fan.is_directory())
+            continue;
+        for (auto &obj : fs::directory_iterator(fan.path(), ec))
+        {
+            if (ObjectId::fromHex(prefix + obj.path().filename().string()).empty())
+                continue;
+            loose++;
+            looseBytes += obj.file_size(ec);
+        }
+    }
+    if (!verbose)
+    {
+        std::cout << loose << " objects, " << (looseBytes + 1023) / 1024 << " kilobytes\n";
+        return true;
+    }
+
+    ObjectStore &store = objectStore();
+    uint64_t packed = 0, packBytes = 0;
+    for (const auto &pack : store.packs())
+    {
+        packed += pack->size();
+        std::string base = pack->packPath.substr(0, pack->packPath.size() - 5);
+        for (const char *ext : {".pack", ".idx", ".bitmap"})
+        {
+            uint64_t size = fs::file_size(base + ext, ec);
+            packBytes += ec ? 0 : size;
+        }
+    }
+    std::cout << "count: " << loose << "\n"
+              << "size: " << (looseBytes + 1023) / 1024 << "\n"
+              << "in-pack: " << packed << "\n"
+              << "packs: " << store.packs().size() << "\n"
+              << "size-pack: " << (packBytes + 1023) / 1024 << "\n";
+
+    // --- What the refs reach, by kind: packed objects through the type bitmaps ---
+    PackBitmaps bitmaps;
+    std::shared_ptr<Pack> pack = bitmappedPack(bitmaps);
+    ObjectPositions positions(pack.get());
+    Bitmap reach;
+    if (!markReachable(refTips(), positions, [&](const ObjectId &id, Bitmap &out)
+                       { return pack && bitmaps.find(id, out); },
+                       reach))
+        return false;
+    uint64_t kinds[4] = {0, 0, 0, 0};
+    if (pack)
+    {
+        for (int kind = PackBitmaps::COMMITS; kind <= PackBitmaps::OTHERS; kind++)
+        {
+            Bitmap of = reach;
+            of &= bitmaps.ofKind(static_cast<PackBitmaps::ObjectKind>(kind));
+            kinds[kind] = of.count();
+        }
+    }
+    reach.forEach([&](size_t pos)
+                  {
+        if (pos < positions.packedCount())
+            return;
+        std::string type;
+        uint64_t size;
+        if (store.info(positions.idAt(static_cast<uint32_t>(pos)), type, size))
+            kinds[type == "commit" ? 0 : type == "tree" ? 1 : type == "blob" ? 2 : 3]++; });
+    std::cout << "reachable: " << reach.count() << " (" << kinds[0] << " commits, " << kinds[1] << " trees, "
+              << kinds[2] << " blobs, " << kinds[3] << " other)\n"
+              << "bitmaps: " << (pack ? bitmaps.size() : 0) << "\n";
+    return true;
+}
+
+bool Repository::parseExpiry(const std::string &spec, time_t now, time_t &cutoff)
+{
+    if (spec == "now" || spec == "never")
+    {
+        cutoff = spec == "now" ? now : 0; // never: nothing is old enough
+        return true;
+    }
+    size_t dot = spec.find('.');
+    if (dot == 0 || dot == std::string::npos || spec.size() < 4 || spec.compare(spec.size() - 4, 4, ".ago") != 0 ||
+        spec.find_first_not_of("0123456789") != dot)
+        return false;
+    std::string unit = spec.substr(dot + 1, spec.size() - 4 - dot - 1);
+    if (unit.size() > 1 && unit.back() == 's')
+        unit.pop_back();
+    static const std::map<std::string, time_t> seconds = {
+        {"second", 1}, {"minute", 60}, {"hour", 3600}, {"day", 86400}, {"week", 7 * 86400}};
+    auto it = seconds.find(unit);
+    if (it == seconds.end())
+        return false;
+    // The count must not reach back past the epoch: that also keeps the product in range
+    uint64_t count = 0;
+    auto [end, ec] = std::from_chars(spec.data(), spec.data() + dot, count);
+    if (ec != std::errc() || end != spec.data() + dot || now < 0 ||
+        count > static_cast<uint64_t>(now / it->second))
+        return false;
+    cutoff = now - static_cast<time_t>(count) * it->second;
+    return true;
+}
+
+bool Repository::prune(bool dryRun, time_t expire)
+{
+    TraceSpan span("prune");
+    if (!isInitialized())
+    {
+        std::cerr << "Error: not a MyGit repository.\n";
+        return false;
+    }
+
+    // --- Roots: the refs, plus whatever the index holds (staged, not yet committed) ---
+    // An unreadable index would hide staged objects: better prune nothing
+    std::vector<ObjectId> roots = refTips();
+    Index index;
+    if (!index.load(path + "/index"))
+    {
+        std::cerr << "Error: index file is corrupt.\n";
+        return false;
+    }
+    for (const auto &entry : index.entries)
+        roots.push_back(entry.second.hash);
+    for (const auto &tree : index.cacheTree)
+        roots.push_back(tree.second);
+
+    PackBitmaps bitmaps;
+    std::shared_ptr<Pack> pack = bitmappedPack(bitmaps);
+    ObjectPositions positions(pack.get());
+    Bitmap reach;
+    if (!markReachable(roots, positions, [&](const ObjectId &id, Bitmap &out)
+                       { return pack && bitmaps.find(id, out); },
+                       reach))
+    {
+        std::cerr << "Error: not pruning, reachability is incomplete.\n";
+        return false;
+    }
+
+    ObjectStore &store = objectStore();
+    size_t pruned = 0;
+    std::error_code ec;
+    for (auto &fan : fs::directory_iterator(path + "/objects", ec))
+    {
+        std::string prefix = fan.path().filename().string();
+        if (prefix.size() != 2 || !fan.is_directory())
+            continue;
+        for (auto &obj : fs::directory_iterator(fan.path(), ec))
+        {
+            ObjectId id = ObjectId::fromHex(prefix + obj.path().filename().string());
+            if (id.empty() || reach.get(positions.position(id)))
+                continue;
+            struct stat st;
+            if (::lstat(obj.path().c_str(), &st) != 0 || expire == 0 || st.st_mtime > expire)
+                continue; // too recent: may be about to be referenced
+            if (dryRun)
+            {
+                std::string type;
+                uint64_t size;
+                store.info(id, type, size);
+                std::cout << id << " " << type << "\n";
+            }
+            else if (!fs::remove(obj.path(), ec))
+                continue;
+            pruned++;
+        }
+        if (!dryRun && fs::is_empty(fan.path(), ec))
+            fs::remove(fan.path(), ec);
+    }
+    if (!dryRun)
+        std::cout << "Pruned " << pruned << " unreachable object(s).\n";
+    return true;
+}
+
+// ---------- fsck ----------
+bool Repository::fsck(bool showDangling)
+{
+    TraceSpan span("fsck");
+    if (!isInitialized())
+    {
+        std::cerr << "Error: not a MyGit repository.\n";
+        return false;
+    }
+    auto start = std::chrono::steady_clock::now();
+    ObjectStore &store = objectStore();
+
+    // What one task found; tasks only write their own slot
+    struct Link
+    {
+        ObjectId from, to;
+        int type; // what `from` says `to` is (PACK_BLOB: a blob or a chunk list)
+    };
+    struct Found
+    {
+        std::vector<std::pair<ObjectId, int>> objects;
+        std::vector<Link> links;
+        std::string errors;
+        uint64_t bytes = 0;
+    };
+
+    // --- The objects a commit, tree or chunk list refers to (false if it does not parse) ---
+    auto parseLinks = [](const ObjectId &id, int type, std::string_view content, std::vector<Link> &links)
+    {
+        if (type == PACK_COMMIT)
+        {
+            CommitView commit;
+            if (!parseCommit(content, commit))
+                return false;
+            ObjectId tree = ObjectId::fromHex(commit.tree);
+            bool ok = !tree.empty();
+            links.push_back({id, tree, PACK_TREE});
+            commit.forEachParent([&](std::string_view hex)
+                                 {
+                ObjectId parent = ObjectId::fromHex(hex);
+                ok = ok && !parent.empty();
+                links.push_back({id, parent, PACK_COMMIT}); });
+            return ok;
+        }
+        if (type == PACK_TREE)
+        {
+            size_t parsed = 0;
+            for (const auto &entry : TreeView(content))
+            {
+                parsed += entry.mode.size() + entry.name.size() + entry.rawHash.size() + 2;
+                if (entry.mode == "160000")
+                    continue; // a submodule commit lives in another repository
+                links.push_back({id, entry.hash(), entry.mode == "40000" ? PACK_TREE : PACK_BLOB});
+            }
+            return parsed == content.size(); // TreeView stops quietly at a truncated entry
+        }
+        if (type == PACK_CHUNKS)
+            return ObjectStore::forEachChunk(content, [&](const ObjectId &chunk, uint32_t)
+                                             { links.push_back({id, chunk, PACK_BLOB}); return true; });
+        return type != 0;
+    };
+
+    auto check = [&](const ObjectId &id, int type, const ObjectId &actual, std::string_view content,
+                     const std::string &where, Found &out)
+    {
+        if (actual != id)
+        {
+            out.errors += "Error: " + id.hex() + " (" + where + ") hashes to " + actual.hex() + ".\n";
+            return;
+        }
+        out.objects.emplace_back(id, type);
+        if (!parseLinks(id, type, content, out.links))
+            out.errors += "Error: malformed " + packTypeName(type) + " " + id.hex() + " (" + where + ").\n";
+    };
+
+    // --- Loose objects: streamed through the hash, so a large blob is never held whole ---
+    std::vector<ObjectId> loose;
+    std::error_code ec;
+    for (auto &fan : fs::directory_iterator(path + "/objects", ec))
+    {
+        std::string prefix = fan.path().filename().string();
+        if (prefix.size() != 2 || !fan.is_directory())
+            continue;
+        for (auto &obj : fs::directory_iterator(fan.path(), ec))
+        {
+            ObjectId id = ObjectId::fromHex(prefix + obj.path().filename().string());
+            if (!id.empty())
+                loose.push_back(id);
+        }
+    }
+    std::sort(loose.begin(), loose.end());
+
+    const std::vector<std::shared_ptr<Pack>> &packs = store.packs();
+    std::vector<std::vector<uint32_t>> packOrder(packs.size());
+    size_t tasks = (loose.size() + FSCK_LOOSE_BATCH - 1) / FSCK_LOOSE_BATCH;
+    for (size_t p = 0; p < packs.size(); p++)
+    {
+        // Entries in pack order: a delta's base comes before it, and is still cached
+        std::vector<uint32_t> &order = packOrder[p];
+        order.resize(packs[p]->size());
+        for (uint32_t i = 0; i < order.size(); i++)
+            order[i] = i;
+        const Pack &pack = *packs[p];
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+                  { return pack.offsetOf(a) < pack.offsetOf(b); });
+        tasks += 1 + (order.size() + FSCK_PACK_BATCH - 1) / FSCK_PACK_BATCH;
+    }
+
+    std::vector<Found> found(tasks);
+    unsigned threads;
+    std::string poolError;
+    {
+        TraceSpan hashSpan("fsck.hash");
+        ThreadPool pool;
+        threads = static_cast<unsigned>(pool.size());
+        size_t task = 0;
+        for (size_t begin = 0; begin < loose.size(); begin += FSCK_LOOSE_BATCH, task++)
+        {
+            pool.submit([&, begin, task]
+                        {
+                Found &out = found[task];
+                for (size_t i = begin; i < loose.size() && i < begin + FSCK_LOOSE_BATCH; i++)
+                try
+                {
+                    HashStream hasher;
+                    std::string type, content;
+                    bool ok = store.stream(
+                        loose[i],
+                        [&](const std::string &t, size_t size)
+                        {
+                            type = t;
+                            hasher.update(objectHeader(t, size));
+                        },
+                        [&](const char *data, size_t size)
+                        {
+                            hasher.update(data, size);
+                            if (type != "blob")
+                                content.append(data, size); // only what has links is kept
+                            out.bytes += size;
+                            return true;
+                        });
+                    if (!ok)
+                        out.errors += "Error: cannot read loose object " + loose[i].hex() + ".\n";
+                    else
+                        check(loose[i], packTypeFromName(type), hasher.finish(), content, "loose", out);
+                }
+                catch (const std::exception &e)
+                {
+                    // One bad object must not cost the rest of the batch its check
+                    out.errors += "Error: loose object " + loose[i].hex() + " is corrupt (" + e.what() + ").\n";
+                } });
+        }
+
+        for (size_t p = 0; p < packs.size(); p++)
+        {
+            const Pack &pack = *packs[p];
+            std::string name = fs::path(pack.packPath).filename().string();
+            pool.submit([&, name, task]
+                        {
+                if (!pack.verifyChecksums())
+                    found[task].errors += "Error: " + name + " does not match its checksum.\n"; });
+            task++;
+
+            const std::vector<uint32_t> &order = packOrder[p];
+            for (size_t begin = 0; begin < order.size(); begin += FSCK_PACK_BATCH, task++)
+            {
+                pool.submit([&, name, begin, task]
+                            {
+                    Found &out = found[task];
+                    PackBaseCache bases;
+                    std::string content;
+                    for (size_t k = begin; k < order.size() && k < begin + FSCK_PACK_BATCH; k++)
+                    try
+                    {
+                        uint32_t i = order[k];
+                        int type;
+                        if (!pack.verifyCrc(i) || !pack.readAt(pack.offsetOf(i), type, content, 0, &bases))
+                        {
+                            out.errors += "Error: cannot read " + pack.hashAt(i).hex() + " from " + name + ".\n";
+                            continue;
+                        }
+                        out.bytes += content.size();
+                        check(pack.hashAt(i), type, hashObject(packTypeName(type), content), content, name, out);
+                    }
+                    catch (const std::exception &e)
+                    {
+                        out.errors += "Error: " + pack.hashAt(order[k]).hex() + " in " + name + " is corrupt (" +
+                                      e.what() + ").\n";
+                    } });
+            }
+        }
+        if (!pool.wait())
+            poolError = pool.error();
+    }
+
+    // --- Connectivity: every link must lead to an object of the right type ---
+    TraceSpan linkSpan("fsck.links");
+    bool ok = poolError.empty();
+    if (!ok)
+        std::cerr << "Error: checking objects failed: " << poolError << "\n";
+    size_t checked = 0;
+    uint64_t bytes = 0;
+    std::unordered_map<ObjectId, int> present;
+    std::vector<Link> links;
+    for (Found &out : found)
+    {
+        std::cerr << out.errors;
+        ok = ok && out.errors.empty();
+        checked += out.objects.size();
+        bytes += out.bytes;
+        present.insert(out.objects.begin(), out.objects.end());
+        links.insert(links.end(), out.links.begin(), out.links.end());
+    }
+    found.clear();
+
+    auto typeOk = [&](const ObjectId &id, int type)
+    {
+        auto it = present.find(id);
+        return it != present.end() && (it->second == type || (type == PACK_BLOB && it->second == PACK_CHUNKS));
+    };
+
+    // Roots, as links from nowhere: the refs, and whatever the index holds
+    std::vector<Link> roots;
+    for (const auto &tip : refTips())
+        roots.push_back({ObjectId(), tip, PACK_COMMIT});
+    Index index;
+    if (!index.load(path + "/index"))
+    {
+        std::cerr << "Error: index file is corrupt.\n";
+        ok = false;
+    }
+    for (const auto &entry : index.entries)
+        roots.push_back({ObjectId(), entry.second.hash, PACK_BLOB});
+    for (const auto &tree : index.cacheTree)
+        roots.push_back({ObjectId(), tree.second, PACK_TREE});
+
+    std::map<ObjectId, int> missing;
+    std::unordered_set<ObjectId> referenced;
+    for (const std::vector<Link> *list : {&roots, &links})
+    {
+        for (const Link &link : *list)
+        {
+            referenced.insert(link.to);
+            if (typeOk(link.to, link.type))
+                continue;
+            ok = false;
+            std::string from = link.from.empty() ? "a ref or the index"
+                                                 : packTypeName(present[link.from]) + " " + link.from.hex();
+            if (!present.count(link.to))
+            {
+                std::cout << "broken link from " << from << " to " << packTypeName(link.type) << " " << link.to << "\n";
+                missing.emplace(link.to, link.type);
+            }
+            else
+                std::cerr << "Error: " << from << " refers to " << link.to << " as a " << packTypeName(link.type)
+                          << ", but it is a " << packTypeName(present[link.to]) << ".\n";
+        }
+    }
+    for (const auto &object : missing)
+        std::cout << "missing " << packTypeName(object.second) << " " << object.first << "\n";
+
+    // --- Reachable from the roots; what nothing refers to at all is dangling ---
+    std::sort(links.begin(), links.end(), [](const Link &a, const Link &b)
+              { return a.from < b.from; });
+    std::unordered_set<ObjectId> reached;
+    std::vector<ObjectId> todo;
+    for (const Link &root : roots)
+        if (present.count(root.to) && reached.insert(root.to).second)
+            todo.push_back(root.to);
+    while (!todo.empty())
+    {
+        ObjectId id = todo.back();
+        todo.pop_back();
+        auto range = std::equal_range(links.begin(), links.end(), Link{id, ObjectId(), 0},
+                                      [](const Link &a, const Link &b)
+                                      { return a.from < b.from; });
+        for (auto it = range.first; it != range.second; ++it)
+            if (present.count(it->to) && reached.insert(it->to).second)
+                todo.push_back(it->to);
+    }
+
+    std::vector<std::pair<ObjectId, int>> dangling;
+    for (const auto &object : present)
+        if (!reached.count(object.first) && !referenced.count(object.first))
+            dangling.push_back(object);
+    std::sort(dangling.begin(), dangling.end());
+    if (showDangling)
+        for (const auto &object : dangling)
+            std::cout << "dangling " << packTypeName(object.second) << " " << object.first << "\n";
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double mib = bytes / (1024.0 * 1024.0);
+    std::cout << std::fixed << std::setprecision(1)
+              << "Checked " << checked << " objects (" << mib << " MiB) in " << std::setprecision(2) << seconds
+              << std::setprecision(1) << " s on "
+              << threads << " threads: " << (seconds > 0 ? checked / seconds : 0) << " objects/s, "
+              << (seconds > 0 ? mib / seconds : 0) << " MiB/s\n"
+              << present.size() - reached.size() << " unreachable, " << dangling.size() << " dangling, "
+              << missing.size() << " missing\n";
+    return ok;
+}
+
+// ---------- Plumbing ----------
+ObjectId Repository::resolveObject(const std::string &name) const
+{
+    size_t colon = name.find(':');
+    if (colon == std::string::npos)
+        return resolveRevision(name);
+
+    ObjectId id = resolveRevision(colon == 0 ? "HEAD" : name.substr(0, colon));
+    std::string type;
+    uint64_t size;
+    if (id.empty() || !objectStore().info(id, type, size))
+        return ObjectId();
+    if (type == "commit")
+    {
+        id = readCommitTree(id);
+        type = "tree";
+    }
+
+    // Walk one tree per path component
+    std::string_view rest = std::string_view(name).substr(colon + 1);
+    while (!rest.empty())
+    {
+        size_t slash = rest.find('/');
+        std::string_view component = rest.substr(0, slash);
+        rest = slash == std::string_view::npos ? std::string_view() : rest.substr(slash + 1);
+        if (component.empty())
+            continue;
+        ObjectCache::Buffer content;
+        if (type != "tree" || !(content = objectStore().load(id, type)))
+            return ObjectId();
+        ObjectId next;
+        for (const auto &entry : TreeView(*content))
+        {
+            if (entry.name == component)
+            {
+                next = entry.hash();
+                type = entry.mode.compare(0, 2, "40") == 0 ? "tree" : "blob";
+                break;
+            }
+        }
+        if (next.empty())
+            return ObjectId();
+        id = next;
+    }
+    return id;
+}
+
+bool Repository::catFile(const std::string &option, const std::string &name)
+{
+    if (!isInitialized())
+    {
+        std::cerr << "Not a MyGit repository.\n";
+        return false;
+    }
+    ObjectStore &store = objectStore();
+    ObjectId id = resolveObject(name);
+    std::string type;
+    uint64_t size = 0;
+    if (id.empty() || !store.info(id, type, size))
+    {
+        if (option != "-e")
+        {
+            // A loose file that is there but does not read is damaged, not unknown
+            ObjectId loose = id.empty() ? ObjectId::fromHex(name) : id;
+            std::error_code ec;
+            if (!loose.empty() && fs::exists(store.objectPath(loose), ec))
+                std::cerr << "Error: object " << loose << " is corrupt.\n";
+            else
+                std::cerr << "Error: not a valid object name " << name << "\n";
+        }
+        return false;
+    }
+
+    if (option == "-e")
+        return true;
+    if (option == "-t")
+    {
+        std::cout << type << "\n";
+        return true;
+    }
+    if (option == "-s")
+    {
+        std::cout << size << "\n";
+        return true;
+    }
+
+    std::string content;
+    if (!store.read(id, type, content))
+    {
+        std::cerr << "Error: cannot read object " << id << "\n";
+        return false;
+    }
+    if (type != "tree")
+    {
+        std::cout.write(content.data(), content.size());
+        return true;
+    }
+    for (const auto &entry : TreeView(content))
+    {
+        bool isTree = entry.mode.compare(0, 2, "40") == 0;
+        std::cout << std::string(6 - std::min<size_t>(6, entry.mode.size()), '0') << entry.mode << ' '
+                  << (isTree ? "tree" : entry.mode == "160000" ? "commit" : "blob") << ' ' << entry.hash()
+                  << '\t' << entry.name << '\n';
+    }
+    return true;
+}
+
+bool Repository::catFileBatch(bool contents, bool buffered)
+{
+    TraceSpan span("cat-file.batch");
+    if (!isInitialized())
+    {
+        std::cerr << "Not a MyGit repository.\n";
+        return false;
+    }
+    // Nothing has been printed yet, so iostreams can drop the stdio sync; and
+    // unless every answer is flushed anyway, reading a line need not flush cout.
+    std::ios::sync_with_stdio(false);
+    if (buffered)
+        std::cin.tie(nullptr);
+
+    ObjectStore &store = objectStore();
+    std::string name;
+    while (std::getline(std::cin, name))
+    {
+        traceCount("cat-file.batch.request");
+        ObjectId id = resolveObject(name);
+        bool found = false;
+        if (!id.empty() && contents)
+        {
+            // Streamed: an object is never held whole, unless it comes out of a pack
+            bool ok = store.stream(
+                id,
+                [&](const std::string &type, size_t size)
+                {
+                    found = true;
+                    std::cout << id << ' ' << type << ' ' << size << '\n';
+                },
+                [](const char *data, size_t size)
+                {
+                    std::cout.write(data, size);
+                    return true;
+                });
+            if (found && !ok)
+            {
+                std::cerr << "Error: cannot read object " << id << "\n";
+                return false; // the size already promised cannot be honoured
+            }
+            if (found)
+                std::cout << '\n';
+        }
+        else if (!id.empty())
+        {
+            std::string type;
+            uint64_t size = 0;
+            found = store.info(id, type, size);
+            if (found)
+                std::cout << id << ' ' << type << ' ' << size << '\n';
+        }
+        if (!found)
+            std::cout << name << " missing\n";
+        if (!buffered)
+            std::cout.flush();
+    }
+    std::cout.flush();
+    return true;
+}
+
+bool Repository::hashObjects(const std::vector<std::string> &files, const std::string &type, bool write,
+                            bool stdinPaths, bool fromStdin)
+{
+    if (write && !isInitialized())
+    {
+        std::cerr << "Not a MyGit repository.\n";
+        return false;
+    }
+    std::ios::sync_with_stdio(false);
+    // Only touched when writing: hashing alone works outside a repository
+    ObjectStore *store = write ? &objectStore() : nullptr;
+
+    auto hashOne = [&](const std::string &file)
+    {
+        ObjectId id = store ? store->writeFile(type, file) : hashFile(file, type);
+        if (id.empty())
+        {
+            std::cerr << "Error: cannot hash " << file << "\n";
+            return false;
+        }
+        std::cout << id << '\n';
+        return true;
+    };
+
+    bool ok = true;
+    if (fromStdin)
+    {
+        std::string content(std::istreambuf_iterator<char>(std::cin), {});
+        ObjectId id = store ? store->write(type, content) : hashObject(type, content);
+        if (id.empty())
+            return false;
+        std::cout << id << '\n';
+    }
+    for (const auto &file : files)
+        ok = hashOne(file) && ok;
+    if (stdinPaths)
+    {
+        std::string file;
+        while (std::getline(std::cin, file))
+        {
+            ok = hashOne(file) && ok;
+            std::cout.flush();
+        }
+    }
+    std::cout.flush();
+    return ok;
+}
+
+// ---------- fsmonitor ----------
+
+std::string Repository::fsmonitorSocket() const
+{
+    return path + "/fsmonitor.sock";
+}
+
+std::set<std::string> Repository::fsmonitorCandidates(const Index &index, const FsMonitorAnswer &answer)
+{
+    std::set<std::string> candidates(answer.paths.begin(), answer.paths.end());
+    candidates.insert(index.fsmonitorDirty.begin(), index.fsmonitorDirty.end());
+    for (std::string file : index.fsmonitorUntracked)
+    {
+        if (!file.empty() && file.back() == '/')
+            file.pop_back();
+        candidates.insert(file);
+    }
+    return candidates;
+}
+
+bool Repository::fsmonitorCommand(const std::string &action)
+{
+    if (!isInitialized())
+    {
+        std::cerr << "Error: not a MyGit repository.\n";
+        return false;
+    }
+    std::string reply;
+    bool running = fsmonitorRequest(fsmonitorSocket(), "ping\n", reply);
+
+    if (action == "status")
+    {
+        std::cout << (running ? "fsmonitor is running\n" : "fsmonitor is not running\n");
+        return running;
+    }
+    if (action == "stop")
+    {
+        if (!running)
+        {
+            std::cerr << "fsmonitor is not running\n";
+            return false;
+        }
+        fsmonitorRequest(fsmonitorSocket(), "stop\n", reply);
+        std::cout << "fsmonitor stopped\n";
+        return true;
+    }
+    if (action != "start" && action != "run")
+    {
+        std::cerr << "Usage: mygit fsmonitor start|run|stop|status\n";
+        return false;
+    }
+    if (running)
+    {
+        std::cerr << "fsmonitor is already running\n";
+        return false;
+    }
+
+    // Watches and socket are set up before forking so errors reach the terminal
+    FsMonitorDaemon daemon(path);
+    if (!daemon.start())
+        return false;
+    std::cout << "fsmonitor watching " << daemon.watchCount() << " directories\n";
+    if (action == "run")
+    {
+        daemon.run();
+        return true;
+    }
+
+    std::cout.flush();
+    pid_t pid = ::fork();
+    if (pid < 0)
+    {
+        std::cerr << "Error: fork failed.\n";
+        return false;
+    }
+    if (pid > 0)
+    {
+        daemon.detach();
+        return true;
+    }
+    ::setsid();
+    int devNull = ::open("/dev/null", O_RDWR);
+    if (devNull >= 0)
+    {
+        ::dup2(devNull, 0);
+        ::dup2(devNull, 1);
+        ::dup2(devNull, 2);
+        ::close(devNull);
+    }
+    daemon.run();
+    return true;
+}
+
+void Repository::status()
+{
+    TraceSpan span("status");
+    if (!isInitialized())
+    {
+        std::cerr << "Error: not a MyGit repository.\n";
+        return;
+    }
+
+    // --- Read current branch name from HEAD ---
+    std::string branchName = currentBranch();
+    ObjectId headCommit = readHeadCommit();
+    if (!branchName.empty())
+        std::cout << "On branch " << branchName << "\n\n";
+    else
+        std::cout << "HEAD detached at " << headCommit.hex().substr(0, 7) << "\n\n";
+
+    // --- Read index (staging area) ---
+    // The lock is optional: without it status still works, it just does not
+    // write back refreshed stat data.
+    LockFile indexLock;
+    indexLock.acquire(path + "/index", true);
+    Index index;
+    if (!index.load(path + "/index"))
+    {
+        std::cerr << "Error: index file is corrupt.\n";
+        return;
+    }
+
+    // --- Read last commit’s tracked files (if any) ---
+    // Subtrees whose id matches the index's cache tree are skipped entirely.
+    TraceSpan headSpan("status.head");
+    std::map<std::string, TreeEntry> committedFiles;
+    std::set<std::string> cleanDirs;
+    if (!headCommit.empty())
+    {
+        ObjectId treeHash = readCommitTree(headCommit);
+        auto root = index.cacheTree.find("");
+        if (root != index.cacheTree.end() && root->second == treeHash)
+            cleanDirs.insert("");
+        else
+            readTreeRecursive(treeHash, "", committedFiles, &index, &cleanDirs);
+    }
+
+    auto underCleanDir = [&](const std::string &filename)
+    {
+        if (cleanDirs.count(""))
+            return true;
+        for (size_t slash = filename.find('/'); slash != std::string::npos; slash = filename.find('/', slash + 1))
+            if (cleanDirs.count(filename.substr(0, slash)))
+                return true;
+        return false;
+    };
+
+    // --- Collect file states ---
+    std::vector<std::string> staged;
+    std::vector<std::string> modified;
+    std::vector<std::string> untracked;
+
+    // Staged = index differs from the last commit
+    for (auto &[filename, entry] : index.entries)
+    {
+        if (underCleanDir(filename))
+            continue;
+        auto it = committedFiles.find(filename);
+        if (it == committedFiles.end() || it->second.hash != entry.hash || it->second.mode != gitMode(entry.mode))
+            staged.push_back(filename);
+    }
+    for (auto &[filename, committed] : committedFiles)
+    {
+        if (!index.entries.count(filename))
+            staged.push_back(filename);
+    }
+
+    headSpan.stop();
+
+    // --- Ask the fsmonitor daemon (if running) what changed since the last status ---
+    // Without an incremental answer every tracked file is lstat()ed and the
+    // whole tree is walked; with one, only the candidate paths are looked at.
+    FsMonitorAnswer fsmonitor;
+    bool monitored = fsmonitorQuery(fsmonitorSocket(), index.fsmonitorToken, fsmonitor);
+    bool incremental = monitored && !fsmonitor.full;
+    std::set<std::string> candidates;
+    if (incremental)
+        candidates = fsmonitorCandidates(index, fsmonitor);
+
+    // Modified = working tree differs from the index. Every candidate is
+    // lstat()ed in one batch; only files whose stat data changed since they
+    // were staged are read (small ones in batches too) and re-hashed.
+    TraceSpan worktreeSpan("status.worktree");
+    bool indexRefreshed = false;
+    std::vector<IndexEntry *> checked;
+    if (incremental)
+    {
+        std::set<std::string> tracked;
+        for (const auto &c : candidates)
+            forEachTrackedUnder(index, c, [&](const IndexEntry &entry)
+                                { tracked.insert(entry.path); });
+        for (const auto &file : tracked)
+            checked.push_back(&index.entries[file]);
+    }
+    else
+    {
+        for (auto &[filename, entry] : index.entries)
+            checked.push_back(&entry);
+    }
+
+    std::vector<std::string> paths;
+    for (const auto *entry : checked)
+        paths.push_back(entry->path);
+    std::vector<struct stat> stats;
+    std::vector<int> errors;
+    batchIo().lstatAll(paths, stats, errors);
+
+    enum Verdict : char { CLEAN, MODIFIED, REHASH };
+    std::vector<char> verdict(checked.size(), CLEAN);
+    std::vector<std::string> rehashPaths;
+    std::vector<struct stat> rehashStats;
+    for (size_t i = 0; i < checked.size(); i++)
+    {
+        if (errors[i] || gitMode(stats[i].st_mode) != gitMode(checked[i]->mode))
+            verdict[i] = MODIFIED; // deleted from the working tree, or changed kind
+        else if (!index.isUpToDate(*checked[i], stats[i]))
+        {
+            verdict[i] = REHASH;
+            rehashPaths.push_back(paths[i]);
+            rehashStats.push_back(stats[i]);
+        }
+    }
+    std::vector<ObjectId> rehashed = hashWorktreeFiles(rehashPaths, rehashStats);
+    for (size_t i = 0, k = 0; i < checked.size(); i++)
+    {
+        if (verdict[i] == REHASH && rehashed[k++] == checked[i]->hash)
+        {
+            // Same content, new stat data (touched, copied back, ...): refresh the entry
+            fillStatData(*checked[i], stats[i]);
+            indexRefreshed = true;
+        }
+        else if (verdict[i] != CLEAN)
+            modified.push_back(paths[i]);
+    }
+    worktreeSpan.stop();
+
+    // Untracked = present in the working tree but neither in the index nor ignored
+    // (skip .mygit). A directory without any tracked file is reported once as
+    // "dir/" if it holds anything not ignored. Directories whose listing did not
+    // change since the last status come from the untracked cache without a read.
+    TraceSpan untrackedSpan("status.untracked");
+    std::set<std::string> untrackedSet;
+    IgnoreRules &ignore = ignoreRules();
+    std::function<bool(const std::string &)> hasUntracked = [&](const std::string &dir)
+    {
+        const UntrackedDir &cached = scanUntracked(index, dir, indexRefreshed);
+        if (!cached.files.empty())
+            return true;
+        for (const auto &sub : cached.dirs)
+            if (hasUntracked(dir + "/" + sub))
+                return true;
+        return false;
+    };
+    std::function<void(const std::string &)> walk = [&](const std::string &dir)
+    {
+        std::string prefix = dir.empty() ? "" : dir + "/";
+        const UntrackedDir &cached = scanUntracked(index, dir, indexRefreshed);
+        for (const auto &name : cached.files)
+            untrackedSet.insert(prefix + name);
+        for (const auto &name : cached.dirs)
+        {
+            std::string rel = prefix + name;
+            if (index.hasEntriesUnder(rel))
+                walk(rel);
+            else if (hasUntracked(rel))
+                untrackedSet.insert(rel + "/");
+        }
+    };
+
+    // A changed .mygitignore can affect any path: only a full walk is right then
+    if (incremental)
+        for (const auto &rel : candidates)
+            if (rel == ".mygitignore" || (rel.size() > 13 && rel.compare(rel.size() - 13, 13, "/.mygitignore") == 0))
+                incremental = false;
+
+    if (incremental)
+    {
+        // Report a candidate the way the full walk would have reached it: as its
+        // topmost directory without tracked files, or as itself
+        for (const auto &rel : candidates)
+        {
+            struct stat st;
+            if (rel.empty() || rel == ".mygit" || rel.compare(0, 7, ".mygit/") == 0 || ::lstat(rel.c_str(), &st) != 0)
+                continue;
+            bool isDir = S_ISDIR(st.st_mode);
+            if ((!isDir && index.entries.count(rel)) || ignore.isExcluded(rel, isDir))
+                continue;
+
+            bool collapsed = false;
+            for (size_t slash = rel.find('/'); slash != std::string::npos && !collapsed; slash = rel.find('/', slash + 1))
+            {
+                if (!index.hasEntriesUnder(rel.substr(0, slash)))
+                {
+                    if (!isDir || hasUntracked(rel))
+                        untrackedSet.insert(rel.substr(0, slash) + "/");
+                    collapsed = true;
+                }
+            }
+            if (collapsed)
+                continue;
+            if (!isDir)
+                untrackedSet.insert(rel);
+            else if (!index.hasEntriesUnder(rel))
+            {
+                if (hasUntracked(rel))
+                    untrackedSet.insert(rel + "/");
+            }
+            else
+                walk(rel);
+        }
+    }
+    else
+        walk("");
+    untracked.assign(untrackedSet.begin(), untrackedSet.end());
+    untrackedSpan.stop();
+
+    // --- Remember this result for the next incremental status ---
+    if (monitored && (!fsmonitor.paths.empty() || fsmonitor.full || modified != index.fsmonitorDirty ||
+                      untracked != index.fsmonitorUntracked))
+    {
+        index.fsmonitorToken = fsmonitor.token;
+        index.fsmonitorDirty = modified;
+        index.fsmonitorUntracked = untracked;
+        indexRefreshed = true;
+    }
+
+    if (indexRefreshed && indexLock.isLocked())
+        index.save(indexLock);
+
+    // --- Print results ---
+    if (!readMergeHead().empty())
+    {
+        std::vector<std::string> unmerged = readMergeConflicts();
+        if (unmerged.empty())
+            std::cout << "All conflicts fixed but you are still merging.\n  (use \"mygit commit\" to conclude merge)\n\n";
+        else
+        {
+            std::cout << "You have unmerged paths.\n  (fix conflicts and run \"mygit add\", then \"mygit commit\")\n\n"
+                      << "Unmerged paths:\n";
+            for (auto &f : unmerged)
+                std::cout << "    " << f << "\n";
+            std::cout << "\n";
+        }
+    }
+
+    if (!staged.empty())
+    {
+        std::cout << "Staged files:\n";
+        for (auto &f : staged)
+            std::cout << "    " << f << "\n";
+        std::cout << "\n";
+    }
+
+    if (!modified.empty())
+    {
+        std::cout << "Modified (not staged):\n";
+        for (auto &f : modified)
+            std::cout << "    " << f << "\n";
+        std::cout << "\n";
+    }
+
+    if (!untracked.empty())
+    {
+        std::cout << "Untracked files:\n";
+        for (auto &f : untracked)
+            std::cout << "    " << f << "\n";
+        std::cout << "\n";
+    }
+
+    if (staged.empty() && modified.empty() && untracked.empty())
+        std::cout << "Nothing to commit, working tree clean\n";
+}
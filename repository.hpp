@@ -0,0 +1,373 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <sys/stat.h>
+#include "bitmap.hpp"
+#include "commit_graph.hpp"
+#include "entities.hpp"
+#include "fsmonitor.hpp"
+#include "ignore.hpp"
+#include "index.hpp"
+#include "object_store.hpp"
+#include "refs.hpp"
+
+/**
+ * A repository rooted at the current directory, with its metadata in `path`.
+ *
+ * Every mygit command is a member function here; main.cpp only parses the
+ * command line. Keeping this in its own translation unit (the mygit_core
+ * library) lets the benchmarks drive the same code in-process.
+ */
+
+// ---------- Repository ----------
+struct Repository
+{
+    std::string path = ".mygit"; // local repo folder
+    mutable std::unique_ptr<ObjectStore> storeInstance; // see objectStore()
+    mutable std::unique_ptr<CommitGraph> graphInstance; // see commitGraph()
+    mutable std::unique_ptr<IgnoreRules> ignoreInstance; // see ignoreRules()
+    mutable std::unique_ptr<BatchIo> ioInstance; // see batchIo()
+
+    // --- Selects the object format recorded in the config (sha1 if there is none) ---
+    Repository();
+
+    bool isInitialized() const;
+    // --- Initialize a new repository; objectFormat is "sha1" or "sha256" ---
+    bool init(const std::string &objectFormat = "sha1");
+
+    // ----- CONFIG MANAGEMENT -----
+    std::map<std::string, std::string> readConfig() const;
+
+    void writeConfig(const std::map<std::string, std::string> &values);
+
+    // --- Object store configured from [core] compression (created once per Repository) ---
+    ObjectStore &objectStore() const;
+
+    // --- Batched file I/O from [core] ioengine: sync, uring or threads (created once) ---
+    BatchIo &batchIo() const;
+
+    // ---------- Commit-graph ----------
+    std::string commitGraphPath() const;
+
+    // Mapped once per Repository; reloaded after the file is rewritten
+    const CommitGraph &commitGraph() const;
+
+    // --- Graph record for one commit, parsed from its object ---
+    bool readCommitEntry(const ObjectId &hash, CommitGraphEntry &entry) const;
+
+    static bool parseCommitEntry(const ObjectId &hash, std::string_view content, CommitGraphEntry &entry);
+
+    // --- Add `tips` and any of their ancestors the graph is missing, then rewrite it ---
+    // Commits already in the graph are copied from it, so only new commits are read.
+    // The graph is re-read under its lock, so commits another writer added stay in.
+    bool updateCommitGraph(const std::vector<ObjectId> &tips);
+
+    // --- Lock the commit-graph file for a rewrite (waits briefly for another writer) ---
+    bool lockCommitGraph(LockFile &lock);
+
+    bool writeGraphFile(LockFile &lock, std::vector<CommitGraphEntry> entries);
+
+    // ---------- HEAD and branches ----------
+    // HEAD is either "ref: refs/heads/<branch>" or, when detached, a commit id.
+
+    // --- "refs/heads/<name>" for the checked-out branch, "" when detached ---
+    std::string readHeadRef() const;
+
+    std::string currentBranch() const;
+
+    // --- Commit id currently checked out (empty before the first commit) ---
+    ObjectId readHeadCommit() const;
+
+    // --- Replace a file of the repository (HEAD, MERGE_HEAD, ...) through its lock ---
+    // Refs under refs/ go through a RefTransaction instead (see refs.hpp).
+    bool writeRef(const std::string &ref, const std::string &value);
+
+    // --- Point the current branch (or a detached HEAD) at a new commit ---
+    // Fails without changing anything if it no longer points at `expected`
+    // (another process moved it since `expected` was read).
+    bool updateHead(const ObjectId &commitHash, const ObjectId &expected);
+
+    bool branchExists(const std::string &name) const;
+
+    // Same spirit as git check-ref-format: no "..", control characters, spaces,
+    // "~^:?*[\", leading '-' or '/', trailing '/' or ".lock"
+    static bool isValidBranchName(const std::string &name);
+
+    // --- branch: list, create (<name> [<start>]) or delete (-d <name>) ---
+    bool branch(const std::vector<std::string> &args);
+
+    // --- update-ref [-d] <ref> [<new>] [<old>] | --stdin ---
+    // With <old> the update only happens if the ref still has that value (an
+    // empty or all-zero <old> means it must not exist yet). --stdin reads
+    // "update|create|delete|verify <ref> [<id>...]" lines and applies them all
+    // as one transaction.
+    bool updateRefs(const std::vector<std::string> &args);
+
+    // --- pack-refs: move the loose refs into the sorted packed-refs file ---
+    bool packAllRefs();
+
+    // --- Resolve HEAD, a ref (branch, tag or refs/...), a full id or a unique abbreviated id ---
+    ObjectId resolveRevision(const std::string &rev) const;
+
+    // --- Position of a commit in the graph, adding it (and its history) if missing ---
+    bool graphPosition(const std::string &rev, uint32_t &pos);
+
+    // --- Add setter commands ---
+    void setAuthorName(const std::string &name);
+
+    void setAuthorEmail(const std::string &email);
+
+    // --- Hash a working tree file and store it as a blob ---
+    // Fills `entry` with the blob hash and the stat data the file was hashed with.
+    // `content`, if given, is the file as already read (see readSmallFiles()).
+    // Safe to call from several threads at once.
+    bool hashFileToBlob(const ObjectStore &store, const std::string &filePath, const struct stat &st, IndexEntry &entry,
+                        const std::string *content = nullptr);
+
+    // --- Object id a working tree file would get, without storing it ---
+    ObjectId hashWorktreeFile(const std::string &filePath, const struct stat &st) const;
+
+    // --- hashWorktreeFile() for many files: small ones are read in batches (see batchIo()) ---
+    std::vector<ObjectId> hashWorktreeFiles(const std::vector<std::string> &files,
+                                            const std::vector<struct stat> &stats) const;
+
+    // --- Read the small regular files among `which` (indexes into `files`) in batches ---
+    // fn(i, content) is called for each file read, after every batch of at most
+    // BATCH_READ_BYTES; the files that were not read (too big, symlinks, changed
+    // since their lstat) are returned for the caller to stream one by one.
+    static const uint64_t BATCH_READ_MAX_FILE = 1 << 20;
+    static const uint64_t BATCH_READ_BYTES = 64 << 20;
+    static const size_t BATCH_READ_FILES = 4096;
+    std::vector<size_t> readSmallFiles(const std::vector<std::string> &files, const std::vector<struct stat> &stats,
+                                       const std::vector<size_t> &which,
+                                       const std::function<void(size_t, std::string &)> &fn) const;
+
+    // --- .mygitignore rules of the working tree (created once per Repository) ---
+    IgnoreRules &ignoreRules() const;
+
+    // --- Every file below `dir`, repository-relative (.mygit is skipped) ---
+    // Ignored files are left out unless they are tracked; ignored directories
+    // without tracked files are not descended into.
+    void walkFiles(const std::string &dir, const Index &index, std::vector<std::string> &files) const;
+
+    // --- Expand the paths given to add into a list of files (directories recursively) ---
+    // Directory arguments are walked, unless `changed` (from fsmonitor) is given:
+    // then only the changed paths below the directory are looked at.
+    std::vector<std::string> collectFiles(const std::vector<std::string> &paths, const Index &index,
+                                          std::vector<std::string> &dirs,
+                                          const std::set<std::string> *changed = nullptr);
+
+    // --- Untracked, not ignored entries directly in `dir`, from the index's untracked cache if still valid ---
+    // Sets `changed` when the directory had to be read again.
+    const UntrackedDir &scanUntracked(Index &index, const std::string &dir, bool &changed) const;
+
+    // --- Add operation ---
+    // Files are hashed and written as blobs in parallel; the index is updated once
+    // at the end with a single write.
+    bool add(const std::vector<std::string> &paths);
+
+    // ---------- BUILD TREES FROM INDEX ----------
+    // One tree object per directory, written bottom-up. A directory whose id is
+    // still in the index's cache tree is reused as-is, without visiting anything
+    // below it, so the cost follows the number of changed directories.
+    ObjectId writeTreeFromIndex(Index &index, const std::string &dir = "");
+
+    // ---------- Read Tree Object (recursively) ----------
+    // Flattens a tree into "dir/file" -> entry. A subtree whose id equals the
+    // index's cached id for that directory is not descended; its path is added to
+    // `cleanDirs` instead (everything below it is known to match the index).
+    void readTreeRecursive(const ObjectId &treeHash, const std::string &prefix,
+                           std::map<std::string, TreeEntry> &files,
+                           const Index *index = nullptr, std::set<std::string> *cleanDirs = nullptr) const;
+
+    // --- Return the tree hash recorded in a commit object ---
+    ObjectId readCommitTree(const ObjectId &commitHash) const;
+
+    // ---------- Write Tree Object ----------
+    ObjectId writeTree(const Tree &tree);
+
+    // --- Commit operation ---
+    ObjectId commit(const std::string &message);
+
+    // --- log operation ---
+    // History order and parents come from the commit-graph; only the commits that
+    // are printed are read from the object store.
+    void logCommits(size_t maxCount = SIZE_MAX, const std::string &rev = "HEAD");
+
+    // --- rev-list: commit ids reachable from rev, newest first (graph only) ---
+    bool revList(const std::string &rev, size_t maxCount = SIZE_MAX, bool countOnly = false);
+
+    // --- merge-base: best common ancestor(s) of two commits (graph only) ---
+    bool mergeBase(const std::string &a, const std::string &b);
+
+    // --- Is `ancestor` reachable from `descendant`? (graph only) ---
+    bool isAncestor(const std::string &ancestor, const std::string &descendant);
+
+    // ---------- Diff ----------
+    // One changed path. An empty hash/mode means the path does not exist on that side.
+    struct FileChange
+    {
+        std::string path;
+        std::string oldMode, newMode;
+        ObjectId oldHash, newHash;
+        bool newFromWorktree = false; // new content is read from the file, not the store
+    };
+
+    // --- Tree vs tree; subtrees with equal ids are skipped without being read ---
+    void diffTrees(const ObjectId &oldTree, const ObjectId &newTree, const std::string &prefix,
+                   std::vector<FileChange> &changes) const;
+
+    // --- Index vs HEAD (what commit would record) ---
+    void diffIndexToHead(const Index &index, std::vector<FileChange> &changes) const;
+
+    // --- Working tree vs index (unstaged changes; untracked files are not shown) ---
+    void diffWorktreeToIndex(const Index &index, std::vector<FileChange> &changes) const;
+
+    // --- Content of one side of a change ---
+    bool loadSide(const ObjectId &hash, bool fromWorktree, const std::string &file, std::string &content) const;
+
+    // --- git-style header plus hunks for one changed path ---
+    void printFileChange(const FileChange &change) const;
+
+    // --- diff: worktree vs index, --cached (index vs HEAD), or <commit> <commit> ---
+    bool diff(const std::vector<std::string> &args);
+
+    // ---------- Checkout ----------
+    // --- Write one blob into the working tree (regular file, executable or symlink) ---
+    bool materializeFile(const std::string &file, const ObjectId &hash, const std::string &mode);
+
+    // --- Paths a tree switch would overwrite although they hold local work (modified or untracked) ---
+    std::vector<std::string> blockedPaths(const Index &index, const std::vector<FileChange> &changes) const;
+
+    // --- Apply tree changes to the working tree (files written in parallel) and the index ---
+    bool applyChanges(Index &index, const std::vector<FileChange> &changes);
+
+    // --- checkout: switch to a branch or commit, rewriting only files that differ ---
+    // The work is proportional to the tree delta between HEAD and the target:
+    // unchanged subtrees are never read and unchanged files are never touched.
+    bool checkout(const std::string &target, bool createBranch);
+
+    // ---------- Merge ----------
+    // State of a merge that stopped for conflicts: MERGE_HEAD holds the commit
+    // being merged (the next commit's second parent), MERGE_CONFLICTS the paths
+    // still to be resolved with "mygit add".
+    ObjectId readMergeHead() const;
+    std::vector<std::string> readMergeConflicts() const;
+    bool writeMergeState(const ObjectId &theirs, const std::vector<std::string> &conflicts);
+    void clearMergeState();
+
+    // --- Three-way tree merge; result is empty if nothing is left in the tree ---
+    // Subtrees that are equal on two of the three sides are taken without being
+    // read, so the work is bounded by what changed on both sides. Files changed
+    // on both sides are merged line by line; conflicts are collected, not fatal.
+    bool mergeTrees(const ObjectId &base, const ObjectId &ours, const ObjectId &theirs,
+                    const std::string &prefix, const std::string &theirsLabel,
+                    std::vector<std::string> &conflicts, ObjectId &result);
+
+    // --- merge: fast-forward, or merge against the merge base and commit with two parents ---
+    bool merge(const std::string &rev);
+
+    // --- gc / repack: move every object into a single delta-compressed packfile ---
+    bool gc();
+
+    // ---------- Reachability ----------
+    // --- Commits the refs point at: every branch, HEAD and MERGE_HEAD ---
+    std::vector<ObjectId> refTips() const;
+
+    // --- The pack that has a .bitmap file (null if none), with its bitmaps loaded ---
+    std::shared_ptr<Pack> bitmappedPack(PackBitmaps &bitmaps) const;
+
+    // --- Set the bit of every object reachable from `roots` (commits, trees or blobs) ---
+    // Commits are walked first; one that `bitmapOf` has a bitmap for adds it whole
+    // instead of being walked. Trees come after that, so subtrees the bitmaps
+    // already cover are skipped without being read. Fails if an object is missing.
+    bool markReachable(const std::vector<ObjectId> &roots, ObjectPositions &positions,
+                       const std::function<bool(const ObjectId &, Bitmap &)> &bitmapOf, Bitmap &result) const;
+
+    // --- Write the .bitmap of a freshly written pack holding `objects` (gc) ---
+    // Bitmaps are stored for every ref tip and for commits whose generation is a
+    // multiple of BITMAP_INTERVAL, so no walk goes further than that before
+    // reaching one.
+    static const uint32_t BITMAP_INTERVAL = 100;
+    bool writeBitmaps(const Pack &pack, const std::vector<PackInput> &objects);
+
+    // --- rev-list --objects: objects reachable from `include` but not from `exclude` ---
+    bool revListObjects(const std::vector<std::string> &include, const std::vector<std::string> &exclude,
+                        bool countOnly);
+
+    // --- count-objects: loose and packed totals; `verbose` adds what the refs reach ---
+    bool countObjects(bool verbose);
+
+    // --- prune: delete the loose objects that no ref, nor the index, can reach ---
+    // Only objects last modified before `expire` go: a concurrent add or commit
+    // writes its objects before the index or a ref points at them, and those
+    // must survive. PRUNE_EXPIRE is the default grace period, like git's.
+    static constexpr const char *PRUNE_EXPIRE = "2.weeks.ago";
+    bool prune(bool dryRun, time_t expire);
+
+    // --- "now", "never" or "<n>.<unit>.ago" (seconds ... weeks) as a cutoff time ---
+    static bool parseExpiry(const std::string &spec, time_t now, time_t &cutoff);
+
+    // ---------- fsck ----------
+    // --- fsck: re-hash every object, loose and packed, on all cores; then check connectivity ---
+    // Reports objects whose content does not match their id, broken links (a
+    // commit or tree naming an object that is not there) and, with
+    // `showDangling`, objects that nothing refers to. Fails if anything is wrong.
+    // Loose objects are checked FSCK_LOOSE_BATCH to a task, packed ones
+    // FSCK_PACK_BATCH at a time in pack order, so delta bases stay cached.
+    static const size_t FSCK_LOOSE_BATCH = 256;
+    static const size_t FSCK_PACK_BATCH = 2048;
+    bool fsck(bool showDangling);
+
+    // ---------- Plumbing ----------
+    // --- Any object name: a revision (see resolveRevision) or "<rev>:<path>" ---
+    ObjectId resolveObject(const std::string &name) const;
+
+    // --- cat-file -t | -s | -e | -p <object> ---
+    bool catFile(const std::string &option, const std::string &name);
+
+    // --- cat-file --batch / --batch-check: one object name per stdin line ---
+    // Each answer is "<id> <type> <size>\n", followed by the content and "\n"
+    // when `contents` is set, or "<name> missing\n". Output is flushed after
+    // every answer unless `buffered`, so a caller can talk to one long-lived
+    // process; the object store (and its mapped packs) is shared by all lookups.
+    bool catFileBatch(bool contents, bool buffered);
+
+    // --- hash-object: print the ids of files (or of stdin), storing them with `write` ---
+    // With `stdinPaths`, file names are read one per line and each id is
+    // printed (and flushed) as soon as it is known.
+    bool hashObjects(const std::vector<std::string> &files, const std::string &type, bool write,
+                     bool stdinPaths, bool fromStdin);
+
+    // ---------- fsmonitor ----------
+    std::string fsmonitorSocket() const;
+
+    // --- Paths to look at when the daemon answered incrementally ---
+    // What changed since the token, plus what the last status found not clean.
+    static std::set<std::string> fsmonitorCandidates(const Index &index, const FsMonitorAnswer &answer);
+
+    // --- The index entry at `file`, or every entry below it if it is a directory ---
+    template <typename Fn>
+    static void forEachTrackedUnder(const Index &index, const std::string &file, Fn fn)
+    {
+        auto exact = index.entries.find(file);
+        if (exact != index.entries.end())
+            fn(exact->second);
+        std::string prefix = file + "/";
+        for (auto it = index.entries.lower_bound(prefix); it != index.entries.end() && it->first.compare(0, prefix.size(), prefix) == 0; ++it)
+            fn(it->second);
+    }
+
+    // --- fsmonitor start | run | stop | status ---
+    bool fsmonitorCommand(const std::string &action);
+
+    void status();
+};
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Small work-stealing thread pool.
+ *
+ * Every worker owns a deque. Tasks submitted from outside are dealt round-robin
+ * across the deques; tasks submitted from inside a worker go to its own deque.
+ * A worker pops from the back of its own deque (hot in cache) and, when it runs
+ * dry, steals from the front of the others, so uneven work (one huge file among
+ * many small ones) still keeps every core busy.
+ *
+ * Tasks report their own failures through the state they share with the
+ * caller. One that throws anyway (bad_alloc, a parser on corrupt input) is
+ * caught so it cannot take the pool down, and the next wait() returns false;
+ * callers must treat that as a failure of the whole batch.
+ */
+class ThreadPool
+{
+public:
+    explicit ThreadPool(unsigned threads = 0)
+    {
+        if (threads == 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+
+        for (unsigned i = 0; i < threads; i++)
+            queues.push_back(std::make_unique<Queue>());
+        for (unsigned i = 0; i < threads; i++)
+            workers.emplace_back([this, i]
+                                 { workerLoop(i); });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            stopping = true;
+        }
+        wakeCv.notify_all();
+        for (auto &worker : workers)
+            worker.join();
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    size_t size() const { return workers.size(); }
+
+    // --- Queue a task ---
+    void submit(std::function<void()> task)
+    {
+        size_t target = currentWorker >= 0 && currentPool == this
+                            ? static_cast<size_t>(currentWorker)
+                            : nextQueue.fetch_add(1) % queues.size();
+
+        pending.fetch_add(1);
+        queued.fetch_add(1);
+        {
+            std::lock_guard<std::mutex> lock(queues[target]->mutex);
+            queues[target]->tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(stateMutex);
+        }
+        wakeCv.notify_one();
+    }
+
+    // --- Block until every submitted task has finished ---
+    // False if any of them threw since the last wait(); error() says what the first one threw.
+    [[nodiscard]] bool wait()
+    {
+        std::unique_lock<std::mutex> lock(stateMutex);
+        doneCv.wait(lock, [this]
+                    { return pending.load() == 0; });
+        bool ok = !thrown;
+        thrown = false;
+        return ok;
+    }
+
+    const std::string &error() const { return failure; }
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+
+    std::atomic<size_t> pending{0};   // submitted but not finished
+    std::atomic<size_t> queued{0};    // sitting in a deque
+    std::atomic<size_t> nextQueue{0}; // round-robin cursor for external submits
+
+    std::mutex stateMutex;
+    std::condition_variable wakeCv;
+    std::condition_variable doneCv;
+    bool stopping = false;
+    bool thrown = false;  // a task threw since the last wait() (under stateMutex)
+    std::string failure;  // what the first one threw
+
+    static inline thread_local int currentWorker = -1;
+    static inline thread_local const ThreadPool *currentPool = nullptr;
+
+    // Own deque first (LIFO), then steal from the others (FIFO)
+    bool takeTask(size_t self, std::function<void()> &task)
+    {
+        {
+            Queue &own = *queues[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty())
+            {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                queued.fetch_sub(1);
+                return true;
+            }
+        }
+        for (size_t i = 1; i < queues.size(); i++)
+        {
+            Queue &victim = *queues[(self + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty())
+            {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                queued.fetch_sub(1);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void recordFailure(std::exception_ptr error)
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        if (thrown)
+            return;
+        thrown = true;
+        try
+        {
+            std::rethrow_exception(error);
+        }
+        catch (const std::exception &e)
+        {
+            failure = e.what();
+        }
+        catch (...)
+        {
+            failure = "unknown exception";
+        }
+    }
+
+    void workerLoop(size_t self)
+    {
+        currentWorker = static_cast<int>(self);
+        currentPool = this;
+
+        while (true)
+        {
+            std::function<void()> task;
+            if (takeTask(self, task))
+            {
+                try
+                {
+                    task();
+                }
+                catch (...)
+                {
+                    recordFailure(std::current_exception());
+                }
+
+                if (pending.fetch_sub(1) == 1)
+                {
+                    std::lock_guard<std::mutex> lock(stateMutex);
+                    doneCv.notify_all();
+                }
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(stateMutex);
+            if (stopping && queued.load() == 0)
+                return;
+            wakeCv.wait(lock, [this]
+                        { return stopping || queued.load() > 0; });
+        }
+    }
+};
@@ -0,0 +1,261 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <unistd.h>
+
+/**
+ * Built-in tracing, switched on with the MYGIT_TRACE environment variable:
+ *
+ *   MYGIT_TRACE=1 (or "summary")  per-span and per-counter totals on stderr
+ *   MYGIT_TRACE=chrome            Chrome trace-event JSON on stderr
+ *   MYGIT_TRACE=/abs/path.json    Chrome trace-event JSON written to that file
+ *
+ * The JSON loads in chrome://tracing or https://ui.perfetto.dev.
+ *
+ * Code marks work with a TraceSpan (a scope, timed) or traceCount() (a named
+ * counter, e.g. bytes hashed). Every thread records into its own log, so
+ * recording takes no lock; the logs are merged and written once, at exit.
+ * When tracing is off both cost a single branch.
+ *
+ * Names must be string literals (only the pointer is stored).
+ */
+class Tracer
+{
+public:
+    enum class Output
+    {
+        None,
+        Summary,
+        Chrome
+    };
+
+    static Tracer &instance()
+    {
+        static Tracer tracer;
+        return tracer;
+    }
+
+    bool enabled() const { return output != Output::None; }
+
+    // Nanoseconds since the tracer started
+    uint64_t now() const
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                         std::chrono::steady_clock::now() - origin)
+                                         .count());
+    }
+
+    void record(const char *name, uint64_t start, uint64_t duration)
+    {
+        local().events.push_back({name, start, duration});
+    }
+
+    void count(const char *name, uint64_t delta)
+    {
+        local().counters[name] += delta;
+    }
+
+    ~Tracer()
+    {
+        if (enabled())
+            flush();
+    }
+
+    Tracer(const Tracer &) = delete;
+    Tracer &operator=(const Tracer &) = delete;
+
+private:
+    struct Event
+    {
+        const char *name;
+        uint64_t start;
+        uint64_t duration;
+    };
+
+    // Owned by the tracer, so a thread's events outlive the thread
+    struct ThreadLog
+    {
+        uint32_t tid = 0;
+        std::vector<Event> events;
+        std::unordered_map<const char *, uint64_t> counters;
+    };
+
+    Output output = Output::None;
+    std::string file; // Chrome output path ("" = stderr)
+    std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+    std::mutex logsMutex;
+    std::vector<std::unique_ptr<ThreadLog>> logs;
+
+    Tracer()
+    {
+        const char *env = std::getenv("MYGIT_TRACE");
+        std::string value = env ? env : "";
+        if (value.empty() || value == "0" || value == "false")
+            return;
+        if (value == "chrome")
+            output = Output::Chrome;
+        else if (value[0] == '/')
+        {
+            output = Output::Chrome;
+            file = value;
+        }
+        else
+            output = Output::Summary;
+    }
+
+    ThreadLog &local()
+    {
+        thread_local ThreadLog *log = nullptr;
+        if (!log)
+        {
+            std::lock_guard<std::mutex> lock(logsMutex);
+            logs.push_back(std::make_unique<ThreadLog>());
+            log = logs.back().get();
+            log->tid = static_cast<uint32_t>(logs.size());
+        }
+        return *log;
+    }
+
+    // Same name from different translation units may be different pointers
+    std::map<std::string, uint64_t> mergedCounters() const
+    {
+        std::map<std::string, uint64_t> merged;
+        for (const auto &log : logs)
+            for (const auto &[name, value] : log->counters)
+                merged[name] += value;
+        return merged;
+    }
+
+    void flush()
+    {
+        std::lock_guard<std::mutex> lock(logsMutex);
+        if (output == Output::Summary)
+            writeSummary(stderr);
+        else if (file.empty())
+            writeChrome(stderr);
+        else if (FILE *out = std::fopen(file.c_str(), "w"))
+        {
+            writeChrome(out);
+            std::fclose(out);
+        }
+        else
+            std::fprintf(stderr, "Error: MYGIT_TRACE: cannot write '%s': %s\n", file.c_str(), std::strerror(errno));
+    }
+
+    // --- Totals per span name (inclusive: nested spans count in their parents too) ---
+    void writeSummary(FILE *out) const
+    {
+        struct Total
+        {
+            uint64_t count = 0, total = 0, max = 0;
+        };
+        std::map<std::string, Total> spans;
+        for (const auto &log : logs)
+        {
+            for (const Event &e : log->events)
+            {
+                Total &t = spans[e.name];
+                t.count++;
+                t.total += e.duration;
+                t.max = std::max(t.max, e.duration);
+            }
+        }
+        std::vector<std::pair<std::string, Total>> sorted(spans.begin(), spans.end());
+        std::stable_sort(sorted.begin(), sorted.end(),
+                         [](const auto &a, const auto &b) { return a.second.total > b.second.total; });
+
+        std::fprintf(out, "mygit trace: %.3f ms wall, %zu thread(s)\n", now() / 1e6, logs.size());
+        std::fprintf(out, "%-28s %10s %12s %12s %12s\n", "span", "count", "total ms", "mean ms", "max ms");
+        for (const auto &[name, t] : sorted)
+            std::fprintf(out, "%-28s %10llu %12.3f %12.3f %12.3f\n", name.c_str(),
+                         static_cast<unsigned long long>(t.count), t.total / 1e6, t.total / 1e6 / t.count, t.max / 1e6);
+
+        auto counters = mergedCounters();
+        if (!counters.empty())
+        {
+            std::fprintf(out, "%-28s %10s\n", "counter", "value");
+            for (const auto &[name, value] : counters)
+                std::fprintf(out, "%-28s %10llu\n", name.c_str(), static_cast<unsigned long long>(value));
+        }
+    }
+
+    // --- Trace-event format: one complete ("X") event per span, counters at the end ---
+    void writeChrome(FILE *out) const
+    {
+        long pid = static_cast<long>(::getpid());
+        std::fprintf(out, "{\"traceEvents\":[\n");
+        bool first = true;
+        for (const auto &log : logs)
+        {
+            for (const Event &e : log->events)
+            {
+                std::fprintf(out, "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%ld,\"tid\":%u}",
+                             first ? "" : ",\n", e.name, e.start / 1e3, e.duration / 1e3, pid, log->tid);
+                first = false;
+            }
+        }
+        double end = now() / 1e3;
+        for (const auto &[name, value] : mergedCounters())
+        {
+            std::fprintf(out, "%s{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":%ld,\"args\":{\"value\":%llu}}",
+                         first ? "" : ",\n", name.c_str(), end, pid, static_cast<unsigned long long>(value));
+            first = false;
+        }
+        std::fprintf(out, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    }
+};
+
+// --- Times the enclosing scope under `name` ---
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char *spanName)
+        : name(Tracer::instance().enabled() ? spanName : nullptr)
+    {
+        if (name)
+            start = Tracer::instance().now();
+    }
+
+    ~TraceSpan()
+    {
+        stop();
+    }
+
+    // --- End the span before the scope does (for sequential phases) ---
+    void stop()
+    {
+        if (name)
+        {
+            Tracer &tracer = Tracer::instance();
+            tracer.record(name, start, tracer.now() - start);
+            name = nullptr;
+        }
+    }
+
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+private:
+    const char *name;
+    uint64_t start = 0;
+};
+
+// --- Add `delta` to the counter `name` ---
+inline void traceCount(const char *name, uint64_t delta = 1)
+{
+    Tracer &tracer = Tracer::instance();
+    if (tracer.enabled())
+        tracer.count(name, delta);
+}